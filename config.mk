@@ -1,10 +1,17 @@
 CXX = clang++
 
+OPT_CXXFLAGS = -ffunction-sections -fdata-sections -flto -Ofast -march=native
+OPT_LDFLAGS = -s -Wl,--gc-sections -flto -Ofast
+
 CXXFLAGS += -std=c++17 -Wall -Wextra -Werror -pedantic
-opt: CXXFLAGS += -ffunction-sections -fdata-sections -flto -Ofast -march=native
+opt: CXXFLAGS += ${OPT_CXXFLAGS}
 debug: CXXFLAGS += -O0 -g
 
 LDFLAGS += -fuse-ld=gold
-opt: LDFLAGS += -s -Wl,--gc-sections -flto -Ofast
+opt: LDFLAGS += ${OPT_LDFLAGS}
+
+# Benchmarks are only meaningful with optimisations on.
+bench: CXXFLAGS += ${OPT_CXXFLAGS}
+bench: LDFLAGS += ${OPT_LDFLAGS}
 
 LDLIBS = -lpthread
@@ -0,0 +1,60 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <cstddef>
+#include <memory_resource>
+
+// A bump-pointer memory resource for strings which all die at the same time,
+// such as those built while handling one request. Allocating is a pointer
+// increment within a large block, deallocating does nothing, and all of the
+// memory is handed back at once when the arena is released or destroyed.
+// Arena arena;
+// String foo{"a string too long to be stored inline", &arena};
+// ...
+// arena.release();  // foo must not be used (or destroyed) after this.
+//
+// An arena is not thread-safe: give each thread (or request) its own.
+class Arena : public std::pmr::memory_resource {
+ public:
+  using Size = unsigned long long;
+
+  // Constructs an arena which takes blocks of at least block_size bytes from
+  // upstream (the global heap if null) as it needs them. Nothing is allocated
+  // until the first string is.
+  explicit Arena(Size block_size = 64 * 1024,
+                 std::pmr::memory_resource* upstream = nullptr);
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // Returns all memory to upstream.
+  ~Arena();
+
+  // Returns all memory to upstream at once. Everything allocated from the arena
+  // so far becomes invalid. The arena can then be reused.
+  void release();
+
+  // Returns the number of bytes handed out since the arena was created or
+  // last released.
+  Size bytes_used() const;
+
+ private:
+  struct Block {
+    Block* next;
+    Size size;
+  };
+
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+  void do_deallocate(void* p, std::size_t bytes,
+                     std::size_t alignment) override;
+  bool do_is_equal(const std::pmr::memory_resource& other)
+      const noexcept override;
+
+  Size block_size_;
+  std::pmr::memory_resource* upstream_;
+  Block* blocks_ = nullptr;
+  char* current_ = nullptr;
+  char* end_ = nullptr;
+  Size bytes_used_ = 0;
+};
+
+#endif // ARENA_H
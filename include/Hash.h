@@ -0,0 +1,30 @@
+#ifndef HASH_H
+#define HASH_H
+#include <cstddef>
+#include <functional>
+
+#include "StringView.h"
+
+// A fast non-cryptographic 64-bit hash of the chars of a view, in the style of
+// wyhash: it reads 16 bytes per step (48 for long strings) and folds them in
+// with 64x64->128 bit multiplies. Short strings are read with a couple of
+// overlapping loads rather than a loop. It is fine for hash tables but gives
+// no protection against inputs chosen to collide.
+// hash("user_id") == hash(view(String{"user_id"}));  // always true
+StringView::Size hash(StringView v);
+
+// Strings and views can be used as keys of unordered containers. Hashing a
+// String goes through String::hash(), so shared strings only work out their
+// hash once.
+// std::unordered_map<String, int> counts;
+namespace std {
+template <> struct hash<String> {
+  std::size_t operator()(const String& s) const { return s.hash(); }
+};
+
+template <> struct hash<StringView> {
+  std::size_t operator()(StringView v) const { return ::hash(v); }
+};
+}  // namespace std
+
+#endif // HASH_H
@@ -0,0 +1,103 @@
+#ifndef INTERN_H
+#define INTERN_H
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+#include "StringView.h"
+
+// A pool which stores each distinct string once and hands out small handles
+// to it. Two handles from the same pool are equal exactly when their strings
+// are, so comparing (or hashing) them never looks at the chars. This suits
+// data with a lot of repetition, like identifiers or field names.
+// InternPool pool;
+// InternPool::Handle a = pool.intern("user_id");
+// InternPool::Handle b = pool.intern(view(field_name));
+// if (a == b) ...  // one pointer comparison
+//
+// Interned chars are packed into large slabs together with their hash and
+// length, so interning a new string is a bump allocation rather than a heap
+// allocation, and a handle is a single pointer. Nothing is freed until the
+// pool is destroyed, and handles (and views of them) are valid until then.
+//
+// Any number of threads may intern and look up strings at once. Looking up a
+// string which is already in the pool never takes a lock or writes to shared
+// memory, so it scales with the number of cores. Adding a string locks one of
+// many shards, chosen by hash, each with its own table and slabs, so threads
+// only wait for each other when they add to the same shard.
+class InternPool {
+ public:
+  using Size = StringView::Size;
+
+  class Handle;
+
+  InternPool();
+
+  InternPool(const InternPool&) = delete;
+  InternPool& operator=(const InternPool&) = delete;
+
+  ~InternPool();
+
+  // Returns the handle for s, adding a copy of s to the pool if it isn't in
+  // it already.
+  Handle intern(StringView s);
+
+  // Returns the handle for s if it has been interned, or a null handle if it
+  // hasn't. Never adds to the pool.
+  Handle find(StringView s) const;
+
+  // Returns the number of distinct strings in the pool.
+  Size size() const;
+
+  // Returns the number of bytes the pool holds for its strings and tables.
+  Size bytes_used() const;
+
+ private:
+  struct Entry;
+  struct Table;
+  struct Shard;
+
+  Shard& shard(Size hash) const;
+
+  std::unique_ptr<Shard[]> shards_;
+};
+
+// A reference to a string in an InternPool. Handles are as cheap to copy as a
+// pointer. A default-constructed handle is null: it is false in a boolean
+// context, its view is empty and it equals no handle but another null one.
+class InternPool::Handle {
+ public:
+  Handle() = default;
+
+  // Returns the interned chars. They are followed by a nul terminator.
+  StringView view() const;
+  const char* data() const;
+  Size length() const;
+
+  // Returns hash(view()) (see Hash.h), worked out when the string was added.
+  Size hash() const;
+
+  explicit operator bool() const { return entry_ != nullptr; }
+
+  friend bool operator==(Handle a, Handle b) { return a.entry_ == b.entry_; }
+  friend bool operator!=(Handle a, Handle b) { return a.entry_ != b.entry_; }
+
+ private:
+  friend class InternPool;
+
+  explicit Handle(const Entry* entry) : entry_(entry) {}
+
+  const Entry* entry_ = nullptr;
+};
+
+// Handles hash by their stored hash, so they can be used as keys directly.
+// std::unordered_map<InternPool::Handle, int> counts;
+namespace std {
+template <> struct hash<InternPool::Handle> {
+  std::size_t operator()(InternPool::Handle handle) const {
+    return handle.hash();
+  }
+};
+}  // namespace std
+
+#endif // INTERN_H
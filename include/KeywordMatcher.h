@@ -0,0 +1,177 @@
+#ifndef KEYWORD_MATCHER_H
+#define KEYWORD_MATCHER_H
+#include <cstdint>
+#include <vector>
+
+#include "Search.h"
+#include "String.h"
+#include "StringView.h"
+
+// Finds every occurrence of any of a set of patterns in one pass over a text,
+// with the Aho-Corasick algorithm. Searching for each pattern in turn with
+// find() reads the text once per pattern; a matcher reads each char of the
+// text once and follows one transition per char, however many patterns there
+// are, so it costs O(text + matches). Building it costs O(total pattern
+// length), so a matcher is built once and then used for many texts.
+// KeywordMatcher keywords{{String{"error"}, String{"fatal"}, String{"oom"}}};
+// keywords.for_each_match(log, [](KeywordMatcher::Match match) {
+//   std::cout << match.pattern << " at " << match.position << "\n";
+// });
+//
+// The patterns form a trie, and each state of the automaton is a node of it.
+// Transitions are on byte classes: the bytes which appear in some pattern get
+// a class each, and all other bytes share class 0, so the tables are only as
+// wide as the patterns' alphabet. The shallow states, where a scan spends
+// nearly all of its time, have a full row of transitions each, so a step from
+// one of them is a single load. Deeper states only keep their trie edges and
+// fall back along their failure links to a shallower state, which keeps the
+// tables small for tens of thousands of patterns.
+//
+// '\0' is matched like any other char. Empty patterns never match.
+class KeywordMatcher {
+ public:
+  using Size = String::Size;
+
+  // An occurrence of patterns[pattern] starting at position in the text.
+  struct Match {
+    Size pattern;
+    Size position;
+  };
+
+  // Compiles patterns into a matcher. Matches refer to patterns by their
+  // index in the vector, and equal patterns each get their own matches.
+  explicit KeywordMatcher(const std::vector<StringView>& patterns);
+  explicit KeywordMatcher(const std::vector<String>& patterns);
+
+  // Calls on_match(Match) for every occurrence of every pattern in text,
+  // including ones which overlap. Matches are reported in the order they end;
+  // matches which end at the same char are reported longest first.
+  template <typename F>
+  void for_each_match(StringView text, const F& on_match) const {
+    std::uint32_t state = 0;
+    Scan(text, 0, state, on_match);
+  }
+
+  // Returns every match, in the order for_each_match() reports them.
+  std::vector<Match> find_all(StringView text) const;
+
+  // Returns the match which ends first, or the longest of those if more than
+  // one ends at the same char, stopping the scan there. Returns a match with
+  // pattern == kNotFound if there is none.
+  Match find_first(StringView text) const;
+
+  // Scans a text which arrives in chunks, such as from a socket, carrying the
+  // state of the automaton from each chunk to the next so that a match split
+  // between chunks is still found. Positions count from the start of the
+  // first chunk. The matcher must outlive the stream.
+  // KeywordMatcher::Stream stream{keywords};
+  // while (Read(socket, buffer)) stream.feed(buffer, on_match);
+  class Stream {
+   public:
+    explicit Stream(const KeywordMatcher& matcher) : matcher_(&matcher) {}
+
+    // Scans the next chunk of the text, calling on_match(Match) as
+    // for_each_match() does.
+    template <typename F> void feed(StringView chunk, const F& on_match) {
+      matcher_->Scan(chunk, position_, state_, on_match);
+      position_ += chunk.length();
+    }
+
+    // Returns how many chars have been fed so far.
+    Size position() const { return position_; }
+
+    // Starts again at the beginning of a new text.
+    void reset() {
+      state_ = 0;
+      position_ = 0;
+    }
+
+   private:
+    const KeywordMatcher* matcher_;
+    std::uint32_t state_ = 0;
+    Size position_ = 0;
+  };
+
+  // Returns the number of patterns and of states of the automaton.
+  Size patterns() const;
+  Size states() const;
+
+  // Returns the number of bytes the matcher holds in its tables.
+  Size bytes_used() const;
+
+ private:
+  // Set in a transition's target when the target state has matches to
+  // report, so that a scan only looks further when it does.
+  static constexpr std::uint32_t kHasMatches = std::uint32_t{1} << 31;
+  static constexpr std::uint32_t kNone = ~std::uint32_t{0};
+
+  // Returns the target of the transition on class c from a state without a
+  // full row, with kHasMatches set if it has matches.
+  std::uint32_t NextSparse(std::uint32_t state, std::uint16_t c) const;
+
+  // Steps through text from state, reporting matches with positions counted
+  // from offset, and leaves state where the text ends.
+  template <typename F>
+  void Scan(StringView text, Size offset, std::uint32_t& state,
+            const F& on_match) const {
+    const unsigned char* chars =
+        reinterpret_cast<const unsigned char*>(text.data());
+    // Copied out of the matcher, as on_match could (as far as the compiler
+    // knows) change the members.
+    const std::uint32_t* dense = dense_.data();
+    const std::uint16_t* class_of = class_of_;
+    std::uint32_t dense_states = dense_states_;
+    unsigned row_shift = row_shift_;
+    std::uint32_t current = state;
+    for (Size i = 0; i < text.length(); i++) {
+      std::uint16_t c = class_of[chars[i]];
+      current = current < dense_states ? dense[(current << row_shift) + c]
+                                       : NextSparse(current, c);
+      if (current & kHasMatches) {
+        current &= ~kHasMatches;
+        Report(current, offset + i + 1, on_match);
+      }
+    }
+    state = current;
+  }
+
+  // Reports the matches which end at end in state: its own patterns, then
+  // those of each shorter state along its chain of output links.
+  template <typename F>
+  void Report(std::uint32_t state, Size end, const F& on_match) const {
+    for (std::uint32_t s = state; s != kNone; s = output_link_[s]) {
+      for (std::uint32_t p = first_pattern_[s]; p != kNone;
+           p = next_pattern_[p]) {
+        on_match(Match{p, end - pattern_lengths_[p]});
+      }
+    }
+  }
+
+  // The class of each byte, and how many classes there are.
+  std::uint16_t class_of_[256];
+  Size classes_;
+  // States are numbered in breadth-first order, so the shallowest come
+  // first. States below dense_states_ have a full row of targets in dense_,
+  // with room for 1 << row_shift_ >= classes_ of them so that finding a row
+  // is a shift rather than a multiply; the others have their trie edges in
+  // edge_classes_ and edge_targets_ from edges_begin_[state] to
+  // edges_begin_[state + 1].
+  std::uint32_t dense_states_;
+  unsigned row_shift_;
+  std::vector<std::uint32_t> dense_;
+  std::vector<std::uint32_t> edges_begin_;
+  std::vector<std::uint16_t> edge_classes_;
+  std::vector<std::uint32_t> edge_targets_;
+  // The state of the longest proper suffix of each state's chars which is
+  // also in the trie.
+  std::vector<std::uint32_t> failure_;
+  // The first pattern which ends at each state, or kNone; then each
+  // pattern's next one which ends at the same state.
+  std::vector<std::uint32_t> first_pattern_;
+  std::vector<std::uint32_t> next_pattern_;
+  // The nearest state along the failure links with a pattern of its own.
+  std::vector<std::uint32_t> output_link_;
+  std::vector<Size> pattern_lengths_;
+};
+
+#endif // KEYWORD_MATCHER_H
@@ -0,0 +1,92 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+#include <optional>
+#include <type_traits>
+
+#include "String.h"
+#include "StringBuilder.h"
+#include "StringView.h"
+
+// Converting numbers to and from text without streams. Formatting writes the
+// digits into a small buffer on the stack and copies them into the string,
+// so it never allocates unless the string has to grow, and neither direction
+// depends on the locale. Numbers are written in the shortest form which reads
+// back as the same value, the way std::to_chars writes them:
+// to_string(-42);  // "-42"
+// to_string(0.1);  // "0.1"
+// to_string(1e21);  // "1e+21"
+// StringBuilder out;
+// out << "requests_total " << count << '\n';
+
+// Whether T is formatted as a number. chars and bools are not, so that
+// out << 'x' still adds a char.
+template <typename T>
+constexpr bool kIsNumber = std::is_arithmetic_v<T> &&
+                           !std::is_same_v<T, bool> &&
+                           !std::is_same_v<T, char>;
+
+template <typename T>
+using EnableIfNumber = std::enable_if_t<kIsNumber<T>>;
+
+// The most chars write_number() writes, for any number.
+constexpr String::Size kMaxNumberLength = 32;
+
+// Writes value to out, which must have room for kMaxNumberLength chars, and
+// returns the number of chars written. No nul terminator is written.
+String::Size write_number(char* out, long long value);
+String::Size write_number(char* out, unsigned long long value);
+String::Size write_number(char* out, float value);
+String::Size write_number(char* out, double value);
+
+template <typename Number, typename = EnableIfNumber<Number>>
+String::Size write_number(char* out, Number value) {
+  if constexpr (std::is_floating_point_v<Number>) {
+    return write_number(out, static_cast<double>(value));
+  } else if constexpr (std::is_signed_v<Number>) {
+    return write_number(out, static_cast<long long>(value));
+  } else {
+    return write_number(out, static_cast<unsigned long long>(value));
+  }
+}
+
+// Returns value written as text. Up to 15 chars fit inline, so most numbers
+// don't allocate at all.
+template <typename Number, typename = EnableIfNumber<Number>>
+String to_string(Number value) {
+  char digits[kMaxNumberLength];
+  return String{digits, write_number(digits, value)};
+}
+
+// Adds value, written as text, to the end of s or of what out is building.
+// String line{"latency_ms "};
+// append_number(line, 12.5);  // line is now "latency_ms 12.5"
+template <typename Number, typename = EnableIfNumber<Number>>
+void append_number(String& s, Number value) {
+  char digits[kMaxNumberLength];
+  s.append(digits, write_number(digits, value));
+}
+
+template <typename Number, typename = EnableIfNumber<Number>>
+StringBuilder& append_number(StringBuilder& out, Number value) {
+  char digits[kMaxNumberLength];
+  return out.append(digits, write_number(digits, value));
+}
+
+template <typename Number, typename = EnableIfNumber<Number>>
+StringBuilder& operator<<(StringBuilder& out, Number value) {
+  return append_number(out, value);
+}
+
+// Parses the whole of text as a number and returns it, or returns nullopt if
+// text is anything else: empty, with spaces or other chars around the number,
+// with a leading '+', or out of range for the type. Integers are decimal.
+// Floating point numbers may have an exponent and may be "inf" or "nan".
+// Nothing is copied, so fields from split() can be parsed in place.
+// for (StringView field : split(row, ',')) {
+//   if (auto value = parse_double(field)) total += *value;
+// }
+std::optional<long long> parse_int(StringView text);
+std::optional<unsigned long long> parse_uint(StringView text);
+std::optional<double> parse_double(StringView text);
+
+#endif // NUMBER_H
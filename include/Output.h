@@ -0,0 +1,103 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <limits.h>
+#include <sys/uio.h>
+
+#include "Number.h"
+#include "String.h"
+#include "StringView.h"
+
+// Collects many pieces of output, such as the fields of a log record or the
+// headers and body of a response, and writes them all to a file descriptor at
+// once with writev(). Long pieces aren't copied: they go straight from their
+// own buffers to the kernel, where an std::ostream copies every piece into its
+// buffer first. Pieces shorter than kCopyBelow are copied into a buffer in
+// the batch instead, one after another, as the kernel takes longer to step to
+// the next piece of a writev() than to copy that many chars.
+// OutputBatch out{STDOUT_FILENO};
+// out << method << ' ' << path << " took " << elapsed_ms << "ms\n";
+// out << response_body;  // not copied
+// out.flush();
+//
+// Temporary Strings, such as the result of a + b, are moved into the batch
+// and kept there until they have been written. Anything else - a String
+// variable, a view or a const char* string - is only pointed at, so its chars
+// must stay alive and unchanged until the next flush. Move a String in
+// (out << std::move(s)) to have the batch keep it, or copy() a view to have
+// the batch copy it. Literals, chars and numbers are always safe.
+class OutputBatch {
+ public:
+  using Size = String::Size;
+
+  // The most pieces a batch holds. Adding one more first writes the others.
+  static constexpr Size kMaxPieces = IOV_MAX;
+
+  // Pieces shorter than this are copied rather than pointed at.
+  static constexpr Size kCopyBelow = 128;
+
+  // The size of the buffer short pieces are copied into. Filling it writes
+  // everything so far.
+  static constexpr Size kBufferSize = 16 << 10;
+
+  explicit OutputBatch(int fd);
+
+  OutputBatch(const OutputBatch&) = delete;
+  OutputBatch& operator=(const OutputBatch&) = delete;
+
+  // Writes whatever is left. Errors are ignored here; call flush() first to
+  // find out about them.
+  ~OutputBatch();
+
+  // Adds a piece to the end of the output.
+  OutputBatch& add(String&& s);
+  OutputBatch& add(StringView v);
+  OutputBatch& add(const String& s) { return add(StringView{s}); }
+  OutputBatch& add(StaticString s) { return add(StringView{s}); }
+  OutputBatch& add(const char* c_str) { return add(StringView{c_str}); }
+  OutputBatch& add(char c) { return copy(StringView{&c, 1}); }
+
+  // Adds a copy of v, so that its chars needn't outlive the call.
+  OutputBatch& copy(StringView v);
+  OutputBatch& operator<<(String&& s) { return add(std::move(s)); }
+  OutputBatch& operator<<(StringView v) { return add(v); }
+  OutputBatch& operator<<(const String& s) { return add(s); }
+  OutputBatch& operator<<(StaticString s) { return add(s); }
+  OutputBatch& operator<<(const char* c_str) { return add(c_str); }
+  OutputBatch& operator<<(char c) { return add(c); }
+
+  // Returns the number of pieces and of chars waiting to be written.
+  Size pieces() const;
+  Size length() const;
+
+  // Writes every piece, in order, and empties the batch. Short writes are
+  // continued from where they stopped, and a non-blocking descriptor is
+  // waited on until it can take more. Throws std::system_error if writing
+  // fails, leaving the pieces which weren't written in the batch.
+  void flush();
+
+ private:
+  int fd_;
+  // Pieces moved into the batch. A deque never moves its elements, so
+  // pieces_ can point into them, even at the chars of an inline string.
+  std::deque<String> strings_;
+  std::vector<iovec> pieces_;
+  // Holds the short pieces. Allocated when the first one is added.
+  std::unique_ptr<char[]> buffer_;
+  Size buffer_used_ = 0;
+  // pieces_[0, written_) have been written by a flush which then failed.
+  Size written_ = 0;
+  Size length_ = 0;
+};
+
+// Adds value written as text.
+template <typename Number, typename = EnableIfNumber<Number>>
+OutputBatch& operator<<(OutputBatch& out, Number value) {
+  char digits[kMaxNumberLength];
+  return out.copy(StringView{digits, write_number(digits, value)});
+}
+
+#endif // OUTPUT_H
@@ -0,0 +1,134 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "String.h"
+#include "StringView.h"
+
+// Multi-threaded versions of the operations which scan or write every char of
+// a string, for strings of many megabytes. Each one splits the string into
+// chunks small enough to stay in a core's cache, and the threads of a pool
+// take chunks in turn until there are none left. Strings shorter than the
+// pool's threshold are handled on the calling thread, exactly like the
+// single-threaded versions, so these can be used everywhere.
+// String blob = String::map_file("dump.bin");
+// parallel::count(blob, '\n');  // all cores
+//
+// The results are always the same as the single-threaded versions': searches
+// look past the end of each chunk for matches which start in it, and find()
+// returns the first match in the whole string, not the first one a thread
+// happens to see.
+namespace parallel {
+
+using Size = String::Size;
+
+// Strings at least this long are split between threads by default.
+constexpr Size kDefaultThreshold = 1 << 20;
+
+// Chunks are this big by default, about the size of a core's L2 cache.
+constexpr Size kDefaultChunkSize = 256 << 10;
+
+// A fixed set of worker threads. A pool runs one batch of tasks at a time;
+// the calling thread works on the batch too, and run() returns once the whole
+// batch is done. A pool may be used from any number of threads, which take
+// turns.
+// parallel::ThreadPool pool{8};
+// pool.run(100, [&](Size i) { Process(i); });
+class ThreadPool {
+ public:
+  // Starts threads - 1 workers, so that with the calling thread there are
+  // threads threads in all.
+  explicit ThreadPool(unsigned threads, Size threshold = kDefaultThreshold,
+                      Size chunk_size = kDefaultChunkSize);
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Waits for the current batch, if any, and stops the workers.
+  ~ThreadPool();
+
+  // Returns the pool used when none is given: one thread per core, created
+  // the first time it is asked for and never destroyed.
+  static ThreadPool& shared();
+
+  // Returns the number of threads working on each batch, counting the caller.
+  unsigned threads() const;
+
+  // Strings shorter than the threshold are handled on the calling thread.
+  Size threshold() const;
+  void set_threshold(Size threshold);
+
+  // Returns the number of chars each task handles.
+  Size chunk_size() const;
+
+  // Calls task(i) for each i in [0, count), on any of the pool's threads and
+  // the calling one, and returns when every call has returned. task must not
+  // throw. A task may itself call run(), or a parallel algorithm, on the same
+  // pool: as the pool's threads are busy with the outer batch, the nested
+  // call runs its tasks one after another on the task's own thread.
+  void run(Size count, const std::function<void(Size)>& task);
+
+ private:
+  // Runs the current batch's tasks until there are none left.
+  void work_on(const std::function<void(Size)>& task, Size count);
+
+  // The loop each worker thread runs.
+  void work();
+
+  std::atomic<Size> threshold_;
+  Size chunk_size_;
+  std::vector<std::thread> workers_;
+
+  // Held for the whole of run(), so that batches take turns.
+  std::mutex run_mutex_;
+  // Everything below is guarded by mutex_, apart from next_.
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  const std::function<void(Size)>* task_ = nullptr;
+  Size count_ = 0;
+  // The index of the next task to run in the current batch.
+  std::atomic<Size> next_{0};
+  // Counts batches, so that workers can tell when there is a new one.
+  Size batch_ = 0;
+  // The number of workers taking tasks from the current batch.
+  unsigned active_ = 0;
+  bool stopping_ = false;
+};
+
+// Return the same as String(c, size), String(v) and a + b, with the chars
+// written by all of the pool's threads.
+String fill(char c, Size size, ThreadPool& pool = ThreadPool::shared());
+String copy(StringView v, ThreadPool& pool = ThreadPool::shared());
+String concat(StringView a, StringView b,
+              ThreadPool& pool = ThreadPool::shared());
+
+// Return the same as find() and count() in Search.h. find() returns as soon
+// as the first match is known: chunks after one with a match aren't searched.
+Size find(StringView haystack, char c,
+          ThreadPool& pool = ThreadPool::shared());
+Size find(StringView haystack, StringView needle,
+          ThreadPool& pool = ThreadPool::shared());
+Size count(StringView haystack, char c,
+           ThreadPool& pool = ThreadPool::shared());
+Size count(StringView haystack, StringView needle,
+           ThreadPool& pool = ThreadPool::shared());
+
+// Return or do the same as the functions of the same names in Transform.h.
+String to_lower(StringView v, ThreadPool& pool = ThreadPool::shared());
+String to_upper(StringView v, ThreadPool& pool = ThreadPool::shared());
+void to_lower_in_place(String& s, ThreadPool& pool = ThreadPool::shared());
+void to_upper_in_place(String& s, ThreadPool& pool = ThreadPool::shared());
+String replace(StringView v, char from, char to,
+               ThreadPool& pool = ThreadPool::shared());
+void replace_in_place(String& s, char from, char to,
+                      ThreadPool& pool = ThreadPool::shared());
+
+}  // namespace parallel
+
+#endif // PARALLEL_H
@@ -0,0 +1,112 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+// Allocation profiling for String buffers. When built with -DSTRING_PROFILING,
+// every heap buffer a String allocates or frees is counted: how many, how big
+// and which String operation asked for it. Counting only touches counters
+// belonging to the current thread, so it is cheap and never takes a lock;
+// snapshot() adds up the counters of every thread when asked. Without
+// -DSTRING_PROFILING, all of this compiles away and snapshot() returns zeros.
+//
+// auto before = profile::snapshot();
+// HandleRequest();
+// auto churn = profile::difference(profile::snapshot(), before);
+// std::cout << churn.allocations << " allocations\n";
+namespace profile {
+
+using Size = unsigned long long;
+
+#ifdef STRING_PROFILING
+constexpr bool kEnabled = true;
+#else
+constexpr bool kEnabled = false;
+#endif
+
+// The String operations which allocations are attributed to.
+enum class Operation {
+  kFill,        // String(char, Size)
+  kCString,     // String(const char*)
+  kBuffer,      // String(const char*, Size) and String(StringView)
+  kCopy,        // the copy constructors
+  kCopyAssign,  // copy assignment
+  kConcat,      // turning a + b + ... into a String
+  kSubstring,   // substring()
+  kShare,       // String::share()
+  kUnshare,     // copying a shared buffer before writing to it
+  kAppend,      // reserve(), push_back() and append() growing a string
+  kOther,       // anything else
+  kCount,
+};
+
+// Returns a printable name for an operation, such as "copy_assign".
+const char* name(Operation operation);
+
+// Allocations are grouped by size into powers of two: bucket i counts
+// allocations of between 2^i and 2^(i+1) - 1 bytes.
+constexpr int kHistogramBuckets = 64;
+
+struct OperationCounts {
+  Size allocations = 0;
+  Size bytes = 0;
+};
+
+struct Snapshot {
+  Size allocations = 0;
+  Size deallocations = 0;
+  // Bytes allocated in total, ever, and bytes allocated but not yet freed.
+  Size total_bytes = 0;
+  Size live_bytes = 0;
+  Size histogram[kHistogramBuckets] = {};
+  OperationCounts operations[static_cast<int>(Operation::kCount)] = {};
+
+  const OperationCounts& operator[](Operation operation) const {
+    return operations[static_cast<int>(operation)];
+  }
+};
+
+// Returns the counts so far, added up over every thread (including threads
+// which have exited).
+Snapshot snapshot();
+
+// Returns what happened between two snapshots. live_bytes is taken from later.
+Snapshot difference(const Snapshot& later, const Snapshot& earlier);
+
+// Returns the histogram bucket an allocation of the given size is counted in.
+int bucket(Size bytes);
+
+#ifdef STRING_PROFILING
+
+// While a Scope is alive, String allocations on this thread are attributed to
+// its operation rather than to the constructor that made them. Free functions
+// like substring() use this to claim the allocations they cause.
+class Scope {
+ public:
+  explicit Scope(Operation operation);
+  ~Scope();
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+
+ private:
+  Operation previous_;
+  bool had_previous_;
+};
+
+// Called by String whenever it allocates or frees a heap buffer.
+void record_allocation(Operation operation, Size bytes);
+void record_deallocation(Size bytes);
+
+#else
+
+class Scope {
+ public:
+  explicit Scope(Operation) {}
+};
+
+inline void record_allocation(Operation, Size) {}
+inline void record_deallocation(Size) {}
+
+#endif
+
+}  // namespace profile
+
+#endif // PROFILE_H
@@ -0,0 +1,41 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "StringView.h"
+
+// Searching within strings. These all take views, so they work on a String or
+// a view of part of one without copying it, and they treat '\0' like any other
+// char. Short needles are found with a vectorized filter on their first and
+// last chars; long ones with the two-way algorithm, so the worst case is
+// linear in the length of the haystack either way.
+
+// Returned by find() and rfind() when there is no match.
+constexpr StringView::Size kNotFound = ~StringView::Size{0};
+
+// Returns the position of the first occurrence of c or needle at or after
+// start, or kNotFound. An empty needle is found at start.
+// String foo{"one two one"};
+// find(foo, "one", 1);  // returns 8
+StringView::Size find(StringView haystack, char c, StringView::Size start = 0);
+StringView::Size find(StringView haystack, StringView needle,
+                      StringView::Size start = 0);
+
+// Returns the position of the last occurrence of c or needle, or kNotFound.
+// An empty needle is found at haystack.length().
+// String foo{"one two one"};
+// rfind(foo, 'o');  // returns 8
+StringView::Size rfind(StringView haystack, char c);
+StringView::Size rfind(StringView haystack, StringView needle);
+
+// Returns whether c or needle occurs anywhere in haystack.
+bool contains(StringView haystack, char c);
+bool contains(StringView haystack, StringView needle);
+
+// Returns the number of non-overlapping occurrences of c or needle, counting
+// from the start. An empty needle occurs haystack.length() + 1 times.
+// String foo{"aaaaa"};
+// count(foo, "aa");  // returns 2
+StringView::Size count(StringView haystack, char c);
+StringView::Size count(StringView haystack, StringView needle);
+
+#endif // SEARCH_H
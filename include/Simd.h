@@ -0,0 +1,93 @@
+#ifndef SIMD_H
+#define SIMD_H
+#include <cstdint>
+
+// Vectorized byte kernels used to build and copy strings. Each kernel has an
+// AVX2, an SSE2 and a scalar implementation. The best one this machine
+// supports is picked the first time a kernel is called.
+namespace simd {
+
+using Size = unsigned long long;
+
+// The instruction sets the kernels are written for, from slowest to fastest.
+enum class Isa {
+  kScalar,
+  kSse2,
+  kAvx2,
+};
+
+// Returns the fastest instruction set this machine supports.
+Isa detect();
+
+// Returns the instruction set the kernels are currently using.
+Isa selected();
+
+// Makes the kernels use a given instruction set, which must be supported by
+// this machine. This exists so that tests and benchmarks can compare the
+// implementations; it must not be called while other threads use the kernels.
+void select(Isa isa);
+
+// Returns the number of chars before the first nul in c_str, like strlen.
+Size length(const char* c_str);
+
+// Sets size chars starting at out to c, like memset.
+void fill(char* out, char c, Size size);
+
+// Copies size chars from in to out, like memcpy. The two must not overlap.
+void copy(char* out, const char* in, Size size);
+
+// Returns the index of the first (or, for rfind_byte, last) occurrence of c in
+// the size chars starting at data, or size if there is none.
+Size find_byte(const char* data, Size size, char c);
+Size rfind_byte(const char* data, Size size, char c);
+
+// Returns the number of occurrences of c in the size chars starting at data.
+Size count_byte(const char* data, Size size, char c);
+
+// Returns a bit for each of the first min(size, 64) chars starting at data:
+// bit i is set when data[i] == c. Scanning for several occurrences close
+// together, like the delimiters in a line of CSV, can then step through the
+// bits rather than calling find_byte for each one.
+std::uint64_t match_mask(const char* data, Size size, char c);
+
+// Returns whether the size chars starting at data are valid UTF-8. The AVX2
+// version checks 32 bytes at a time with byte shuffles, after Keiser and
+// Lemire; the SSE2 version only skips ASCII 32 bytes at a time.
+bool valid_utf8(const char* data, Size size);
+
+// Returns the number of chars in the size chars starting at data which are
+// not UTF-8 continuation bytes: the number of code points, if they are valid.
+Size count_code_points(const char* data, Size size);
+
+// Writes the size chars starting at in to out with the ASCII letters changed
+// to lower or upper case, leaving every other byte as it is. out may be in,
+// to change the case in place, but the two must not otherwise overlap.
+void to_lower(char* out, const char* in, Size size);
+void to_upper(char* out, const char* in, Size size);
+
+// Writes the size chars starting at in to out with every from changed to to.
+// out may be in, but the two must not otherwise overlap.
+void replace_byte(char* out, const char* in, Size size, char from, char to);
+
+// Returns the index of the first position at which the size chars starting at
+// a and at b differ other than in the case of ASCII letters, or size.
+Size mismatch_ignoring_case(const char* a, const char* b, Size size);
+
+// Returns the index of the first position at which the size chars starting at
+// a and at b differ, or size if they are all the same.
+Size mismatch(const char* a, const char* b, Size size);
+
+// Returns the index of the first (or, for rfind_pair, last) occurrence of the
+// needle_length >= 2 chars at needle in the size chars starting at data, or
+// size if there is none. Candidate positions are found by comparing a vector of
+// positions against the first and the last char of the needle at once, and
+// only positions matching both are compared in full. The worst case is
+// O(size * needle_length), so this is meant for short needles.
+Size find_pair(const char* data, Size size, const char* needle,
+               Size needle_length);
+Size rfind_pair(const char* data, Size size, const char* needle,
+                Size needle_length);
+
+}  // namespace simd
+
+#endif // SIMD_H
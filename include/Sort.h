@@ -0,0 +1,68 @@
+#ifndef SORT_H
+#define SORT_H
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Parallel.h"
+#include "String.h"
+#include "StringView.h"
+
+// Sorting many strings at once. std::sort compares two whole strings at every
+// step, reading both through data(), and moves each string around many times.
+// sort_strings() is a most-significant-digit radix sort instead: the strings
+// are dealt into 257 buckets by their first char (one for strings which have
+// ended), each bucket by the next char, and so on. Every key keeps a copy of
+// the next 8 of its chars beside it, so most steps never touch the strings'
+// own buffers. Buckets too small to be worth a radix pass are finished with
+// a multikey quicksort over those 8-char prefixes. Large inputs are split into
+// buckets on the calling thread first and the buckets are then sorted on all
+// of the pool's threads.
+//
+// The order is the same as operator< on views: bytes compare as unsigned
+// chars, '\0' like any other, and a proper prefix orders first. Equal strings
+// may end up in either order.
+// std::vector<String> names = ...;
+// sort_strings(names);
+
+// Inputs with at least this many strings are sorted on all of a pool's threads.
+constexpr String::Size kParallelSortFrom = 1 << 16;
+
+// How many items ahead sort_strings() fetches when moving them into place.
+constexpr String::Size kSortPrefetchAhead = 16;
+
+// Returns the indices of keys in the order that sorts them, so that
+// keys[order[0]] <= keys[order[1]] <= ... The keys are only read.
+std::vector<String::Size> sorted_order(
+    const std::vector<StringView>& keys,
+    parallel::ThreadPool& pool = parallel::ThreadPool::shared());
+
+// Sorts a random-access range of Strings, views or anything else a view can
+// be made from. The keys are sorted as views first, and only then are the
+// items moved into place, so every item is moved twice rather than O(log n)
+// times, and is never copied.
+template <typename Range>
+void sort_strings(Range& range,
+                  parallel::ThreadPool& pool = parallel::ThreadPool::shared()) {
+  using Size = String::Size;
+  auto first = std::begin(range);
+  std::vector<StringView> keys;
+  keys.reserve(std::distance(first, std::end(range)));
+  for (const auto& item : range) keys.emplace_back(item);
+  std::vector<Size> order = sorted_order(keys, pool);
+  // Gather the items in order into a new vector and move them back: two
+  // moves each, but the writes are in order and the reads can be fetched
+  // ahead, where following the cycles of the permutation jumps around both.
+  std::vector<std::decay_t<decltype(*first)>> sorted;
+  sorted.reserve(order.size());
+  for (Size i = 0; i < order.size(); i++) {
+    if (i + kSortPrefetchAhead < order.size()) {
+      __builtin_prefetch(&first[order[i + kSortPrefetchAhead]]);
+    }
+    sorted.push_back(std::move(first[order[i]]));
+  }
+  std::move(sorted.begin(), sorted.end(), first);
+}
+
+#endif // SORT_H
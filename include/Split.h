@@ -0,0 +1,136 @@
+#ifndef SPLIT_H
+#define SPLIT_H
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include "StringView.h"
+
+// Splitting strings into fields without copying them. split() and lines()
+// return a range which finds each field only as the loop reaches it, and each
+// field is a view into the original chars, so nothing is allocated however
+// many fields there are. The chars must outlive the views, as usual.
+// String row{"id,name,,email"};
+// for (StringView field : split(row, ',')) ...  // "id", "name", "", "email"
+//
+// Single char delimiters, and the newlines for lines(), are found by matching
+// 64 chars at a time with simd::match_mask and then stepping through the bits,
+// so a line of short fields costs one or two vector compares rather than a
+// scan per field. Longer delimiters are found with find() from Search.h.
+
+class Split;
+
+// Options for split() and lines(), which can be combined with |.
+using SplitOptions = unsigned;
+// Leave out fields which are empty (after trimming, if that is asked for).
+constexpr SplitOptions kSkipEmpty = 1 << 0;
+// Remove whitespace from both ends of each field, as trim() in Transform.h
+// does.
+constexpr SplitOptions kTrimWhitespace = 1 << 1;
+
+// Returns the fields of s between occurrences of delimiter. Without
+// kSkipEmpty, n delimiters give n + 1 fields, so an empty s gives one empty
+// field. An empty delimiter never matches, giving s as the only field.
+// for (StringView field : split(line, '\t', kTrimWhitespace)) ...
+// for (StringView part : split(text, ", ", kSkipEmpty)) ...
+Split split(StringView s, char delimiter, SplitOptions options = 0);
+Split split(StringView s, StringView delimiter, SplitOptions options = 0);
+
+// Returns the lines of s, split at '\n' with any '\r' before it removed. A
+// newline at the very end doesn't start another, empty, line, so an empty s
+// has no lines.
+// String file = String::map_file("data.tsv");
+// for (StringView line : lines(file)) ...
+Split lines(StringView s, SplitOptions options = 0);
+
+// The range returned by split() and lines().
+class Split {
+ public:
+  using Size = StringView::Size;
+
+  // A forward iterator over the fields.
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = StringView;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const StringView*;
+    using reference = const StringView&;
+
+    // Constructs an end iterator.
+    Iterator() = default;
+
+    const StringView& operator*() const { return field_; }
+    const StringView* operator->() const { return &field_; }
+
+    Iterator& operator++() {
+      advance();
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator old = *this;
+      advance();
+      return old;
+    }
+
+    // Iterators are equal when they are at the same field of the same range,
+    // or both at the end.
+    friend bool operator==(const Iterator& a, const Iterator& b) {
+      return a.split_ == b.split_ && a.field_.data() == b.field_.data() &&
+             a.rest_ == b.rest_;
+    }
+    friend bool operator!=(const Iterator& a, const Iterator& b) {
+      return !(a == b);
+    }
+
+   private:
+    friend class Split;
+
+    // Constructs an iterator at the first field of split.
+    explicit Iterator(const Split* split);
+
+    // Moves on to the next field, or to the end.
+    void advance();
+
+    // Returns the first occurrence of the split's char in [from, end), or end.
+    // from must not go backwards between calls.
+    const char* find_char(const char* from, const char* end);
+
+    // Null at the end.
+    const Split* split_ = nullptr;
+    StringView field_;
+    // The chars after the current field's delimiter, or null if the current
+    // field is the last.
+    const char* rest_ = nullptr;
+    // The chars find_char() last matched, and a bit for each of the 64 from
+    // there which is the split's char.
+    const char* block_ = nullptr;
+    std::uint64_t matches_ = 0;
+  };
+
+  Iterator begin() const { return Iterator{this}; }
+  Iterator end() const { return Iterator{}; }
+
+ private:
+  enum class Mode { kChar, kString, kLines };
+
+  friend Split split(StringView s, char delimiter, SplitOptions options);
+  friend Split split(StringView s, StringView delimiter,
+                     SplitOptions options);
+  friend Split lines(StringView s, SplitOptions options);
+
+  Split(StringView text, Mode mode, char c, StringView delimiter,
+        SplitOptions options)
+      : text_(text), mode_(mode), c_(c), delimiter_(delimiter),
+        options_(options) {}
+
+  StringView text_;
+  Mode mode_;
+  // The delimiter for kChar, which is '\n' for kLines.
+  char c_;
+  // The delimiter for kString.
+  StringView delimiter_;
+  SplitOptions options_;
+};
+
+#endif // SPLIT_H
@@ -1,7 +1,73 @@
 #ifndef STRING_H
 #define STRING_H
+#include <atomic>
+#include <cstddef>
 #include <iostream>
+#include <memory_resource>
+#include <type_traits>
 
+#include "Profile.h"
+#include "Simd.h"
+
+class StringView;
+template <typename Left, typename Right> class Concat;
+
+// A string literal with its length worked out at compile time, made with the
+// _s suffix. Turning one into a String neither counts nor copies its chars nor
+// allocates: the String points at the literal itself, in read-only storage,
+// and never frees it. Copies of that String are free too, and only something
+// which changes it makes a copy of its own. The conversion is constexpr, so a
+// String constant at namespace scope is set up at compile time rather than by
+// code run at startup.
+// const String kContentType = "content-type"_s;
+// static_assert("content-type"_s.length() == 12);
+class StaticString {
+ public:
+  using Size = unsigned long long;
+
+  // Returns the chars of the literal, followed by its nul terminator.
+  constexpr const char* data() const { return data_; }
+
+  constexpr Size length() const { return length_; }
+
+ private:
+  constexpr StaticString(const char* data, Size length)
+      : data_(data), length_(length) {}
+
+  friend constexpr StaticString operator""_s(const char* chars,
+                                             std::size_t length);
+  friend constexpr StaticString substring(StaticString s, Size start);
+
+  const char* data_;
+  Size length_;
+};
+
+constexpr StaticString operator""_s(const char* chars, std::size_t length) {
+  return StaticString{chars, length};
+}
+
+// Strings which are too long to be stored inline normally get their buffer from
+// the global heap. The constructors below can instead be given a memory
+// resource (such as an Arena) to allocate the buffer from. The resource is a
+// property of the buffer rather than of the string: a buffer remembers where it
+// came from and is always returned there, even after being moved to another
+// string, and a copy uses the global heap unless it is given a resource too.
+// The resource must outlive every buffer allocated from it.
+//
+// Copying a string normally copies its buffer. A string which is copied often
+// but rarely changed can opt in to sharing instead with share(): from then on,
+// copies of it point at the same buffer and just bump an atomic reference
+// count, so copies may be made and destroyed on any number of threads at once.
+// The buffer is only copied again when someone asks for a mutable data().
+//
+// Strings are normally allocated to exactly fit their contents. A string which
+// is built up piece by piece with append() or push_back() instead grows its
+// buffer geometrically, so that n appends cost O(n) in total rather than the
+// O(n^2) of repeatedly writing s = s + piece. reserve() sets aside room up
+// front when the final length is roughly known.
+//
+// A large file can be turned into a string without reading it with
+// map_file(). The string's chars are then the file's pages, mapped read-only.
 class String {
  public:
   using Size = unsigned long long;
@@ -11,15 +77,42 @@ class String {
   String();
 
   // Constructs a new string containing a given repeated character.
-  String(char c, Size size);
+  String(char c, Size size, std::pmr::memory_resource* resource = nullptr);
 
   // Construct a string by copying the value of a nul-terminated string.
   // String foo{"Hello!"};
-  String(const char* c_str);
+  String(const char* c_str, std::pmr::memory_resource* resource = nullptr);
 
   // Construct a string by copying a fixed number of bytes from a buffer.
   // String foo{"Hello!", 6};
-  String(const char* data, Size size);
+  String(const char* data, Size size,
+         std::pmr::memory_resource* resource = nullptr);
+
+  // Construct a string by copying the contents of a view. Views never own
+  // their chars, so this is how to get an owning copy of one.
+  // String foo{substring(view(bar), 3)};
+  explicit String(StringView view,
+                  std::pmr::memory_resource* resource = nullptr);
+
+  // Construct a string which points at a literal rather than copying it (see
+  // StaticString above). This is constexpr and never allocates.
+  // String foo = "Hello!"_s;
+  constexpr String(StaticString literal)
+      : heap_{const_cast<char*>(literal.data()),
+              literal.length() | kHeapFlag | kStaticFlag} {}
+
+  // Construct a string from a chain of concatenations. The total length is
+  // worked out first, so the result is allocated once and each piece is
+  // copied once, however many pieces there are.
+  // String foo = a + ", " + b + "!";
+  template <typename Left, typename Right>
+  String(const Concat<Left, Right>& concat,
+         std::pmr::memory_resource* resource = nullptr);
+
+  // Construct a copy of other with its buffer allocated from resource.
+  // Arena arena;
+  // String foo{bar, &arena};
+  String(const String& other, std::pmr::memory_resource* resource);
 
   // Rule of five - if you ever have to implement any of the next five
   // functions,  you probably need to implement the other four or you will
@@ -43,7 +136,7 @@ class String {
   // String bar{std::move(foo)};  // move
   // std::cout << bar << "\n";  // shows "Hello!"
   // std::cout << foo << "\n";  // allowed to show anything but must not crash.
-  String(String&& other);
+  String(String&& other) noexcept;
 
   // Copy-assignment operator: Overwrite this string with a copy of other.
   // Take care not to have any memory leaks!
@@ -61,13 +154,17 @@ class String {
   // foo = std::move(bar);  // move-assign.
   // std::cout << bar << "\n";  // shows "Hello!"
   // std::cout << foo << "\n";  // allowed to show anything but must not crash.
-  String& operator=(String&& other);
+  String& operator=(String&& other) noexcept;
 
   // Returns a pointer to length()+1 chars, where the first length() chars are
   // the contents of the string and the last char is a nul terminator.
   // String foo{"Hello!"};
   // char* c_string = foo.data();
   // std::cout << c_string << "\n";  // shows "Hello!"
+  //
+  // On a shared, mapped or literal string, the non-const data() first gives
+  // this string its own copy of the buffer, so that writes through it don't
+  // affect other strings, the file or the literal.
   const char* data() const;
   char* data();
 
@@ -76,25 +173,379 @@ class String {
   // std::cout << foo.length() << "\n";  // shows 6.
   Size length() const;
 
+  // Returns the number of chars the string can hold without reallocating.
+  // This is at least length(), and kInlineCapacity for short strings. Shared,
+  // mapped and literal strings have no spare capacity, as any change makes a
+  // private copy.
+  Size capacity() const;
+
+  // Makes room for at least capacity chars, so that appends up to that length
+  // don't reallocate. Never shrinks the string.
+  // String foo;
+  // foo.reserve(1000);
+  void reserve(Size capacity);
+
+  // Adds chars to the end of the string. When the buffer is full it is
+  // replaced with one of at least twice the capacity, in the same memory
+  // resource. Appending part of a string to itself is fine.
+  // String foo{"Hello"};
+  // foo.push_back(',');
+  // foo.append(" World!", 7);  // foo is now "Hello, World!"
+  void push_back(char c);
+  void append(const char* data, Size size);
+  void append(const String& s);
+
+  // Shorten the string in its own buffer: truncate() keeps its first length
+  // chars, and remove_prefix() drops its first count chars and moves the rest
+  // to the front. Neither allocates unless the string is shared, mapped or a
+  // literal, in which case it gets a copy of the chars it keeps. The buffer
+  // isn't shrunk; its spare room is given back when the string is destroyed.
+  // A length or count beyond length() is treated as length().
+  // String foo{"Hello, World!"};
+  // foo.truncate(12);  // "Hello, World"
+  // foo.remove_prefix(7);  // "World"
+  void truncate(Size length);
+  void remove_prefix(Size count);
+
+  // Returns the memory resource this string's buffer was allocated from, or
+  // nullptr if the string is stored inline or on the global heap.
+  std::pmr::memory_resource* resource() const;
+
+  // Moves this string into a buffer which copies will share rather than copy.
+  // Does nothing to strings which are stored inline, already shared or point
+  // at a literal, as copying those never allocates anyway.
+  // String config{ReadFile("routes.conf")};
+  // config.share();
+  // String copy = config;  // no allocation; copy.data() == config.data().
+  void share();
+
+  // Returns how many strings share this string's buffer: 1 unless share() has
+  // been called and the string has since been copied.
+  Size share_count() const;
+
+  // Returns a string of the contents of the file at path, mapped read-only
+  // into memory rather than read. This returns without reading the file:
+  // each page is read from disk the first time it is touched, and pages are
+  // shared with the page cache rather than copied, so a huge file costs
+  // little memory. Views, substrings of views and output work straight from
+  // the mapping; anything that changes the string, or copies it, makes a copy
+  // on the heap. That includes substring() of the String itself, which
+  // returns a String with chars of its own: take parts of a mapped file with
+  // view() or substring(view(s), ...), which return StringViews into the
+  // mapping, and make a String only of the parts which have to outlive it.
+  // data() is still nul-terminated: the end of the last page of a file is
+  // zero-filled, and if the file fills it exactly a zero page is mapped after
+  // it. The file must not shrink while it is mapped. Throws std::system_error
+  // if the file can't be opened or mapped.
+  // String log = String::map_file("/var/log/huge.log");
+  // std::cout << substring(view(log), 0, 80);  // reads one page
+  static String map_file(const char* path);
+
+  // Returns a string of length chars which are left unset, for code which is
+  // about to write every one of them through data(), such as the parallel
+  // algorithms in Parallel.h. Only the nul terminator is written.
+  // String buffer = String::uninitialized(4096);
+  // Generate(buffer.data(), buffer.length());
+  static String uninitialized(Size length,
+                              std::pmr::memory_resource* resource = nullptr);
+
+  // Returns hash(view(*this)) (see Hash.h). Shared buffers never change, so a
+  // shared string works out its hash once and keeps it in the buffer for
+  // every copy to use. Strings which are hashed over and over, such as keys
+  // which are looked up often, can be shared just to cache their hash.
+  Size hash() const;
+
  private:
-  // insert gubbins here.
-  Size length_;
-  char* first_char_;
+  // Strings of up to kInlineCapacity chars are stored directly inside the
+  // object and never touch the heap. Longer strings keep a pointer to a heap
+  // buffer and their length. The two share the same 16 bytes: the last byte of
+  // inline_ holds kInlineCapacity - length() for inline strings (so it doubles
+  // as the nul terminator of a full inline string), while for heap strings it
+  // overlaps the top byte of length_, where kHeapFlag is set. Buffers from a
+  // memory resource also set kResourceFlag and are preceded by a
+  // ResourceHeader saying where to return them. Shared buffers set kSharedFlag
+  // instead and are preceded by a SharedHeader. Buffers with spare capacity set
+  // kGrowableFlag and are preceded by a GrowableHeader, whichever resource
+  // they come from. Mapped files set kMappedFlag and have no header: the
+  // mapping is unmapped using just its address and length. Literals set
+  // kStaticFlag and have no header either, as they are never freed. A buffer
+  // which was allocated to fit its contents exactly and has since been
+  // truncated sets kTrimmedFlag, and says how many chars follow its
+  // terminator in the chars just after it (see spare()).
+  static constexpr Size kInlineCapacity = 15;
+  static constexpr Size kHeapFlag = Size{1} << 63;
+  static constexpr Size kResourceFlag = Size{1} << 62;
+  static constexpr Size kSharedFlag = Size{1} << 61;
+  static constexpr Size kGrowableFlag = Size{1} << 60;
+  static constexpr Size kMappedFlag = Size{1} << 59;
+  static constexpr Size kStaticFlag = Size{1} << 58;
+  static constexpr Size kTrimmedFlag = Size{1} << 57;
+  static constexpr Size kLengthMask =
+      ~(kHeapFlag | kResourceFlag | kSharedFlag | kGrowableFlag |
+        kMappedFlag | kStaticFlag | kTrimmedFlag);
+
+  struct Heap {
+    char* first_char_;
+    Size length_;
+  };
+
+  struct ResourceHeader {
+    std::pmr::memory_resource* resource;
+  };
+
+  struct SharedHeader {
+    std::atomic<Size> references;
+    // Null for buffers on the global heap.
+    std::pmr::memory_resource* resource;
+    // Zero until someone asks for the hash. Racing threads all store the
+    // same value, so relaxed loads and stores are enough.
+    std::atomic<Size> hash;
+  };
+
+  struct GrowableHeader {
+    Size capacity;
+    // Null for buffers on the global heap.
+    std::pmr::memory_resource* resource;
+  };
+
+  bool is_inline() const;
+  bool is_shared() const;
+  bool is_static() const;
+  // Whether the buffer must be copied before it is changed: it is shared,
+  // mapped or a literal.
+  bool is_read_only() const;
+  SharedHeader* shared_header() const;
+  GrowableHeader* growable_header() const;
+
+  // Returns how many chars of the buffer follow the terminator: 0 unless the
+  // string has kTrimmedFlag. set_spare() records it for a trimmed string,
+  // which must have that many chars after its terminator: one byte holds up
+  // to 8, and otherwise a 0 byte is followed by the whole Size.
+  Size spare() const;
+  void set_spare(Size spare);
+
+  // Frees this string's heap buffer, or drops its reference to a shared one.
+  // Must only be called on a heap string; leaves the representation dangling.
+  void release();
+
+  // Sets up storage for length chars plus a nul terminator and returns a
+  // pointer to the first char. The contents are left for the caller to fill.
+  // Must only be called on a string that doesn't own a heap buffer. Any heap
+  // allocation is attributed to operation when profiling.
+  char* initialize(Size length, std::pmr::memory_resource* resource = nullptr,
+                   profile::Operation operation = profile::Operation::kOther);
+
+  // Sets up an empty string with room for capacity chars, in a growable
+  // buffer if they don't fit inline. Must only be called on a string that
+  // doesn't own a heap buffer.
+  void initialize_growable(Size capacity,
+                           std::pmr::memory_resource* resource);
+
+  // Sets the length of a string with room for it, and writes the terminator.
+  void set_length(Size length);
+
+  template <typename Range, typename Separator>
+  friend String join(const Range& range, const Separator& separator);
+
+  union {
+    Heap heap_;
+    char inline_[kInlineCapacity + 1];
+  };
 };
 
+// Moves never allocate, so containers such as std::vector move Strings when
+// they grow rather than copying them.
+static_assert(std::is_nothrow_move_constructible_v<String> &&
+              std::is_nothrow_move_assignable_v<String>);
+
 // None of these functions should need access to anything except the existing
 // public interface of the string to be implemented efficiently.
 
 // output s to a stream (eg. std::cout).
 std::ostream& operator<<(std::ostream& output, const String& s);
 
-// substring from start position to end. start must be <= s.length().
+inline std::ostream& operator<<(std::ostream& output, StaticString s) {
+  return output.write(s.data(), s.length());
+}
+
+// substring from start position to end. start must be <= s.length(). These
+// always copy the chars into a new String, even from a shared or mapped
+// string, as a String's chars must be followed by a nul terminator; use
+// view() below for a part of s which doesn't copy.
 String substring(const String& s, String::Size start);
 
 // substring [start, start + length). substring indices must be fully inside s.
 String substring(const String& s, String::Size start, String::Size length);
 
-// String concatenation.
-String operator+(const String& a, const String& b);
+// Literals: the chars from start to the end are a literal too, being followed
+// by the same nul terminator, so that substring is worked out at compile time.
+// Other substrings are copied like any other String's.
+constexpr StaticString substring(StaticString s, StaticString::Size start) {
+  if (start > s.length()) return StaticString{"", 0};
+  return StaticString{s.data() + start, s.length() - start};
+}
+
+inline String substring(StaticString s, String::Size start,
+                        String::Size length) {
+  return substring(String{s}, start, length);
+}
+
+// Views of s, or of part of it. These never copy; the result is only valid for
+// as long as s is alive and unmodified. Out-of-range indices give an empty
+// view, matching substring().
+// String foo{"Hello, World!"};
+// std::cout << view(foo, 7, 5) << "\n";  // shows "World"
+StringView view(const String& s);
+StringView view(const String& s, String::Size start);
+StringView view(const String& s, String::Size start, String::Size length);
+
+// String concatenation. a + b doesn't build a string straight away: it
+// returns a Concat expression which remembers its operands and is turned into a
+// String when assigned to one. This means a + b + c + d allocates and copies
+// once rather than once per +. The operands are referenced, not copied, so the
+// expression must be turned into a String before they go away:
+// String foo = a + b + c;  // fine
+// auto bar = String("x") + b;  // bar refers to a destroyed temporary!
+
+// One operand of a concatenation: a run of chars to copy into the result.
+class ConcatPiece {
+ public:
+  ConcatPiece(const char* data, String::Size length)
+      : data_(data), length_(length) {}
+
+  String::Size length() const { return length_; }
+
+  // Copies the chars to out and returns a pointer just past them.
+  char* copy_to(char* out) const {
+    simd::copy(out, data_, length_);
+    return out + length_;
+  }
+
+  void write_to(std::ostream& output) const { output.write(data_, length_); }
+
+ private:
+  const char* data_;
+  String::Size length_;
+};
+
+template <typename Left, typename Right>
+class Concat {
+ public:
+  Concat(const Left& left, const Right& right)
+      : left_(left), right_(right), length_(left.length() + right.length()) {}
+
+  // Returns the length of the string this expression will produce.
+  String::Size length() const { return length_; }
+
+  // Copies every piece to out in order and returns a pointer just past them.
+  char* copy_to(char* out) const { return right_.copy_to(left_.copy_to(out)); }
+
+  void write_to(std::ostream& output) const {
+    left_.write_to(output);
+    right_.write_to(output);
+  }
+
+ private:
+  Left left_;
+  Right right_;
+  String::Size length_;
+};
+
+template <typename Left, typename Right>
+String::String(const Concat<Left, Right>& concat,
+               std::pmr::memory_resource* resource) {
+  concat.copy_to(
+      initialize(concat.length(), resource, profile::Operation::kConcat));
+}
+
+// The types which can appear on either side of +. Anything else (notably a
+// temporary String made by an implicit conversion inside operator+ itself)
+// would leave the expression pointing at an object that no longer exists.
+inline ConcatPiece AsConcatOperand(const String& s) {
+  return ConcatPiece(s.data(), s.length());
+}
+
+inline ConcatPiece AsConcatOperand(const char* c_str) {
+  return ConcatPiece(c_str, simd::length(c_str));
+}
+
+inline ConcatPiece AsConcatOperand(StaticString literal) {
+  return ConcatPiece(literal.data(), literal.length());
+}
+
+// A single char. Only a char itself is taken, not anything which converts to
+// one, as the piece points at the char.
+template <typename Char,
+          typename = std::enable_if_t<std::is_same_v<Char, char>>>
+ConcatPiece AsConcatOperand(const Char& c) {
+  return ConcatPiece(&c, 1);
+}
+
+inline const ConcatPiece& AsConcatOperand(const ConcatPiece& piece) {
+  return piece;
+}
+
+template <typename Left, typename Right>
+const Concat<Left, Right>& AsConcatOperand(const Concat<Left, Right>& concat) {
+  return concat;
+}
+
+template <typename T>
+using ConcatOperand = std::decay_t<decltype(AsConcatOperand(
+    std::declval<const T&>()))>;
+
+template <typename A, typename B>
+Concat<ConcatOperand<A>, ConcatOperand<B>> operator+(const A& a, const B& b) {
+  return {AsConcatOperand(a), AsConcatOperand(b)};
+}
+
+// Returns the concatenation of any number of operands of +, including chars.
+// Like a chain of +, the length is added up first so the result is allocated
+// once.
+// String path = concat(directory, '/', view(name), ".txt");
+template <typename... Pieces> String concat(const Pieces&... pieces) {
+  if constexpr (sizeof...(pieces) == 0) {
+    return String{};
+  } else {
+    return String{(ConcatPiece{"", 0} + ... + pieces)};
+  }
+}
+
+// Returns the items of range with separator between each one and the next.
+// The items and the separator can be any operands of +, including chars. The
+// range is walked twice, once to add up the length and once to copy, so the
+// result is allocated once however many items there are, where building it
+// with s = s + item copies everything so far for each item.
+// std::vector<String> names = ...;
+// String list = join(names, ", ");
+// String path = join(std::vector<const char*>{"usr", "local", "bin"}, '/');
+template <typename Range, typename Separator>
+String join(const Range& range, const Separator& separator) {
+  auto gap = AsConcatOperand(separator);
+  String::Size length = 0, count = 0;
+  for (const auto& item : range) {
+    length += AsConcatOperand(item).length();
+    count++;
+  }
+  if (count > 0) length += (count - 1) * gap.length();
+  String result;
+  char* out =
+      result.initialize(length, nullptr, profile::Operation::kConcat);
+  bool first = true;
+  for (const auto& item : range) {
+    if (!first) out = gap.copy_to(out);
+    out = AsConcatOperand(item).copy_to(out);
+    first = false;
+  }
+  return result;
+}
+
+// output a concatenation to a stream without building the string first.
+template <typename Left, typename Right>
+std::ostream& operator<<(std::ostream& output,
+                         const Concat<Left, Right>& concat) {
+  concat.write_to(output);
+  return output;
+}
 
 #endif // STRING_H
@@ -0,0 +1,48 @@
+#ifndef STRING_BUILDER_H
+#define STRING_BUILDER_H
+
+#include "String.h"
+#include "StringView.h"
+
+// Builds a string out of many small pieces, such as a serialized message.
+// Appending is amortized O(1) per char, and build() hands the finished buffer
+// to a String without copying it.
+// StringBuilder out;
+// out << "{\"name\": \"" << name << "\", \"role\": \"" << role << "\"}";
+// String message = out.build();
+class StringBuilder {
+ public:
+  using Size = String::Size;
+
+  // Constructs an empty builder. Giving a capacity makes room for that many
+  // chars straight away.
+  StringBuilder() = default;
+  explicit StringBuilder(Size capacity);
+
+  // Adds to the end of the string being built.
+  StringBuilder& append(char c);
+  StringBuilder& append(const char* data, Size size);
+  StringBuilder& append(StringView v);
+  StringBuilder& operator<<(char c) { return append(c); }
+  StringBuilder& operator<<(StringView v) { return append(v); }
+
+  // Makes room for at least capacity chars in total.
+  void reserve(Size capacity);
+
+  Size length() const;
+  Size capacity() const;
+
+  // Returns a view of what has been built so far. It is invalidated by the
+  // next append.
+  StringView view() const;
+
+  // Returns the built string, moving the buffer into it (spare capacity and
+  // all) rather than copying it. The builder is left empty, ready to build
+  // another.
+  String build();
+
+ private:
+  String buffer_;
+};
+
+#endif // STRING_BUILDER_H
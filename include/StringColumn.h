@@ -0,0 +1,103 @@
+#ifndef STRING_COLUMN_H
+#define STRING_COLUMN_H
+#include <cstdint>
+#include <vector>
+
+#include "String.h"
+#include "StringView.h"
+
+// Holds many strings packed end to end in one buffer, with a table of where
+// each one starts, in the layout of an Arrow string array. Row i is the chars
+// from offset(i) to offset(i + 1). A vector of Strings costs 16 bytes per
+// string plus a heap block for each one longer than 15 chars, and scanning it
+// jumps from block to block; a column costs 4 bytes per string on top of the
+// chars themselves, and scanning it reads one buffer from start to end.
+// StringColumn names;
+// names.append("alice");
+// names.append(view(bob));
+// names[1];  // a view of "bob"
+// names.find("li");  // {0}
+//
+// Offsets are 32 bits, as in Arrow's (not large) string arrays, so a column
+// holds at most 4 GiB of chars. Rows can be added but not changed or removed;
+// take() builds a new column from some of the rows of another.
+class StringColumn {
+ public:
+  using Size = String::Size;
+
+  // Constructs an empty column.
+  StringColumn();
+
+  // Constructs a column of copies of strings, allocating its chars and its
+  // offsets once each.
+  explicit StringColumn(const std::vector<String>& strings);
+
+  // Adds a copy of v as the last row. The chars grow geometrically, like
+  // String::append(). Throws std::length_error if the column would hold more
+  // than 4 GiB of chars.
+  void append(StringView v);
+
+  // Makes room for rows more rows holding bytes more chars in all.
+  void reserve(Size rows, Size bytes);
+
+  // Returns the number of rows.
+  Size size() const;
+
+  // Returns a view of row i, which must be less than size(). The view is
+  // invalidated by the next append.
+  StringView operator[](Size i) const;
+
+  // Returns where row i starts in data(); offset(size()) is bytes().
+  Size offset(Size i) const;
+
+  // Returns all size() + 1 offsets, for code which saves or sends the column
+  // as it is laid out in memory.
+  const std::uint32_t* offsets() const;
+
+  // Returns every row's chars, end to end, and how many there are.
+  const char* data() const;
+  Size bytes() const;
+
+  // Returns the number of bytes the column has allocated for its chars and
+  // offsets, including spare capacity.
+  Size bytes_used() const;
+
+  // Returns a String copy of each row.
+  std::vector<String> to_strings() const;
+
+  // Returns a new column of the given rows, in the order given.
+  StringColumn take(const std::vector<Size>& rows) const;
+
+  // Kernels which run over the whole column at once and return the indices
+  // of the matching rows in order.
+
+  // Rows which contain needle. The whole buffer is searched in one go, as
+  // one string, and a match which runs from one row into the next is thrown
+  // away. Every row contains the empty needle.
+  std::vector<Size> find(StringView needle) const;
+
+  // Rows equal to value. Only the offsets are read for rows of other lengths.
+  std::vector<Size> find_equal(StringView value) const;
+
+  // Rows for which predicate(view) returns true.
+  template <typename Predicate>
+  std::vector<Size> filter(const Predicate& predicate) const {
+    std::vector<Size> rows;
+    const char* chars = data();
+    for (Size i = 0; i < size(); i++) {
+      if (predicate(StringView{chars + offsets_[i],
+                               offsets_[i + 1] - offsets_[i]})) {
+        rows.push_back(i);
+      }
+    }
+    return rows;
+  }
+
+ private:
+  // The chars of every row, grown with String::append().
+  String bytes_;
+  // size() + 1 offsets into bytes_, starting with 0.
+  std::vector<std::uint32_t> offsets_;
+};
+
+#endif // STRING_COLUMN_H
@@ -0,0 +1,95 @@
+#ifndef STRING_TABLE_H
+#define STRING_TABLE_H
+#include <cstdint>
+#include <vector>
+
+#include "String.h"
+#include "StringColumn.h"
+#include "StringView.h"
+
+// A file format for tables of strings which are loaded by mapping the file
+// rather than reading and parsing it, so that opening a table of millions of
+// strings takes about as long as opening a file, whatever its size. Rows and
+// lookups read the mapped pages directly: nothing is copied or allocated, and
+// only the pages which are touched are ever read from disk.
+// write_string_table("words.table", words);  // once, at build time
+// StringTable table{"words.table"};        // at every start
+// table[42];                               // a view of row 42
+// table.find("hello");                     // its row, or kNotFound
+//
+// A table file is a StringColumn as it is laid out in memory, plus a header
+// and an optional hash index. All numbers are little-endian, in this order:
+//   header   64 bytes: the magic "StrTable", version, flags, the number of
+//            rows, the number of chars, the number of index slots (a power of
+//            two, or 0 without an index) and a checksum of each section
+//   offsets  rows + 1 32-bit offsets into the chars, padded to 8 bytes
+//   index    64-bit slots, 0 when empty, else the top 32 bits of the row's
+//            hash (see Hash.h) followed by 32 bits of row + 1, placed by
+//            linear probing from hash & (slots - 1)
+//   chars    every row's chars, end to end
+// The version changes with the layout or with hash(), as the index depends
+// on it.
+
+// Writes the rows of column, or copies of strings, to a new table file at
+// path, replacing any file there. With an index, find() takes O(1) on average
+// rather than O(rows), at a cost of 16 to 32 bytes per row. The table is
+// written to path + ".tmp", synced and renamed over path, so a StringTable
+// which has the old file mapped goes on reading the old rows, and path never
+// names a half-written table. Throws std::system_error if the file can't be
+// written, including when path + ".tmp" already exists (another writer is
+// busy, or one died and left it behind), and std::length_error if there are
+// 2^32 - 1 rows or more.
+void write_string_table(const char* path, const StringColumn& column,
+                        bool with_index = true);
+void write_string_table(const char* path, const std::vector<String>& strings,
+                        bool with_index = true);
+
+// A table file mapped into memory. Views of its rows are valid for as long as
+// the table is.
+class StringTable {
+ public:
+  using Size = String::Size;
+
+  // The version of the format this reads and writes.
+  static constexpr std::uint32_t kVersion = 1;
+
+  // Maps the table file at path. Throws std::system_error if it can't be
+  // mapped and std::runtime_error if it isn't a table of this version or its
+  // sections don't fit the file. Opening checks only the header, in constant
+  // time. With verify, the checksums and every offset are checked too, which
+  // reads the whole file; without it, a corrupted file can give wrong rows or
+  // views which reach outside the file.
+  explicit StringTable(const char* path, bool verify = true);
+
+  // Tables can be moved but not copied, as copying the mapping would copy
+  // the whole file onto the heap.
+  StringTable(const StringTable&) = delete;
+  StringTable& operator=(const StringTable&) = delete;
+  StringTable(StringTable&&) = default;
+  StringTable& operator=(StringTable&&) = default;
+
+  // Returns the number of rows.
+  Size size() const;
+
+  // Returns a view of row i, which must be less than size().
+  StringView operator[](Size i) const;
+
+  // Returns whether the file has a hash index.
+  bool has_index() const;
+
+  // Returns the first row equal to key, or kNotFound (see Search.h). Takes
+  // O(1) on average with an index, and reads the chars of rows with another
+  // hash only if the top 32 bits of their hash match. Without an index,
+  // every row is compared.
+  Size find(StringView key) const;
+
+ private:
+  String file_;
+  const std::uint32_t* offsets_;
+  const std::uint64_t* index_;
+  Size index_mask_;
+  const char* chars_;
+  Size size_;
+};
+
+#endif // STRING_TABLE_H
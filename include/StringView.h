@@ -0,0 +1,82 @@
+#ifndef STRING_VIEW_H
+#define STRING_VIEW_H
+#include <iostream>
+
+#include "String.h"
+
+// A non-owning reference to a run of chars: just a pointer and a length. Views
+// are cheap to copy and never allocate, which makes them the right type for
+// slicing a string into many fields. The chars must outlive the view.
+class StringView {
+ public:
+  using Size = String::Size;
+
+  // Constructs an empty view.
+  // StringView foo;
+  StringView();
+
+  // Constructs a view of a nul-terminated string, not including the nul.
+  // StringView foo{"Hello!"};
+  StringView(const char* c_str);
+
+  // Constructs a view of a fixed number of bytes from a buffer.
+  // StringView foo{"Hello!", 6};
+  StringView(const char* data, Size size);
+
+  // Constructs a view of the whole of a string.
+  // String foo{"Hello!"};
+  // StringView bar{foo};
+  StringView(const String& s);
+
+  // Constructs a view of a literal.
+  // StringView foo = "Hello!"_s;
+  StringView(StaticString s) : data_(s.data()), length_(s.length()) {}
+
+  // Returns a pointer to the first char of the view. Unlike String::data(),
+  // the chars are not guaranteed to be followed by a nul terminator.
+  const char* data() const;
+
+  // Returns the number of chars in the view.
+  Size length() const;
+
+ private:
+  const char* data_;
+  Size length_;
+};
+
+// output v to a stream (eg. std::cout).
+std::ostream& operator<<(std::ostream& output, StringView v);
+
+// subview from start position to end. start must be <= v.length().
+StringView substring(StringView v, StringView::Size start);
+
+// subview [start, start + length). subview indices must be fully inside v.
+StringView substring(StringView v, StringView::Size start,
+                     StringView::Size length);
+
+// Lexicographic comparison of the bytes of two views, as unsigned chars.
+// Embedded '\0' chars compare like any other char, and a proper prefix orders
+// first. The bytes are compared 16 or 32 at a time with simd::mismatch. These
+// take views, so they work for Strings too and for any mix of String, view
+// and nul-terminated string, and let Strings be keys of ordered containers.
+// String foo{"apple"};
+// foo < "banana";  // true
+
+// Three-way comparison: returns a negative number, zero or a positive number
+// when a orders before, the same as or after b.
+int compare(StringView a, StringView b);
+
+bool operator==(StringView a, StringView b);
+bool operator!=(StringView a, StringView b);
+bool operator<(StringView a, StringView b);
+bool operator<=(StringView a, StringView b);
+bool operator>(StringView a, StringView b);
+bool operator>=(StringView a, StringView b);
+
+// Views can be concatenated with strings and with each other.
+// String foo = view(bar, 0, 3) + "-" + baz;
+inline ConcatPiece AsConcatOperand(StringView v) {
+  return ConcatPiece(v.data(), v.length());
+}
+
+#endif // STRING_VIEW_H
@@ -0,0 +1,57 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "String.h"
+#include "StringView.h"
+
+// Normalizing text such as header names and keys. Each change comes in two
+// forms: one which takes a view and returns a new String, allocated once, and
+// one which changes a String in place through its mutable data(). As with any
+// write through data(), changing a shared or mapped string in place first
+// gives it its own copy.
+// String key = to_lower(trim(header_name));
+// replace_in_place(path, '\\', '/');
+//
+// Case mapping, replacing chars and case-insensitive comparison are done by
+// vectorized kernels in Simd.h. Only ASCII letters change case: every other
+// byte, including all of UTF-8 beyond ASCII, is left as it is.
+
+// Returns v with its ASCII letters in lower or upper case.
+// to_lower("Content-Type");  // "content-type"
+String to_lower(StringView v);
+String to_upper(StringView v);
+void to_lower_in_place(String& s);
+void to_upper_in_place(String& s);
+
+// Returns v with every from changed to to.
+String replace(StringView v, char from, char to);
+void replace_in_place(String& s, char from, char to);
+
+// Returns v with every non-overlapping occurrence of needle, counting from the
+// start, changed to replacement. The occurrences are counted first so that
+// the result is allocated once. An empty needle matches nothing. In place,
+// the chars are rewritten in s's own buffer when replacement is the same
+// length as needle; otherwise s is given a new buffer, unless needle doesn't
+// occur at all. needle and replacement may be views of s itself.
+// replace_all("a, b, c", ", ", ",");  // "a,b,c"
+String replace_all(StringView v, StringView needle, StringView replacement);
+void replace_all_in_place(String& s, StringView needle,
+                          StringView replacement);
+
+// Returns v without spaces, tabs, carriage returns, newlines, vertical tabs
+// and form feeds at either end. Trimming a view never copies; trimming a
+// String in place moves its chars within its own buffer, with truncate() and
+// remove_prefix(), so it never allocates unless the string is shared, mapped
+// or a literal.
+// trim("  value\r\n");  // "value"
+StringView trim(StringView v);
+void trim_in_place(String& s);
+
+// Compare like ==, != and compare() in StringView.h, but with the ASCII
+// letters A-Z and a-z equal to each other. Other letters are compared as they
+// are, and uppercase letters order as their lowercase forms.
+// equals_ignoring_case("Content-Length", "content-length");  // true
+bool equals_ignoring_case(StringView a, StringView b);
+int compare_ignoring_case(StringView a, StringView b);
+
+#endif // TRANSFORM_H
@@ -0,0 +1,39 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include "String.h"
+#include "StringView.h"
+
+// Strings hold bytes, which are usually UTF-8. These check and measure UTF-8
+// text, and slice it without cutting a code point in half. They take views, so
+// they work on Strings too, and never copy.
+// String name = ReadName();
+// if (!is_valid_utf8(name)) return Error("name isn't UTF-8");
+// StringView preview = utf8_substring(name, 0, 20);  // at most 20 code points
+//
+// The work is done by vectorized kernels in Simd.h, 32 bytes at a time.
+
+// Returns whether v is valid UTF-8: every sequence is complete, is the
+// shortest encoding of its code point, and doesn't encode a surrogate
+// (U+D800 to U+DFFF) or anything past U+10FFFF.
+bool is_valid_utf8(StringView v);
+
+// Returns the number of code points in v. If v isn't valid UTF-8 this is the
+// number of bytes which aren't continuation bytes, and the functions below
+// treat each of those as the start of a code point too.
+StringView::Size count_code_points(StringView v);
+
+// Returns the part of v from code point start to the end, or to at most
+// length code points after start, matching substring() but counting code
+// points rather than bytes. A start past the end gives an empty view.
+// utf8_substring("naïve café", 6);  // "café"
+StringView utf8_substring(StringView v, StringView::Size start);
+StringView utf8_substring(StringView v, StringView::Size start,
+                          StringView::Size length);
+
+// Returns the longest prefix of v of at most max_length bytes which doesn't
+// end part way through a code point, for fitting text into a byte limit.
+// truncate_utf8("café", 4);  // "caf", as the é takes two bytes
+StringView truncate_utf8(StringView v, StringView::Size max_length);
+
+#endif // UTF8_H
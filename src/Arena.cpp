@@ -0,0 +1,75 @@
+#include <cstdint>
+#include <new>
+#include "../include/Arena.h"
+
+using Size = Arena::Size;
+
+Arena::Arena(Size block_size, std::pmr::memory_resource* upstream)
+    : block_size_(block_size), upstream_(upstream) {}
+
+Arena::~Arena() {
+  release();
+}
+
+void Arena::release() {
+  while (blocks_ != nullptr) {
+    Block* next = blocks_->next;
+    if (upstream_ != nullptr) {
+      upstream_->deallocate(blocks_, blocks_->size, alignof(Block));
+    } else {
+      ::operator delete(blocks_, blocks_->size);
+    }
+    blocks_ = next;
+  }
+  current_ = end_ = nullptr;
+  bytes_used_ = 0;
+}
+
+Size Arena::bytes_used() const {
+  return bytes_used_;
+}
+
+// Returns the number of bytes to skip from p to reach the given alignment.
+static Size Padding(const char* p, std::size_t alignment) {
+  return -reinterpret_cast<std::uintptr_t>(p) & (alignment - 1);
+}
+
+void* Arena::do_allocate(std::size_t bytes, std::size_t alignment) {
+  if (current_ != nullptr && Padding(current_, alignment) + bytes <=
+                                 Size(end_ - current_)) {
+    current_ += Padding(current_, alignment);
+    void* result = current_;
+    current_ += bytes;
+    bytes_used_ += bytes;
+    return result;
+  }
+  // Requests too big for a normal block get a block of their own, sized to
+  // fit. That block goes behind the current one so that the space left in the
+  // current block isn't wasted.
+  Size size = sizeof(Block) + alignment + bytes;
+  bool dedicated = size > block_size_;
+  if (!dedicated) size = block_size_;
+  void* memory = upstream_ != nullptr ? upstream_->allocate(size, alignof(Block))
+                                      : ::operator new(size);
+  auto* block = new (memory) Block{nullptr, size};
+  char* first = reinterpret_cast<char*>(block + 1);
+  first += Padding(first, alignment);
+  if (dedicated && blocks_ != nullptr) {
+    block->next = blocks_->next;
+    blocks_->next = block;
+  } else {
+    block->next = blocks_;
+    blocks_ = block;
+    current_ = first + bytes;
+    end_ = static_cast<char*>(memory) + size;
+  }
+  bytes_used_ += bytes;
+  return first;
+}
+
+// Memory is only returned all at once, by release().
+void Arena::do_deallocate(void*, std::size_t, std::size_t) {}
+
+bool Arena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+  return this == &other;
+}
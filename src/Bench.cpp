@@ -0,0 +1,1279 @@
+#include "../include/Arena.h"
+#include "../include/Hash.h"
+#include "../include/Intern.h"
+#include "../include/KeywordMatcher.h"
+#include "../include/Number.h"
+#include "../include/Output.h"
+#include "../include/Parallel.h"
+#include "../include/Search.h"
+#include "../include/Simd.h"
+#include "../include/Sort.h"
+#include "../include/Split.h"
+#include "../include/String.h"
+#include "../include/StringBuilder.h"
+#include "../include/StringColumn.h"
+#include "../include/StringTable.h"
+#include "../include/Transform.h"
+#include "../include/Utf8.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <mutex>
+#include <new>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <unistd.h>
+
+using namespace std::literals;
+
+// Create a registry for benchmarks, in the same way as the tests. Each
+// benchmark will register itself into this map with a name.
+using Benchmark = void();
+std::map<std::string_view, Benchmark*> benchmarks;
+
+#define BENCHMARK(name)  \
+  struct Benchmark_##name {  \
+    Benchmark_##name() { benchmarks.emplace(#name, &Benchmark_##name::Run); }  \
+    static void Run();  \
+  } benchmark_##name;  \
+  void Benchmark_##name::Run()
+
+// Replace the default new and delete with ones which count allocations and
+// the bytes they ask for, so that each benchmark can report how many
+// allocations an operation makes and how much memory a structure takes.
+std::atomic<std::size_t> allocation_count{0};
+std::atomic<std::size_t> allocated_bytes{0};
+
+void* operator new(std::size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void* p = std::malloc(size)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+// Stops the compiler from optimising away a value which is never used.
+template <typename T> void DoNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Measurement {
+  double ns_per_op;
+  double allocations_per_op;
+};
+
+// How long to keep repeating each operation for. Can be changed with
+// --min-time-ms on the command line.
+std::chrono::milliseconds min_duration{50};
+
+// The most strings the sorting benchmark sorts at once. Can be changed with
+// --max-sort-size on the command line; 100 million takes about 16 GiB.
+String::Size max_sort_size = 10000000;
+
+// Runs body repeatedly for long enough to get a stable measurement.
+template <typename F> Measurement Measure(F&& body) {
+  using Clock = std::chrono::steady_clock;
+  long long iterations = 1;
+  while (true) {
+    std::size_t allocations_before = allocation_count;
+    auto start = Clock::now();
+    for (long long i = 0; i < iterations; i++) body();
+    std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+    if (elapsed >= min_duration) {
+      double allocations = allocation_count - allocations_before;
+      return {elapsed.count() / iterations, allocations / iterations};
+    }
+    iterations *= 2;
+  }
+}
+
+// Like Measure, but runs setup before each run of body and leaves it out of
+// the time, for operations which use up their input such as sorting.
+template <typename Setup, typename F>
+Measurement MeasureWithSetup(Setup&& setup, F&& body) {
+  using Clock = std::chrono::steady_clock;
+  std::chrono::duration<double, std::nano> elapsed{0};
+  double allocations = 0;
+  long long iterations = 0;
+  while (elapsed < min_duration) {
+    setup();
+    std::size_t allocations_before = allocation_count;
+    auto start = Clock::now();
+    body();
+    elapsed += Clock::now() - start;
+    allocations += allocation_count - allocations_before;
+    iterations++;
+  }
+  return {elapsed.count() / iterations, allocations / iterations};
+}
+
+// Results are either printed as a table for people to read or, with --csv, as
+// comma separated values so that runs can be saved and diffed.
+bool csv_output = false;
+
+void Report(std::string_view name, std::string_view implementation,
+            String::Size size, String::Size bytes_per_op,
+            Measurement measurement) {
+  double bytes_per_second = bytes_per_op / measurement.ns_per_op * 1e9;
+  if (csv_output) {
+    std::cout << name << "," << implementation << "," << size << ","
+              << measurement.ns_per_op << "," << bytes_per_second << ","
+              << measurement.allocations_per_op << ",\n";
+    return;
+  }
+  std::cout << std::left << std::setw(32) << name << std::setw(12)
+            << implementation << std::right << std::setw(10) << size
+            << std::fixed << std::setprecision(1) << std::setw(14)
+            << measurement.ns_per_op << " ns/op" << std::setw(14)
+            << bytes_per_second / (1 << 20) << " MiB/s" << std::setprecision(2)
+            << std::setw(10) << measurement.allocations_per_op
+            << " allocs/op\n";
+}
+
+// Reports how much memory a structure takes for each item it holds.
+void ReportMemory(std::string_view name, std::string_view implementation,
+                  String::Size size, double bytes_per_item) {
+  if (csv_output) {
+    std::cout << name << "," << implementation << "," << size << ",,,,"
+              << bytes_per_item << "\n";
+    return;
+  }
+  std::cout << std::left << std::setw(32) << name << std::setw(12)
+            << implementation << std::right << std::setw(10) << size
+            << std::fixed << std::setprecision(1) << std::setw(14)
+            << bytes_per_item << " bytes/item\n";
+}
+
+// The sizes each String operation is measured at, from empty up to megabytes.
+// 15 and 16 are either side of the largest string which is stored inline.
+constexpr String::Size kSizes[] = {0,    1,     15,    16,      64,     256,
+                                   4096, 65536, 1 << 20, 4 << 20};
+
+// Measures an operation on String and the same operation on std::string for
+// every size in kSizes. Each make_* function is given a size and returns a
+// callable which performs the operation once on inputs of that size.
+template <typename MakeString, typename MakeStd>
+void Compare(std::string_view name, MakeString make_string, MakeStd make_std,
+             String::Size bytes_per_size = 1) {
+  for (String::Size size : kSizes) {
+    Report(name, "String", size, size * bytes_per_size,
+           Measure(make_string(size)));
+    Report(name, "std::string", size, size * bytes_per_size,
+           Measure(make_std(size)));
+  }
+}
+
+// A stream buffer which throws away whatever is written to it, for measuring
+// the cost of output without the cost of a real destination.
+class NullBuffer : public std::streambuf {
+ protected:
+  std::streamsize xsputn(const char*, std::streamsize count) override {
+    return count;
+  }
+  int_type overflow(int_type c) override { return c; }
+};
+
+NullBuffer null_buffer;
+std::ostream null_output{&null_buffer};
+
+BENCHMARK(ConstructFill) {
+  Compare(
+      "construct_fill",
+      [](String::Size size) {
+        return [size] { DoNotOptimize(String('x', size).data()); };
+      },
+      [](String::Size size) {
+        return [size] { DoNotOptimize(std::string(size, 'x').data()); };
+      });
+}
+
+BENCHMARK(ConstructCString) {
+  Compare(
+      "construct_c_str",
+      [](String::Size size) {
+        return [source = std::string(size, 'x')] {
+          DoNotOptimize(String(source.c_str()).data());
+        };
+      },
+      [](String::Size size) {
+        return [source = std::string(size, 'x')] {
+          DoNotOptimize(std::string(source.c_str()).data());
+        };
+      });
+}
+
+BENCHMARK(ConstructBuffer) {
+  Compare(
+      "construct_buffer",
+      [](String::Size size) {
+        return [source = std::string(size, 'x')] {
+          DoNotOptimize(String(source.data(), source.size()).data());
+        };
+      },
+      [](String::Size size) {
+        return [source = std::string(size, 'x')] {
+          DoNotOptimize(std::string(source.data(), source.size()).data());
+        };
+      });
+}
+
+BENCHMARK(CopyConstruct) {
+  Compare(
+      "copy_construct",
+      [](String::Size size) {
+        return [source = String('x', size)] {
+          String copy{source};
+          DoNotOptimize(copy.data());
+        };
+      },
+      [](String::Size size) {
+        return [source = std::string(size, 'x')] {
+          std::string copy{source};
+          DoNotOptimize(copy.data());
+        };
+      });
+}
+
+// Each iteration moves the source into a new string and then moves it back,
+// so the source is the same for every iteration.
+BENCHMARK(MoveConstruct) {
+  Compare(
+      "move_construct_and_back",
+      [](String::Size size) {
+        return [source = String('x', size)]() mutable {
+          String moved{std::move(source)};
+          DoNotOptimize(moved.data());
+          source = std::move(moved);
+        };
+      },
+      [](String::Size size) {
+        return [source = std::string(size, 'x')]() mutable {
+          std::string moved{std::move(source)};
+          DoNotOptimize(moved.data());
+          source = std::move(moved);
+        };
+      });
+}
+
+BENCHMARK(CopyAssign) {
+  Compare(
+      "copy_assign",
+      [](String::Size size) {
+        return [source = String('x', size), target = String('y', size)]()
+                   mutable {
+          target = source;
+          DoNotOptimize(target.data());
+        };
+      },
+      [](String::Size size) {
+        return [source = std::string(size, 'x'),
+                target = std::string(size, 'y')]() mutable {
+          target = source;
+          DoNotOptimize(target.data());
+        };
+      });
+}
+
+// Each iteration moves the source into the target and back again.
+BENCHMARK(MoveAssign) {
+  Compare(
+      "move_assign_and_back",
+      [](String::Size size) {
+        return [source = String('x', size), target = String()]() mutable {
+          target = std::move(source);
+          DoNotOptimize(target.data());
+          source = std::move(target);
+        };
+      },
+      [](String::Size size) {
+        return [source = std::string(size, 'x'),
+                target = std::string()]() mutable {
+          target = std::move(source);
+          DoNotOptimize(target.data());
+          source = std::move(target);
+        };
+      });
+}
+
+// Takes the second half of the source, so the result is size / 2 long.
+BENCHMARK(Substring) {
+  Compare(
+      "substring",
+      [](String::Size size) {
+        return [source = String('x', size), size] {
+          DoNotOptimize(substring(source, size / 2).data());
+        };
+      },
+      [](String::Size size) {
+        return [source = std::string(size, 'x'), size] {
+          DoNotOptimize(source.substr(size / 2).data());
+        };
+      });
+}
+
+// Concatenates two strings of the given size.
+BENCHMARK(Concat) {
+  Compare(
+      "concat",
+      [](String::Size size) {
+        return [a = String('a', size), b = String('b', size)] {
+          String result = a + b;
+          DoNotOptimize(result.data());
+        };
+      },
+      [](String::Size size) {
+        return [a = std::string(size, 'a'), b = std::string(size, 'b')] {
+          std::string result = a + b;
+          DoNotOptimize(result.data());
+        };
+      },
+      2);
+}
+
+BENCHMARK(Output) {
+  Compare(
+      "output",
+      [](String::Size size) {
+        return [source = String('x', size)] { null_output << source; };
+      },
+      [](String::Size size) {
+        return [source = std::string(size, 'x')] { null_output << source; };
+      });
+}
+
+// Builds pieces[0] + pieces[1] + ... as one expression.
+template <int... kIndices>
+String ConcatAll(const std::vector<String>& pieces,
+                 std::integer_sequence<int, kIndices...>) {
+  return (pieces[kIndices] + ...);
+}
+
+// Concatenates n fragments of the given size, first one + at a time with each
+// intermediate result turned into a String (which is how operator+ used to
+// behave), and then as a single expression.
+template <int kPieces> void ConcatenatePieces(String::Size size) {
+  std::vector<String> pieces;
+  for (int i = 0; i < kPieces; i++) pieces.emplace_back('a' + i, size);
+  auto pairwise = Measure([&] {
+    String result = pieces[0];
+    for (int i = 1; i < kPieces; i++) result = String(result + pieces[i]);
+    DoNotOptimize(result.data());
+  });
+  auto expression = Measure([&] {
+    String result =
+        ConcatAll(pieces, std::make_integer_sequence<int, kPieces>());
+    DoNotOptimize(result.data());
+  });
+  std::string name = "concat_" + std::to_string(kPieces) + "_way";
+  Report(name, "pairwise", size, kPieces * size, pairwise);
+  Report(name, "expression", size, kPieces * size, expression);
+}
+
+BENCHMARK(ConcatChain) {
+  for (String::Size size : {4, 64, 1024, 16384}) {
+    ConcatenatePieces<2>(size);
+    ConcatenatePieces<4>(size);
+    ConcatenatePieces<8>(size);
+  }
+}
+
+// Joins n fragments of 8 chars with a separator: by folding s = s + ", " +
+// fragment, which copies the whole result so far for every fragment, with
+// join(), which allocates and copies once, and with std::string's +=.
+BENCHMARK(JoinFragments) {
+  for (String::Size count : {100, 1000, 10000}) {
+    std::vector<String> fragments;
+    std::vector<std::string> std_fragments;
+    for (String::Size i = 0; i < count; i++) {
+      fragments.emplace_back('a' + i % 26, 8);
+      std_fragments.emplace_back(8, 'a' + i % 26);
+    }
+    String::Size bytes = count * 10 - 2;
+    Report("join_fragments", "fold", count, bytes, Measure([&] {
+             String result = fragments[0];
+             for (String::Size i = 1; i < count; i++) {
+               result = result + ", " + fragments[i];
+             }
+             DoNotOptimize(result.data());
+           }));
+    Report("join_fragments", "join", count, bytes, Measure([&] {
+             String result = join(fragments, ", ");
+             DoNotOptimize(result.data());
+           }));
+    Report("join_fragments", "std", count, bytes, Measure([&] {
+             std::string result = std_fragments[0];
+             for (String::Size i = 1; i < count; i++) {
+               result += ", ";
+               result += std_fragments[i];
+             }
+             DoNotOptimize(result.data());
+           }));
+  }
+}
+
+// Serializes a batch of metrics as "name value\n" lines, with an integer and
+// a floating point value each, and parses the values back: with the String
+// number functions, with std::ostringstream and std::istringstream (copying
+// each result into a String, as callers used to), and with std::to_chars
+// into a std::string and std::strtod.
+BENCHMARK(Numbers) {
+  constexpr int kMetrics = 64;
+  std::vector<long long> counts;
+  std::vector<double> ratios;
+  for (int i = 0; i < kMetrics; i++) {
+    counts.push_back(i * 7919LL * i);
+    ratios.push_back(i / 7.0);
+  }
+  auto format = [&] {
+    StringBuilder out{64 * kMetrics};
+    for (int i = 0; i < kMetrics; i++) {
+      out << "requests_total " << counts[i] << '\n';
+      out << "hit_ratio " << ratios[i] << '\n';
+    }
+    return out.build();
+  };
+  String::Size bytes = format().length();
+  Report("format_metrics", "string", kMetrics, bytes, Measure([&] {
+           DoNotOptimize(format().data());
+         }));
+  Report("format_metrics", "stream", kMetrics, bytes, Measure([&] {
+           std::ostringstream out;
+           out.precision(17);
+           for (int i = 0; i < kMetrics; i++) {
+             out << "requests_total " << counts[i] << '\n';
+             out << "hit_ratio " << ratios[i] << '\n';
+           }
+           std::string text = out.str();
+           DoNotOptimize(String{text.data(), text.size()}.data());
+         }));
+  Report("format_metrics", "std", kMetrics, bytes, Measure([&] {
+           std::string out;
+           out.reserve(64 * kMetrics);
+           char digits[32];
+           for (int i = 0; i < kMetrics; i++) {
+             out += "requests_total ";
+             out.append(digits, std::to_chars(digits, digits + 32, counts[i])
+                                    .ptr);
+             out += "\nhit_ratio ";
+             out.append(digits, std::to_chars(digits, digits + 32, ratios[i])
+                                    .ptr);
+             out += '\n';
+           }
+           DoNotOptimize(out.data());
+         }));
+  std::vector<String> texts;
+  bytes = 0;
+  for (double ratio : ratios) {
+    texts.push_back(to_string(ratio));
+    bytes += texts.back().length();
+  }
+  Report("parse_doubles", "string", kMetrics, bytes, Measure([&] {
+           double total = 0;
+           for (const String& text : texts) total += *parse_double(text);
+           DoNotOptimize(total);
+         }));
+  Report("parse_doubles", "stream", kMetrics, bytes, Measure([&] {
+           double total = 0;
+           for (const String& text : texts) {
+             std::istringstream input{std::string{text.data(), text.length()}};
+             double value;
+             input >> value;
+             total += value;
+           }
+           DoNotOptimize(total);
+         }));
+  Report("parse_doubles", "std", kMetrics, bytes, Measure([&] {
+           double total = 0;
+           for (const String& text : texts) {
+             total += std::strtod(text.data(), nullptr);
+           }
+           DoNotOptimize(total);
+         }));
+}
+
+// Validates and counts the code points of ASCII and of mixed-script UTF-8
+// text with each instruction set's kernels.
+BENCHMARK(Utf8) {
+  const std::pair<const char*, std::string_view> kTexts[] = {
+      {"ascii", "The quick brown fox jumps over the lazy dog. "},
+      {"mixed", "na\xC3\xAFve caf\xC3\xA9 \xE2\x82\xAC" "10 "
+                "\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82 "
+                "\xE4\xBD\xA0\xE5\xA5\xBD \xF0\x9F\x98\x80 "},
+  };
+  const std::pair<const char*, simd::Isa> kIsas[] = {
+      {"scalar", simd::Isa::kScalar},
+      {"sse2", simd::Isa::kSse2},
+      {"avx2", simd::Isa::kAvx2},
+  };
+  simd::Isa original = simd::selected();
+  for (auto [text_name, piece] : kTexts) {
+    std::string text;
+    while (text.size() < (1 << 20)) text += piece;
+    String s{text.data(), text.size()};
+    for (auto [isa_name, isa] : kIsas) {
+      if (isa > simd::detect()) break;
+      simd::select(isa);
+      Report("utf8_valid_"s + text_name, isa_name, s.length(), s.length(),
+             Measure([&] { DoNotOptimize(is_valid_utf8(s)); }));
+      Report("utf8_count_"s + text_name, isa_name, s.length(), s.length(),
+             Measure([&] { DoNotOptimize(count_code_points(s)); }));
+    }
+  }
+  simd::select(original);
+}
+
+// Normalizes text the way header and key handling does: lowercasing a copy,
+// replacing a substring everywhere and comparing without case. The std
+// versions use std::tolower, repeated std::string::replace and strncasecmp.
+BENCHMARK(Transform) {
+  for (String::Size size : {16, 256, 4096}) {
+    std::string text;
+    while (text.size() < size) text += "Accept-Encoding: GZIP; ";
+    text.resize(size);
+    String s{text.data(), text.size()};
+    String other = to_upper(s);
+    std::string std_other{other.data(), other.length()};
+    Report("to_lower", "string", size, size,
+           Measure([&] { DoNotOptimize(to_lower(s).data()); }));
+    Report("to_lower", "std", size, size, Measure([&] {
+             std::string lower = text;
+             std::transform(lower.begin(), lower.end(), lower.begin(),
+                            [](unsigned char c) { return std::tolower(c); });
+             DoNotOptimize(lower.data());
+           }));
+    Report("replace_all", "string", size, size, Measure([&] {
+             DoNotOptimize(replace_all(s, "; ", ";\r\n").data());
+           }));
+    Report("replace_all", "std", size, size, Measure([&] {
+             std::string replaced = text;
+             for (std::size_t i = replaced.find("; "); i != replaced.npos;
+                  i = replaced.find("; ", i + 3)) {
+               replaced.replace(i, 2, ";\r\n");
+             }
+             DoNotOptimize(replaced.data());
+           }));
+    Report("equals_ignoring_case", "string", size, size, Measure([&] {
+             DoNotOptimize(equals_ignoring_case(s, other));
+           }));
+    Report("equals_ignoring_case", "std", size, size, Measure([&] {
+             DoNotOptimize(text.size() == std_other.size() &&
+                           strncasecmp(text.data(), std_other.data(),
+                                       text.size()) == 0);
+           }));
+  }
+}
+
+BENCHMARK(Parallel) {
+  // Single-threaded against the shared pool, which has a thread per core.
+  parallel::ThreadPool& pool = parallel::ThreadPool::shared();
+  for (String::Size size : {1 << 20, 16 << 20}) {
+    std::string text;
+    while (text.size() < size) text += "GET /index.html HTTP/1.1\r\n";
+    text.resize(size);
+    String s{text.data(), text.size()};
+    Report("copy", "serial", size, size,
+           Measure([&] { DoNotOptimize(String{s}.data()); }));
+    Report("copy", "parallel", size, size,
+           Measure([&] { DoNotOptimize(parallel::copy(s, pool).data()); }));
+    Report("count", "serial", size, size,
+           Measure([&] { DoNotOptimize(count(s, "\r\n")); }));
+    Report("count", "parallel", size, size,
+           Measure([&] { DoNotOptimize(parallel::count(s, "\r\n", pool)); }));
+    Report("find", "serial", size, size,
+           Measure([&] { DoNotOptimize(find(s, "POST")); }));
+    Report("find", "parallel", size, size,
+           Measure([&] { DoNotOptimize(parallel::find(s, "POST", pool)); }));
+    Report("to_upper", "serial", size, size,
+           Measure([&] { DoNotOptimize(to_upper(s).data()); }));
+    Report("to_upper", "parallel", size, size, Measure([&] {
+             DoNotOptimize(parallel::to_upper(s, pool).data());
+           }));
+  }
+}
+
+BENCHMARK(Literals) {
+  // Building a String from a literal: counting and copying its chars (and
+  // allocating, once it is too long to be inline) against pointing at it.
+  Report("literal", "c_str", 12, 12,
+         Measure([&] { DoNotOptimize(String{"content-type"}.data()); }));
+  Report("literal", "_s", 12, 12, Measure([&] {
+           DoNotOptimize(String{"content-type"_s}.length());
+         }));
+  Report("literal", "c_str", 48, 48, Measure([&] {
+           DoNotOptimize(
+               String{"application/x-www-form-urlencoded; charset=utf-8"}
+                   .data());
+         }));
+  Report("literal", "_s", 48, 48, Measure([&] {
+           DoNotOptimize(
+               String{"application/x-www-form-urlencoded; charset=utf-8"_s}
+                   .length());
+         }));
+}
+
+// Writes the same output to a file and to a pipe through an std::ostream and
+// through an OutputBatch: a burst of log records, each made of many short
+// pieces, and a response whose body is one large piece. Each op ends with a
+// flush, as a server would after handling a request. The file is rewound
+// after every op so that it stays small.
+BENCHMARK(OutputBatch) {
+  constexpr int kRecords = 16;
+  String message{"GET /api/v1/users/12345/preferences returned 200"};
+  String user{"alice@example.com"};
+  auto write_log = [&](auto& out) {
+    for (int i = 0; i < kRecords; i++) {
+      out << "ts="_s << 1700000000 + i << " level=info msg=\""_s << message
+          << "\" user="_s << user << " latency_ms="_s << 12.5 << '\n';
+    }
+  };
+  String body{'x', 64 << 10};
+  auto write_response = [&](auto& out) {
+    out << "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"_s
+        << "Content-Length: "_s << body.length() << "\r\n\r\n"_s << body;
+  };
+
+  char path[] = "/tmp/string_bench_XXXXXX";
+  int file = mkstemp(path);
+  int ends[2];
+  if (file == -1 || pipe(ends) == -1) return;
+  std::thread reader([&] {
+    std::vector<char> buffer(1 << 16);
+    while (read(ends[0], buffer.data(), buffer.size()) > 0) {
+    }
+  });
+  std::ofstream file_stream{path};
+  std::ofstream pipe_stream{"/proc/self/fd/" + std::to_string(ends[1])};
+  OutputBatch file_batch{file}, pipe_batch{ends[1]};
+  auto run = [&](std::string_view name, auto write) {
+    std::ostringstream sample;
+    write(sample);
+    String::Size bytes = sample.str().size();
+    Report(std::string{name} + "_file", "ostream", bytes, bytes, Measure([&] {
+             write(file_stream);
+             file_stream.flush();
+             file_stream.seekp(0);
+           }));
+    Report(std::string{name} + "_file", "batch", bytes, bytes, Measure([&] {
+             write(file_batch);
+             file_batch.flush();
+             lseek(file, 0, SEEK_SET);
+           }));
+    Report(std::string{name} + "_pipe", "ostream", bytes, bytes, Measure([&] {
+             write(pipe_stream);
+             pipe_stream.flush();
+           }));
+    Report(std::string{name} + "_pipe", "batch", bytes, bytes, Measure([&] {
+             write(pipe_batch);
+             pipe_batch.flush();
+           }));
+  };
+  run("output_log", write_log);
+  run("output_response", write_response);
+  pipe_stream.close();
+  close(ends[1]);
+  reader.join();
+  close(ends[0]);
+  close(file);
+  unlink(path);
+}
+
+// Simulates handling a request which builds many short-lived strings of
+// assorted lengths and then throws them all away, either with each buffer on
+// the global heap or with all of them in an arena released at the end.
+BENCHMARK(Arena) {
+  constexpr int kStringsPerRequest = 1000;
+  for (String::Size size : {16, 64, 256}) {
+    auto global = Measure([&] {
+      std::vector<String> strings;
+      strings.reserve(kStringsPerRequest);
+      for (int i = 0; i < kStringsPerRequest; i++) {
+        strings.emplace_back('x', size + i % 16);
+      }
+      DoNotOptimize(strings.data());
+    });
+    Arena arena;
+    auto arena_time = Measure([&] {
+      {
+        std::vector<String> strings;
+        strings.reserve(kStringsPerRequest);
+        for (int i = 0; i < kStringsPerRequest; i++) {
+          strings.emplace_back('x', size + i % 16, &arena);
+        }
+        DoNotOptimize(strings.data());
+      }
+      arena.release();
+    });
+    Report("1000_strings_per_request", "global", size,
+           kStringsPerRequest * size, global);
+    Report("1000_strings_per_request", "arena", size,
+           kStringsPerRequest * size, arena_time);
+  }
+}
+
+// Hands one large string to a number of worker threads, each of which makes
+// many copies of it, as happens when a config or routing table is passed to
+// every worker. Compares ordinary copies with copies of a shared string.
+BENCHMARK(SharedFanOut) {
+  constexpr int kCopiesPerThread = 10000;
+  for (String::Size size : {256, 4096, 65536}) {
+    for (int threads : {1, 2, 4, 8}) {
+      auto fan_out = [&](const String& source) {
+        std::vector<std::thread> workers;
+        for (int i = 0; i < threads; i++) {
+          workers.emplace_back([&source] {
+            for (int j = 0; j < kCopiesPerThread; j++) {
+              String copy{source};
+              DoNotOptimize(static_cast<const String&>(copy).data());
+            }
+          });
+        }
+        for (auto& worker : workers) worker.join();
+      };
+      String unshared{'x', size};
+      String shared{'x', size};
+      shared.share();
+      std::string name = "fan_out_" + std::to_string(threads) + "_threads";
+      String::Size bytes = threads * kCopiesPerThread * size;
+      Report(name, "copy", size, bytes, Measure([&] { fan_out(unshared); }));
+      Report(name, "shared", size, bytes, Measure([&] { fan_out(shared); }));
+    }
+  }
+}
+
+// Identifiers of a given length which differ in their last few chars, like
+// the field or symbol names which make good candidates for interning.
+std::vector<std::string> Identifiers(int count, String::Size length) {
+  std::vector<std::string> identifiers;
+  for (int i = 0; i < count; i++) {
+    std::string suffix = "_" + std::to_string(i);
+    identifiers.push_back(std::string(length - suffix.size(), 'x') + suffix);
+  }
+  return identifiers;
+}
+
+// Compares the memory taken by keeping every unique identifier as its own
+// String with interning each of them and keeping a handle. Interning only
+// pays for itself once identifiers repeat: every String holding a repeat
+// costs as much again, while every handle to it costs one pointer.
+BENCHMARK(InternMemory) {
+  constexpr int kUnique = 100000;
+  for (String::Size size : {8, 16, 32, 64}) {
+    std::vector<std::string> identifiers = Identifiers(kUnique, size);
+    std::size_t before = allocated_bytes;
+    {
+      std::vector<String> strings;
+      strings.reserve(kUnique);
+      for (auto& identifier : identifiers) {
+        strings.emplace_back(identifier.data(), identifier.size());
+      }
+      ReportMemory("intern_memory", "String", size,
+                   double(allocated_bytes - before) / kUnique);
+    }
+    InternPool pool;
+    for (auto& identifier : identifiers) {
+      pool.intern({identifier.data(), identifier.size()});
+    }
+    ReportMemory("intern_memory", "InternPool", size,
+                 double(pool.bytes_used()) / kUnique +
+                     sizeof(InternPool::Handle));
+  }
+}
+
+// Interns identifiers which are mostly already in the pool from several
+// threads at once, against the simplest alternative: one lock around one
+// std::unordered_set.
+BENCHMARK(InternThroughput) {
+  constexpr int kUnique = 10000, kInternsPerThread = 100000;
+  constexpr String::Size kSize = 24;
+  std::vector<std::string> identifiers = Identifiers(kUnique, kSize);
+  for (int threads : {1, 2, 4, 8}) {
+    auto run = [&](auto intern) {
+      std::vector<std::thread> workers;
+      for (int i = 0; i < threads; i++) {
+        workers.emplace_back([&, i] {
+          for (int j = 0; j < kInternsPerThread; j++) {
+            auto& identifier = identifiers[(j * 7919 + i) % kUnique];
+            DoNotOptimize(intern(identifier));
+          }
+        });
+      }
+      for (auto& worker : workers) worker.join();
+    };
+    InternPool pool;
+    std::mutex mutex;
+    std::unordered_set<std::string> set;
+    std::string name = "intern_" + std::to_string(threads) + "_threads";
+    String::Size bytes = threads * kInternsPerThread * kSize;
+    Report(name, "InternPool", kSize, bytes, Measure([&] {
+             run([&](const std::string& s) {
+               return pool.intern({s.data(), s.size()});
+             });
+           }));
+    Report(name, "locked_set", kSize, bytes, Measure([&] {
+             run([&](const std::string& s) {
+               std::lock_guard<std::mutex> lock{mutex};
+               return set.insert(s).first->data();
+             });
+           }));
+  }
+}
+
+// Compares a vector of Strings with a StringColumn holding the same values:
+// the memory each value takes, and scanning every value for a substring and
+// for equality.
+BENCHMARK(StringColumn) {
+  constexpr int kRows = 1000000;
+  for (String::Size size : {8, 16, 32, 64}) {
+    std::vector<std::string> identifiers = Identifiers(kRows, size);
+    std::size_t before = allocated_bytes;
+    std::vector<String> strings;
+    strings.reserve(kRows);
+    for (auto& identifier : identifiers) {
+      strings.emplace_back(identifier.data(), identifier.size());
+    }
+    ReportMemory("column_memory", "String", size,
+                 double(allocated_bytes - before) / kRows);
+    StringColumn column{strings};
+    ReportMemory("column_memory", "column", size,
+                 double(column.bytes_used()) / kRows);
+
+    String::Size bytes = kRows * size;
+    Report("column_find", "String", size, bytes, Measure([&] {
+             std::size_t matches = 0;
+             for (const String& s : strings) matches += contains(s, "_9999");
+             DoNotOptimize(matches);
+           }));
+    Report("column_find", "column", size, bytes, Measure([&] {
+             DoNotOptimize(column.find("_9999").size());
+           }));
+    String value{identifiers[kRows / 2].data(), size};
+    Report("column_equal", "String", size, bytes, Measure([&] {
+             std::size_t matches = 0;
+             for (const String& s : strings) matches += s == value;
+             DoNotOptimize(matches);
+           }));
+    Report("column_equal", "column", size, bytes, Measure([&] {
+             DoNotOptimize(column.find_equal(value).size());
+           }));
+  }
+}
+
+// Drops a file's pages from the page cache, so that the next read of it comes
+// from disk.
+void EvictFromCache(const char* path) {
+  int file = open(path, O_RDONLY);
+  if (file == -1) return;
+  fdatasync(file);
+  posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+  close(file);
+}
+
+// Compares starting up from a dictionary of identifiers kept as text, one per
+// line, which is split into Strings and put in a hash map, with mapping the
+// same dictionary saved as a string table, with and without verifying its
+// checksums. Each load ends with one lookup. "Cold" loads evict the files
+// from the page cache first; "warm" ones find them already there.
+BENCHMARK(StringTable) {
+  for (int rows : {100000, 1000000}) {
+    std::vector<std::string> identifiers = Identifiers(rows, 24);
+    char text_path[] = "/tmp/string_bench_XXXXXX";
+    char table_path[] = "/tmp/string_bench_XXXXXX";
+    close(mkstemp(text_path));
+    close(mkstemp(table_path));
+    {
+      std::ofstream text{text_path};
+      for (auto& identifier : identifiers) text << identifier << '\n';
+    }
+    StringColumn column;
+    for (auto& identifier : identifiers) {
+      column.append(StringView{identifier.data(), identifier.size()});
+    }
+    write_string_table(table_path, column);
+    StringView key = column[rows / 2];
+
+    auto parse = [&] {
+      String text = String::map_file(text_path);
+      std::unordered_map<String, String::Size> dictionary;
+      dictionary.reserve(rows);
+      for (StringView line : lines(text)) {
+        dictionary.emplace(String{line}, dictionary.size());
+      }
+      DoNotOptimize(dictionary.find(String{key})->second);
+    };
+    auto map = [&](bool verify) {
+      return [&, verify] {
+        StringTable table{table_path, verify};
+        DoNotOptimize(table.find(key));
+      };
+    };
+    auto evict = [&] {
+      EvictFromCache(text_path);
+      EvictFromCache(table_path);
+    };
+    String::Size bytes = rows * 25;
+    for (bool cold : {true, false}) {
+      std::string name = cold ? "table_load_cold" : "table_load_warm";
+      auto setup = [&] {
+        if (cold) evict();
+      };
+      Report(name, "parse", rows, bytes, MeasureWithSetup(setup, parse));
+      Report(name, "verified", rows, bytes, MeasureWithSetup(setup, map(true)));
+      Report(name, "mapped", rows, bytes, MeasureWithSetup(setup, map(false)));
+    }
+    unlink(text_path);
+    unlink(table_path);
+  }
+}
+
+// Counts the occurrences of every keyword in 1 MiB of words, with a
+// KeywordMatcher against calling count() once per keyword. Half of the
+// keywords are words from the text and half are not, and most of those share
+// a first few chars with words that are.
+BENCHMARK(KeywordMatcher) {
+  std::mt19937_64 random{42};
+  auto word = [&] {
+    std::string w(3 + random() % 8, 'a');
+    for (char& c : w) c = 'a' + random() % 26;
+    return w;
+  };
+  std::vector<std::string> vocabulary;
+  for (int i = 0; i < 20000; i++) vocabulary.push_back(word());
+  std::string text;
+  while (text.size() < (1 << 20)) {
+    text += vocabulary[random() % vocabulary.size()];
+    text += ' ';
+  }
+  String s{text.data(), text.size()};
+  for (int patterns : {10, 100, 1000, 10000}) {
+    std::vector<String> keywords;
+    for (int i = 0; i < patterns; i++) {
+      std::string keyword = vocabulary[random() % vocabulary.size()];
+      if (i % 2 == 1) keyword += word();
+      keywords.emplace_back(keyword.data(), keyword.size());
+    }
+    KeywordMatcher matcher{keywords};
+    std::string name = "keywords_" + std::to_string(patterns);
+    Report(name, "count_each", s.length(), s.length(), Measure([&] {
+             String::Size total = 0;
+             for (const String& keyword : keywords) total += count(s, keyword);
+             DoNotOptimize(total);
+           }));
+    Report(name, "matcher", s.length(), s.length(), Measure([&] {
+             String::Size total = 0;
+             matcher.for_each_match(s, [&](KeywordMatcher::Match) { total++; });
+             DoNotOptimize(total);
+           }));
+    ReportMemory(name + "_memory", "matcher", patterns,
+                 double(matcher.bytes_used()) / patterns);
+  }
+}
+
+// Looks up every key of a hash map with a separate copy of the key, as when
+// the key comes from a request. "shared" keys and probes are shared strings,
+// which only work out their hash the first time it is asked for.
+BENCHMARK(HashMapLookup) {
+  constexpr int kKeys = 1000;
+  for (String::Size size : {8, 16, 32, 64, 256}) {
+    std::vector<std::string> identifiers = Identifiers(kKeys, size);
+    std::unordered_map<String, int> strings;
+    std::unordered_map<String, int> shared;
+    std::unordered_map<std::string, int> stds;
+    std::vector<String> string_probes, shared_probes;
+    std::vector<std::string> std_probes;
+    for (int i = 0; i < kKeys; i++) {
+      String key{identifiers[i].data(), identifiers[i].size()};
+      strings.emplace(key, i);
+      string_probes.push_back(key);
+      key.share();
+      shared.emplace(key, i);
+      shared_probes.push_back(key);
+      stds.emplace(identifiers[i], i);
+      std_probes.push_back(identifiers[i]);
+    }
+    auto lookups = [](auto& map, auto& probes) {
+      return [&] {
+        int total = 0;
+        for (auto& probe : probes) total += map.find(probe)->second;
+        DoNotOptimize(total);
+      };
+    };
+    String::Size bytes = kKeys * size;
+    Report("hash_map_lookup", "String", size, bytes,
+           Measure(lookups(strings, string_probes)));
+    Report("hash_map_lookup", "shared", size, bytes,
+           Measure(lookups(shared, shared_probes)));
+    Report("hash_map_lookup", "std::string", size, bytes,
+           Measure(lookups(stds, std_probes)));
+  }
+}
+
+// Compares equal strings which differ only in their last char.
+BENCHMARK(Equality) {
+  Compare(
+      "equality",
+      [](String::Size size) {
+        String b{'x', size};
+        if (size > 0) b.data()[size - 1] = 'y';
+        return [a = String('x', size), b = std::move(b)] {
+          DoNotOptimize(a == b);
+        };
+      },
+      [](String::Size size) {
+        std::string b(size, 'x');
+        if (size > 0) b[size - 1] = 'y';
+        return [a = std::string(size, 'x'), b = std::move(b)] {
+          DoNotOptimize(a == b);
+        };
+      },
+      2);
+}
+
+// Builds a message out of many small fragments, as a serializer does: by
+// repeated concatenation, by appending to a String, with a StringBuilder and
+// by appending to a std::string.
+BENCHMARK(AppendFragments) {
+  for (String::Size size : {8, 32}) {
+    for (int fragments : {10, 100, 1000}) {
+      String fragment{'f', size};
+      std::string std_fragment(size, 'f');
+      std::string name = "append_" + std::to_string(fragments) + "_fragments";
+      String::Size bytes = fragments * size;
+      Report(name, "s = s + f", size, bytes, Measure([&] {
+               String message;
+               for (int i = 0; i < fragments; i++) message = message + fragment;
+               DoNotOptimize(message.data());
+             }));
+      Report(name, "append", size, bytes, Measure([&] {
+               String message;
+               for (int i = 0; i < fragments; i++) message.append(fragment);
+               DoNotOptimize(message.data());
+             }));
+      Report(name, "builder", size, bytes, Measure([&] {
+               StringBuilder out;
+               for (int i = 0; i < fragments; i++) out << fragment;
+               String message = out.build();
+               DoNotOptimize(message.data());
+             }));
+      Report(name, "std::string", size, bytes, Measure([&] {
+               std::string message;
+               for (int i = 0; i < fragments; i++) message += std_fragment;
+               DoNotOptimize(message.data());
+             }));
+    }
+  }
+}
+
+// Returns the number of bytes of this process which are in memory.
+std::size_t ResidentBytes() {
+  std::ifstream statm{"/proc/self/statm"};
+  std::size_t pages = 0, resident = 0;
+  statm >> pages >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+// Loads a file the usual way, into a buffer and then into a String.
+String ReadFile(const char* path) {
+  std::ifstream input{path, std::ios::binary | std::ios::ate};
+  std::string buffer(input.tellg(), '\0');
+  input.seekg(0);
+  input.read(buffer.data(), buffer.size());
+  return String{buffer.data(), buffer.size()};
+}
+
+// Compares loading a log file by reading it with mapping it: how long until
+// the first byte can be looked at, how long to scan the whole file for
+// newlines, and how much resident memory the loaded file costs. The file is
+// in the page cache for both, so this measures copying rather than the disk.
+BENCHMARK(MapFile) {
+  for (String::Size size : {1 << 20, 64 << 20, 256 << 20}) {
+    char path[] = "/tmp/string_bench_XXXXXX";
+    int file = mkstemp(path);
+    std::string line(99, 'l');
+    line.push_back('\n');
+    for (String::Size written = 0; written < size; written += line.size()) {
+      if (write(file, line.data(), line.size()) != ssize_t(line.size())) {
+        std::cerr << "Couldn't write " << path << "\n";
+        break;
+      }
+    }
+    close(file);
+    Report("file_first_byte", "read", size, size, Measure([&] {
+             const String contents = ReadFile(path);
+             DoNotOptimize(contents.data()[0]);
+           }));
+    Report("file_first_byte", "map_file", size, size, Measure([&] {
+             // A const String, as a mutable data() would copy the file.
+             const String contents = String::map_file(path);
+             DoNotOptimize(contents.data()[0]);
+           }));
+    Report("file_scan_lines", "read", size, size, Measure([&] {
+             DoNotOptimize(count(ReadFile(path), '\n'));
+           }));
+    Report("file_scan_lines", "map_file", size, size, Measure([&] {
+             DoNotOptimize(count(String::map_file(path), '\n'));
+           }));
+    std::size_t before = ResidentBytes();
+    {
+      String contents = ReadFile(path);
+      DoNotOptimize(count(contents, '\n'));
+      ReportMemory("file_resident", "read", size, ResidentBytes() - before);
+    }
+    before = ResidentBytes();
+    {
+      const String contents = String::map_file(path);
+      DoNotOptimize(contents.data()[0]);
+      ReportMemory("file_resident", "map_file", size,
+                   ResidentBytes() - before);
+      // Scanning maps in every page, but they belong to the page cache and
+      // can be dropped under memory pressure, unlike a heap copy.
+      DoNotOptimize(count(contents, '\n'));
+      ReportMemory("file_resident", "map_scanned", size,
+                   ResidentBytes() - before);
+    }
+    unlink(path);
+  }
+}
+
+// Compares ways of splitting CSV text into rows and fields: the split() and
+// lines() ranges, a loop of find and substring which copies each field into a
+// String, and std::string_view with find.
+BENCHMARK(SplitFields) {
+  for (String::Size rows : {16, 1024}) {
+    std::string csv;
+    for (String::Size i = 0; i < rows; i++) {
+      csv += "1042,Ada Lovelace,ada@example.com,,London,1815-12-10\n";
+    }
+    String text{csv.data(), csv.size()};
+    Report("split_csv", "split", rows, csv.size(), Measure([&] {
+             String::Size total = 0;
+             for (StringView line : lines(text)) {
+               for (StringView field : split(line, ',')) {
+                 total += field.length();
+               }
+             }
+             DoNotOptimize(total);
+           }));
+    Report("split_csv", "substring", rows, csv.size(), Measure([&] {
+             String::Size total = 0, start = 0;
+             while (start < text.length()) {
+               String::Size end = find(text, '\n', start);
+               String line = substring(text, start, end - start);
+               String::Size field_start = 0;
+               while (true) {
+                 String::Size comma = find(line, ',', field_start);
+                 if (comma == kNotFound) comma = line.length();
+                 String field =
+                     substring(line, field_start, comma - field_start);
+                 total += field.length();
+                 if (comma == line.length()) break;
+                 field_start = comma + 1;
+               }
+               start = end + 1;
+             }
+             DoNotOptimize(total);
+           }));
+    Report("split_csv", "std", rows, csv.size(), Measure([&] {
+             std::string_view rest = csv;
+             std::size_t total = 0;
+             while (!rest.empty()) {
+               std::size_t end = rest.find('\n');
+               std::string_view line = rest.substr(0, end);
+               rest.remove_prefix(end == rest.npos ? rest.size() : end + 1);
+               while (true) {
+                 std::size_t comma = line.find(',');
+                 total += line.substr(0, comma).size();
+                 if (comma == line.npos) break;
+                 line.remove_prefix(comma + 1);
+               }
+             }
+             DoNotOptimize(total);
+           }));
+  }
+}
+
+// Sorts keys shaped like the ones a large index holds: URLs which share a
+// long prefix, and short words, some short enough to be stored inline.
+// std::sort is given the same Strings and compares them with operator<.
+BENCHMARK(Sort) {
+  std::mt19937_64 random{42};
+  for (String::Size size : {1000000, 10000000, 100000000}) {
+    if (size > max_sort_size) break;
+    std::vector<String> keys, sorted;
+    keys.reserve(size);
+    String::Size bytes = 0;
+    char word[24];
+    for (String::Size i = 0; i < size; i++) {
+      std::uint64_t bits = random();
+      int length = 4 + bits % 20;
+      for (int j = 0; j < length; j++, bits = bits * 6364136223846793005 + 1) {
+        word[j] = 'a' + (bits >> 59) % 26;
+      }
+      if (i % 2 == 0) {
+        keys.push_back(concat("https://example.com/users/"_s,
+                              StringView{word, String::Size(length)}));
+      } else {
+        keys.emplace_back(word, length);
+      }
+      bytes += keys.back().length();
+    }
+    auto setup = [&] {
+      sorted.clear();
+      sorted.shrink_to_fit();
+      sorted = keys;
+    };
+    Report("sort", "std::sort", size, bytes, MeasureWithSetup(setup, [&] {
+             std::sort(sorted.begin(), sorted.end());
+           }));
+    Report("sort", "sort_strings", size, bytes,
+           MeasureWithSetup(setup, [&] { sort_strings(sorted); }));
+  }
+}
+
+// Usage: bench [--csv] [--min-time-ms=N] [--max-sort-size=N]
+//              [benchmark names...]
+// With no names, every benchmark is run.
+int main(int argc, char* argv[]) {
+  std::vector<std::string_view> selected;
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    if (arg == "--csv") {
+      csv_output = true;
+    } else if (arg.substr(0, 14) == "--min-time-ms=") {
+      min_duration = std::chrono::milliseconds(std::atoi(argv[i] + 14));
+    } else if (arg.substr(0, 16) == "--max-sort-size=") {
+      max_sort_size = std::strtoull(argv[i] + 16, nullptr, 10);
+    } else {
+      selected.push_back(arg);
+    }
+  }
+  if (csv_output) {
+    std::cout << "benchmark,implementation,size,ns_per_op,bytes_per_second,"
+                 "allocations_per_op,bytes_per_item\n";
+  }
+  for (auto [name, benchmark] : benchmarks) {
+    bool run = selected.empty();
+    for (auto s : selected) run |= name == s;
+    if (run) benchmark();
+  }
+}
@@ -0,0 +1,81 @@
+#include <cstdint>
+#include <cstring>
+#include "../include/Hash.h"
+
+using Size = StringView::Size;
+
+namespace {
+
+constexpr Size kSecret0 = 0xa0761d6478bd642f;
+constexpr Size kSecret1 = 0xe7037ed1a0b428db;
+constexpr Size kSecret2 = 0x8ebc6af09c88c6e3;
+constexpr Size kSecret3 = 0x589965cc75374cc3;
+
+__extension__ typedef unsigned __int128 Product;
+
+// Multiplies a and b into 128 bits and folds the halves together, which
+// mixes every bit of both inputs into the result.
+Size Mix(Size a, Size b) {
+  Product product = Product{a} * b;
+  return static_cast<Size>(product) ^ static_cast<Size>(product >> 64);
+}
+
+Size Load64(const unsigned char* p) {
+  std::uint64_t word;
+  std::memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+Size Load32(const unsigned char* p) {
+  std::uint32_t word;
+  std::memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+}  // namespace
+
+Size hash(StringView v) {
+  auto p = reinterpret_cast<const unsigned char*>(v.data());
+  Size length = v.length();
+  Size seed = Mix(kSecret0, kSecret1);
+  Size a, b;
+  if (length <= 16) {
+    if (length >= 4) {
+      // Two pairs of 4-byte loads which between them cover every byte.
+      Size step = (length >> 3) << 2;
+      a = (Load32(p) << 32) | Load32(p + step);
+      b = (Load32(p + length - 4) << 32) | Load32(p + length - 4 - step);
+    } else if (length > 0) {
+      a = (Size{p[0]} << 16) | (Size{p[length >> 1]} << 8) | p[length - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    Size remaining = length;
+    if (remaining > 48) {
+      // Three independent lanes, so the multiplies can run in parallel.
+      Size second = seed, third = seed;
+      do {
+        seed = Mix(Load64(p) ^ kSecret1, Load64(p + 8) ^ seed);
+        second = Mix(Load64(p + 16) ^ kSecret2, Load64(p + 24) ^ second);
+        third = Mix(Load64(p + 32) ^ kSecret3, Load64(p + 40) ^ third);
+        p += 48;
+        remaining -= 48;
+      } while (remaining > 48);
+      seed ^= second ^ third;
+    }
+    while (remaining > 16) {
+      seed = Mix(Load64(p) ^ kSecret1, Load64(p + 8) ^ seed);
+      p += 16;
+      remaining -= 16;
+    }
+    // The last 16 bytes, which may overlap bytes already mixed in.
+    a = Load64(p + remaining - 16);
+    b = Load64(p + remaining - 8);
+  }
+  Product product = Product{a ^ kSecret1} * (b ^ seed);
+  a = static_cast<Size>(product);
+  b = static_cast<Size>(product >> 64);
+  return Mix(a ^ kSecret0 ^ length, b ^ kSecret1);
+}
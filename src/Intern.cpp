@@ -0,0 +1,171 @@
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+#include "../include/Arena.h"
+#include "../include/Hash.h"
+#include "../include/Intern.h"
+
+using Size = InternPool::Size;
+
+// Each interned string is stored as an Entry followed by its chars and a nul
+// terminator, all in one slab allocation.
+struct InternPool::Entry {
+  Size hash;
+  Size length;
+};
+
+namespace {
+
+// The pool is split into 2^kShardBits shards, chosen by the top bits of the
+// hash. The bottom bits pick the slot within a shard's table.
+constexpr int kShardBits = 6;
+constexpr Size kShards = Size{1} << kShardBits;
+
+// Each shard takes memory for its strings from the heap in slabs of this size.
+constexpr Size kSlabSize = 16 * 1024;
+
+// Tables start with this many slots and double when they are 3/4 full.
+constexpr Size kInitialSlots = 16;
+
+}  // namespace
+
+// An open-addressed table with linear probing, holding pointers to entries.
+// Slots only ever go from null to an entry, and an entry never changes once
+// it is in a slot, so readers can probe without a lock.
+struct InternPool::Table {
+  explicit Table(Size size)
+      : mask(size - 1), slots(new std::atomic<const Entry*>[size]()) {}
+
+  Size size() const { return mask + 1; }
+
+  // Returns the slot holding s, or the empty slot where it would go.
+  std::atomic<const Entry*>& slot(Size hash, StringView s) const {
+    for (Size i = hash & mask;; i = (i + 1) & mask) {
+      const Entry* entry = slots[i].load(std::memory_order_acquire);
+      if (entry == nullptr) return slots[i];
+      if (entry->hash == hash && entry->length == s.length() &&
+          std::memcmp(entry + 1, s.data(), s.length()) == 0) {
+        return slots[i];
+      }
+    }
+  }
+
+  Size mask;
+  std::unique_ptr<std::atomic<const Entry*>[]> slots;
+};
+
+// Shards are aligned to a cache line so that threads adding to neighbouring
+// shards don't contend for the same line.
+struct alignas(64) InternPool::Shard {
+  Shard() {
+    tables.push_back(std::make_unique<Table>(kInitialSlots));
+    table.store(tables.back().get(), std::memory_order_relaxed);
+  }
+
+  // Replaces the table with one twice the size. The old table is kept until
+  // the pool is destroyed, as other threads may still be reading it; a
+  // reader which misses there takes the lock and looks again in the new one.
+  void grow() {
+    const Table& old = *tables.back();
+    tables.push_back(std::make_unique<Table>(2 * old.size()));
+    Table& grown = *tables.back();
+    for (Size i = 0; i < old.size(); i++) {
+      const Entry* entry = old.slots[i].load(std::memory_order_relaxed);
+      if (entry == nullptr) continue;
+      Size j = entry->hash & grown.mask;
+      while (grown.slots[j].load(std::memory_order_relaxed) != nullptr) {
+        j = (j + 1) & grown.mask;
+      }
+      grown.slots[j].store(entry, std::memory_order_relaxed);
+    }
+    table.store(&grown, std::memory_order_release);
+  }
+
+  std::atomic<const Table*> table;
+  // Everything below is only touched with the mutex held.
+  std::mutex mutex;
+  Arena slabs{kSlabSize};
+  std::vector<std::unique_ptr<Table>> tables;
+  Size count = 0;
+};
+
+InternPool::InternPool() : shards_(new Shard[kShards]) {}
+
+InternPool::~InternPool() = default;
+
+InternPool::Shard& InternPool::shard(Size hash) const {
+  return shards_[hash >> (64 - kShardBits)];
+}
+
+InternPool::Handle InternPool::intern(StringView s) {
+  Size hash = ::hash(s);
+  Shard& shard = this->shard(hash);
+  const Table* table = shard.table.load(std::memory_order_acquire);
+  const Entry* found = table->slot(hash, s).load(std::memory_order_acquire);
+  if (found != nullptr) return Handle{found};
+  std::lock_guard<std::mutex> lock{shard.mutex};
+  table = shard.table.load(std::memory_order_relaxed);
+  std::atomic<const Entry*>* slot = &table->slot(hash, s);
+  found = slot->load(std::memory_order_relaxed);
+  if (found != nullptr) return Handle{found};
+  if (4 * (shard.count + 1) > 3 * table->size()) {
+    shard.grow();
+    slot = &shard.tables.back()->slot(hash, s);
+  }
+  void* memory = shard.slabs.allocate(sizeof(Entry) + s.length() + 1,
+                                      alignof(Entry));
+  auto* entry = new (memory) Entry{hash, s.length()};
+  char* chars = reinterpret_cast<char*>(entry + 1);
+  std::memcpy(chars, s.data(), s.length());
+  chars[s.length()] = '\0';
+  slot->store(entry, std::memory_order_release);
+  shard.count++;
+  return Handle{entry};
+}
+
+InternPool::Handle InternPool::find(StringView s) const {
+  Size hash = ::hash(s);
+  const Table* table = shard(hash).table.load(std::memory_order_acquire);
+  return Handle{table->slot(hash, s).load(std::memory_order_acquire)};
+}
+
+Size InternPool::size() const {
+  Size total = 0;
+  for (Size i = 0; i < kShards; i++) {
+    std::lock_guard<std::mutex> lock{shards_[i].mutex};
+    total += shards_[i].count;
+  }
+  return total;
+}
+
+Size InternPool::bytes_used() const {
+  Size total = sizeof(Shard) * kShards;
+  for (Size i = 0; i < kShards; i++) {
+    std::lock_guard<std::mutex> lock{shards_[i].mutex};
+    total += shards_[i].slabs.bytes_used();
+    for (auto& table : shards_[i].tables) {
+      total += sizeof(Table) + table->size() * sizeof(table->slots[0]);
+    }
+  }
+  return total;
+}
+
+StringView InternPool::Handle::view() const {
+  return StringView{data(), length()};
+}
+
+const char* InternPool::Handle::data() const {
+  if (entry_ == nullptr) return "";
+  return reinterpret_cast<const char*>(entry_ + 1);
+}
+
+Size InternPool::Handle::length() const {
+  return entry_ == nullptr ? 0 : entry_->length;
+}
+
+Size InternPool::Handle::hash() const {
+  return entry_ == nullptr ? 0 : entry_->hash;
+}
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include "../include/KeywordMatcher.h"
+
+using Size = KeywordMatcher::Size;
+
+namespace {
+
+// The most the full rows of transitions may take, so that they stay in a
+// core's L2 cache.
+constexpr Size kMaxDenseBytes = 256 << 10;
+
+// A node of the trie while the matcher is being built, with its edges sorted
+// by class.
+struct Node {
+  std::vector<std::pair<std::uint16_t, std::uint32_t>> children;
+
+  // Returns the child on class c, or kNone.
+  std::uint32_t child(std::uint16_t c) const {
+    auto i = std::lower_bound(children.begin(), children.end(),
+                              std::make_pair(c, std::uint32_t{0}));
+    return i != children.end() && i->first == c ? i->second : ~0u;
+  }
+};
+
+}  // namespace
+
+KeywordMatcher::KeywordMatcher(const std::vector<String>& patterns)
+    : KeywordMatcher(std::vector<StringView>(patterns.begin(),
+                                             patterns.end())) {}
+
+KeywordMatcher::KeywordMatcher(const std::vector<StringView>& patterns) {
+  // Give each byte which appears in a pattern a class of its own, in byte
+  // order, and every other byte class 0.
+  bool used[256] = {};
+  for (StringView pattern : patterns) {
+    for (Size i = 0; i < pattern.length(); i++) {
+      used[static_cast<unsigned char>(pattern.data()[i])] = true;
+    }
+  }
+  classes_ = 1;
+  for (int b = 0; b < 256; b++) class_of_[b] = used[b] ? classes_++ : 0;
+
+  // Build the trie, numbering nodes in the order they are made.
+  std::vector<Node> trie(1);
+  std::vector<std::uint32_t> ends(patterns.size(), kNone);
+  for (Size p = 0; p < patterns.size(); p++) {
+    StringView pattern = patterns[p];
+    if (pattern.length() == 0) continue;
+    if (trie.size() + pattern.length() >= kHasMatches) {
+      throw std::length_error("too many pattern chars for a KeywordMatcher");
+    }
+    std::uint32_t node = 0;
+    for (Size i = 0; i < pattern.length(); i++) {
+      std::uint16_t c =
+          class_of_[static_cast<unsigned char>(pattern.data()[i])];
+      std::uint32_t next = trie[node].child(c);
+      if (next == kNone) {
+        next = trie.size();
+        auto& children = trie[node].children;
+        children.insert(
+            std::upper_bound(children.begin(), children.end(),
+                             std::make_pair(c, std::uint32_t{0})),
+            {c, next});
+        trie.push_back(Node{});
+      }
+      node = next;
+    }
+    ends[p] = node;
+  }
+
+  // Renumber the nodes breadth first, so that shallower states come first.
+  Size n = trie.size();
+  std::vector<std::uint32_t> order{0}, id(n);
+  order.reserve(n);
+  for (Size i = 0; i < order.size(); i++) {
+    id[order[i]] = i;
+    for (auto [c, child] : trie[order[i]].children) order.push_back(child);
+  }
+  for (Node& node : trie) {
+    for (auto& edge : node.children) edge.second = id[edge.second];
+  }
+  std::vector<Node> by_id(n);
+  for (Size i = 0; i < n; i++) by_id[id[i]] = std::move(trie[i]);
+  trie = std::move(by_id);
+
+  // Chain the patterns which end at each state, in the order given.
+  pattern_lengths_.resize(patterns.size());
+  next_pattern_.assign(patterns.size(), kNone);
+  first_pattern_.assign(n, kNone);
+  for (Size p = patterns.size(); p-- > 0;) {
+    pattern_lengths_[p] = patterns[p].length();
+    if (ends[p] == kNone) continue;
+    std::uint32_t state = id[ends[p]];
+    next_pattern_[p] = first_pattern_[state];
+    first_pattern_[state] = p;
+  }
+
+  // Failure and output links, in breadth-first order so that each state's
+  // links are known before its children's.
+  failure_.assign(n, 0);
+  output_link_.assign(n, kNone);
+  for (std::uint32_t state = 0; state < n; state++) {
+    for (auto [c, child] : trie[state].children) {
+      std::uint32_t fallback = 0;
+      if (state != 0) {
+        std::uint32_t f = failure_[state];
+        while (f != 0 && trie[f].child(c) == kNone) f = failure_[f];
+        std::uint32_t next = trie[f].child(c);
+        if (next != kNone) fallback = next;
+      }
+      failure_[child] = fallback;
+      output_link_[child] = first_pattern_[fallback] != kNone
+                                ? fallback
+                                : output_link_[fallback];
+    }
+  }
+  auto target = [&](std::uint32_t state) {
+    bool has_matches =
+        first_pattern_[state] != kNone || output_link_[state] != kNone;
+    return state | (has_matches ? kHasMatches : 0);
+  };
+
+  // Full rows for the states nearest the root, as many as fit.
+  row_shift_ = 0;
+  while ((Size{1} << row_shift_) < classes_) row_shift_++;
+  Size row = Size{1} << row_shift_;
+  dense_states_ = std::min<Size>(
+      n, std::max<Size>(1, kMaxDenseBytes / (row * sizeof(dense_[0]))));
+  dense_.resize(dense_states_ * row);
+  for (std::uint32_t state = 0; state < dense_states_; state++) {
+    for (std::uint16_t c = 0; c < classes_; c++) {
+      std::uint32_t child = trie[state].child(c);
+      if (child != kNone) {
+        dense_[state * row + c] = target(child);
+      } else {
+        // The root stays put; others do what their failure state does, which
+        // is shallower and so already filled in.
+        dense_[state * row + c] =
+            state == 0 ? 0 : dense_[failure_[state] * row + c];
+      }
+    }
+  }
+
+  // Trie edges for the rest.
+  edges_begin_.assign(n + 1, 0);
+  for (std::uint32_t state = 0; state < n; state++) {
+    edges_begin_[state + 1] = edge_classes_.size();
+    if (state < dense_states_) continue;
+    for (auto [c, child] : trie[state].children) {
+      edge_classes_.push_back(c);
+      edge_targets_.push_back(target(child));
+    }
+    edges_begin_[state + 1] = edge_classes_.size();
+  }
+}
+
+std::uint32_t KeywordMatcher::NextSparse(std::uint32_t state,
+                                         std::uint16_t c) const {
+  while (state >= dense_states_) {
+    for (std::uint32_t e = edges_begin_[state]; e < edges_begin_[state + 1];
+         e++) {
+      if (edge_classes_[e] == c) return edge_targets_[e];
+    }
+    state = failure_[state];
+  }
+  return dense_[(state << row_shift_) + c];
+}
+
+std::vector<KeywordMatcher::Match> KeywordMatcher::find_all(
+    StringView text) const {
+  std::vector<Match> matches;
+  for_each_match(text, [&](Match match) { matches.push_back(match); });
+  return matches;
+}
+
+KeywordMatcher::Match KeywordMatcher::find_first(StringView text) const {
+  const unsigned char* chars =
+      reinterpret_cast<const unsigned char*>(text.data());
+  std::uint32_t state = 0;
+  for (Size i = 0; i < text.length(); i++) {
+    std::uint16_t c = class_of_[chars[i]];
+    state = state < dense_states_ ? dense_[(state << row_shift_) + c]
+                                  : NextSparse(state, c);
+    if (state & kHasMatches) {
+      state &= ~kHasMatches;
+      // The state's own patterns are the longest which end here.
+      std::uint32_t s =
+          first_pattern_[state] != kNone ? state : output_link_[state];
+      Size p = first_pattern_[s];
+      return Match{p, i + 1 - pattern_lengths_[p]};
+    }
+  }
+  return Match{kNotFound, kNotFound};
+}
+
+Size KeywordMatcher::patterns() const { return pattern_lengths_.size(); }
+
+Size KeywordMatcher::states() const { return failure_.size(); }
+
+Size KeywordMatcher::bytes_used() const {
+  return sizeof(class_of_) + dense_.size() * sizeof(dense_[0]) +
+         edges_begin_.size() * sizeof(edges_begin_[0]) +
+         edge_classes_.size() * sizeof(edge_classes_[0]) +
+         edge_targets_.size() * sizeof(edge_targets_[0]) +
+         failure_.size() * sizeof(failure_[0]) +
+         first_pattern_.size() * sizeof(first_pattern_[0]) +
+         next_pattern_.size() * sizeof(next_pattern_[0]) +
+         output_link_.size() * sizeof(output_link_[0]) +
+         pattern_lengths_.size() * sizeof(pattern_lengths_[0]);
+}
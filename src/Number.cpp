@@ -0,0 +1,43 @@
+#include <charconv>
+#include <system_error>
+#include "../include/Number.h"
+
+using Size = String::Size;
+
+namespace {
+
+template <typename Number> Size Write(char* out, Number value) {
+  return std::to_chars(out, out + kMaxNumberLength, value).ptr - out;
+}
+
+template <typename Number> std::optional<Number> Parse(StringView text) {
+  const char* end = text.data() + text.length();
+  Number value;
+  auto [stop, error] = std::from_chars(text.data(), end, value);
+  if (error != std::errc{} || stop != end) return std::nullopt;
+  return value;
+}
+
+}  // namespace
+
+Size write_number(char* out, long long value) { return Write(out, value); }
+
+Size write_number(char* out, unsigned long long value) {
+  return Write(out, value);
+}
+
+Size write_number(char* out, float value) { return Write(out, value); }
+
+Size write_number(char* out, double value) { return Write(out, value); }
+
+std::optional<long long> parse_int(StringView text) {
+  return Parse<long long>(text);
+}
+
+std::optional<unsigned long long> parse_uint(StringView text) {
+  return Parse<unsigned long long>(text);
+}
+
+std::optional<double> parse_double(StringView text) {
+  return Parse<double>(text);
+}
@@ -0,0 +1,98 @@
+#include <cerrno>
+#include <system_error>
+#include <utility>
+#include <poll.h>
+#include "../include/Output.h"
+#include "../include/Simd.h"
+
+using Size = OutputBatch::Size;
+
+OutputBatch::OutputBatch(int fd) : fd_(fd) {}
+
+OutputBatch::~OutputBatch() {
+  try {
+    flush();
+  } catch (const std::system_error&) {
+  }
+}
+
+OutputBatch& OutputBatch::add(String&& s) {
+  if (s.length() < kCopyBelow) return copy(s);
+  if (pieces_.size() == kMaxPieces) flush();
+  strings_.push_back(std::move(s));
+  // The const data(), so that a shared string or literal isn't copied.
+  const String& kept = strings_.back();
+  pieces_.push_back(iovec{const_cast<char*>(kept.data()), kept.length()});
+  length_ += kept.length();
+  return *this;
+}
+
+OutputBatch& OutputBatch::add(StringView v) {
+  if (v.length() < kCopyBelow) return copy(v);
+  if (pieces_.size() == kMaxPieces) flush();
+  pieces_.push_back(iovec{const_cast<char*>(v.data()), v.length()});
+  length_ += v.length();
+  return *this;
+}
+
+OutputBatch& OutputBatch::copy(StringView v) {
+  if (v.length() == 0) return *this;
+  if (v.length() > kBufferSize) return add(String{v});
+  if (buffer_used_ + v.length() > kBufferSize) flush();
+  if (buffer_ == nullptr) buffer_.reset(new char[kBufferSize]);
+  char* out = buffer_.get() + buffer_used_;
+  // A run of short pieces is written as one, by growing the last piece.
+  bool follows_last =
+      !pieces_.empty() &&
+      static_cast<char*>(pieces_.back().iov_base) + pieces_.back().iov_len ==
+          out;
+  if (!follows_last && pieces_.size() == kMaxPieces) {
+    flush();
+    out = buffer_.get();
+  }
+  simd::copy(out, v.data(), v.length());
+  buffer_used_ += v.length();
+  length_ += v.length();
+  if (follows_last) {
+    pieces_.back().iov_len += v.length();
+  } else {
+    pieces_.push_back(iovec{out, v.length()});
+  }
+  return *this;
+}
+
+Size OutputBatch::pieces() const { return pieces_.size() - written_; }
+
+Size OutputBatch::length() const { return length_; }
+
+void OutputBatch::flush() {
+  while (written_ < pieces_.size()) {
+    ssize_t count = writev(fd_, pieces_.data() + written_,
+                           static_cast<int>(pieces_.size() - written_));
+    if (count == -1) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        pollfd ready{fd_, POLLOUT, 0};
+        if (poll(&ready, 1, -1) != -1 || errno == EINTR) continue;
+      }
+      throw std::system_error(errno, std::generic_category(), "writev");
+    }
+    length_ -= count;
+    // Step over the pieces written in full, then past the written part of
+    // the one the write stopped in, if any.
+    Size done = count;
+    while (written_ < pieces_.size() && done >= pieces_[written_].iov_len) {
+      done -= pieces_[written_].iov_len;
+      written_++;
+    }
+    if (done > 0) {
+      iovec& partial = pieces_[written_];
+      partial.iov_base = static_cast<char*>(partial.iov_base) + done;
+      partial.iov_len -= done;
+    }
+  }
+  pieces_.clear();
+  strings_.clear();
+  buffer_used_ = 0;
+  written_ = 0;
+}
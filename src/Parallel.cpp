@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../include/Parallel.h"
+#include "../include/Search.h"
+#include "../include/Simd.h"
+
+namespace parallel {
+
+namespace {
+
+// Calls f(begin, end) for each chunk of [0, size), on all of the pool's
+// threads, or once for the whole range on this thread if size is below the
+// pool's threshold.
+template <typename F>
+void ForEachChunk(ThreadPool& pool, Size size, const F& f) {
+  if (size < pool.threshold() || size <= pool.chunk_size()) {
+    f(Size{0}, size);
+    return;
+  }
+  Size chunk = pool.chunk_size();
+  pool.run((size + chunk - 1) / chunk, [&](Size i) {
+    Size begin = i * chunk;
+    f(begin, std::min(begin + chunk, size));
+  });
+}
+
+// Returns true if some proper prefix of needle is also a suffix of it, which
+// is exactly when two matches of it can overlap.
+bool HasBorder(StringView needle) {
+  // The Knuth-Morris-Pratt failure function: border[i] is the length of the
+  // longest border of the first i + 1 chars.
+  const char* chars = needle.data();
+  std::vector<Size> border(needle.length(), 0);
+  for (Size i = 1, k = 0; i < needle.length(); i++) {
+    while (k > 0 && chars[i] != chars[k]) k = border[k - 1];
+    if (chars[i] == chars[k]) k++;
+    border[i] = k;
+  }
+  return border.back() != 0;
+}
+
+// Finds the first chunk match of [begin, end) for which search returns a
+// position other than kNotFound. Chunks past one with a match are skipped.
+template <typename Search>
+Size FindFirst(ThreadPool& pool, Size size, const Search& search) {
+  std::atomic<Size> first{kNotFound};
+  ForEachChunk(pool, size, [&](Size begin, Size end) {
+    if (begin > first.load(std::memory_order_relaxed)) return;
+    Size found = search(begin, end);
+    if (found == kNotFound) return;
+    Size seen = first.load(std::memory_order_relaxed);
+    while (found < seen &&
+           !first.compare_exchange_weak(seen, found,
+                                        std::memory_order_relaxed)) {
+    }
+  });
+  return first.load(std::memory_order_relaxed);
+}
+
+// The pools whose tasks this thread is running, innermost first, so that a
+// task which calls run() on one of them again can be run inline rather than
+// waiting for the batch it is part of.
+struct Running {
+  const ThreadPool* pool;
+  const Running* outer;
+};
+thread_local const Running* running = nullptr;
+
+bool IsRunning(const ThreadPool* pool) {
+  for (const Running* r = running; r != nullptr; r = r->outer) {
+    if (r->pool == pool) return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+ThreadPool::ThreadPool(unsigned threads, Size threshold, Size chunk_size)
+    : threshold_(threshold), chunk_size_(chunk_size > 0 ? chunk_size : 1) {
+  for (unsigned i = 1; i < threads; i++) workers_.emplace_back([this] {
+    work();
+  });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> run_lock{run_mutex_};
+    std::lock_guard<std::mutex> lock{mutex_};
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& worker : workers_) worker.join();
+}
+
+ThreadPool& ThreadPool::shared() {
+  // Never destroyed, so that it can be used while other statics are being
+  // destroyed.
+  static ThreadPool* pool =
+      new ThreadPool{std::max(1u, std::thread::hardware_concurrency())};
+  return *pool;
+}
+
+unsigned ThreadPool::threads() const { return workers_.size() + 1; }
+
+Size ThreadPool::threshold() const {
+  return threshold_.load(std::memory_order_relaxed);
+}
+
+void ThreadPool::set_threshold(Size threshold) {
+  threshold_.store(threshold, std::memory_order_relaxed);
+}
+
+Size ThreadPool::chunk_size() const { return chunk_size_; }
+
+void ThreadPool::run(Size count, const std::function<void(Size)>& task) {
+  if (workers_.empty() || count <= 1 || IsRunning(this)) {
+    for (Size i = 0; i < count; i++) task(i);
+    return;
+  }
+  std::lock_guard<std::mutex> run_lock{run_mutex_};
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    task_ = &task;
+    count_ = count;
+    next_.store(0, std::memory_order_relaxed);
+    batch_++;
+  }
+  wake_.notify_all();
+  work_on(task, count);
+  // Every task has been taken, but workers may still be running some. A
+  // worker which wakes up after this sees no batch and goes back to sleep.
+  std::unique_lock<std::mutex> lock{mutex_};
+  done_.wait(lock, [this] { return active_ == 0; });
+  task_ = nullptr;
+}
+
+void ThreadPool::work_on(const std::function<void(Size)>& task, Size count) {
+  Running frame{this, running};
+  running = &frame;
+  for (Size i = next_.fetch_add(1, std::memory_order_relaxed); i < count;
+       i = next_.fetch_add(1, std::memory_order_relaxed)) {
+    task(i);
+  }
+  running = frame.outer;
+}
+
+void ThreadPool::work() {
+  Size seen = 0;
+  std::unique_lock<std::mutex> lock{mutex_};
+  while (true) {
+    wake_.wait(lock, [&] {
+      return stopping_ || (task_ != nullptr && batch_ != seen);
+    });
+    if (stopping_) return;
+    seen = batch_;
+    const std::function<void(Size)>& task = *task_;
+    Size count = count_;
+    active_++;
+    lock.unlock();
+    work_on(task, count);
+    lock.lock();
+    if (--active_ == 0) done_.notify_all();
+  }
+}
+
+String fill(char c, Size size, ThreadPool& pool) {
+  String result = String::uninitialized(size);
+  char* out = result.data();
+  ForEachChunk(pool, size, [&](Size begin, Size end) {
+    simd::fill(out + begin, c, end - begin);
+  });
+  return result;
+}
+
+String copy(StringView v, ThreadPool& pool) {
+  String result = String::uninitialized(v.length());
+  char* out = result.data();
+  ForEachChunk(pool, v.length(), [&](Size begin, Size end) {
+    simd::copy(out + begin, v.data() + begin, end - begin);
+  });
+  return result;
+}
+
+String concat(StringView a, StringView b, ThreadPool& pool) {
+  String result = String::uninitialized(a.length() + b.length());
+  char* out = result.data();
+  // Chunks are of the result, so one chunk may take chars from both.
+  ForEachChunk(pool, result.length(), [&](Size begin, Size end) {
+    if (begin < a.length()) {
+      Size from_a = std::min(end, a.length()) - begin;
+      simd::copy(out + begin, a.data() + begin, from_a);
+      begin += from_a;
+    }
+    if (begin < end) {
+      simd::copy(out + begin, b.data() + (begin - a.length()), end - begin);
+    }
+  });
+  return result;
+}
+
+Size find(StringView haystack, char c, ThreadPool& pool) {
+  return FindFirst(pool, haystack.length(), [&](Size begin, Size end) {
+    Size found = simd::find_byte(haystack.data() + begin, end - begin, c);
+    return found == end - begin ? kNotFound : begin + found;
+  });
+}
+
+Size find(StringView haystack, StringView needle, ThreadPool& pool) {
+  if (needle.length() == 0 || needle.length() > haystack.length()) {
+    return ::find(haystack, needle);
+  }
+  // Each chunk looks for matches which start in it, so it reads up to
+  // needle.length() - 1 chars into the next one.
+  Size starts = haystack.length() - needle.length() + 1;
+  return FindFirst(pool, starts, [&](Size begin, Size end) {
+    StringView window{haystack.data() + begin,
+                      end - begin + needle.length() - 1};
+    Size found = ::find(window, needle);
+    return found == kNotFound ? kNotFound : begin + found;
+  });
+}
+
+Size count(StringView haystack, char c, ThreadPool& pool) {
+  std::atomic<Size> total{0};
+  ForEachChunk(pool, haystack.length(), [&](Size begin, Size end) {
+    total.fetch_add(
+        simd::count_byte(haystack.data() + begin, end - begin, c),
+        std::memory_order_relaxed);
+  });
+  return total.load(std::memory_order_relaxed);
+}
+
+Size count(StringView haystack, StringView needle, ThreadPool& pool) {
+  // count() doesn't count overlapping matches, so whether a match counts
+  // depends on every match before it, unless matches can't overlap at all.
+  if (needle.length() == 0 || needle.length() > haystack.length() ||
+      haystack.length() < pool.threshold() || HasBorder(needle)) {
+    return ::count(haystack, needle);
+  }
+  std::atomic<Size> total{0};
+  Size starts = haystack.length() - needle.length() + 1;
+  ForEachChunk(pool, starts, [&](Size begin, Size end) {
+    StringView window{haystack.data() + begin,
+                      end - begin + needle.length() - 1};
+    total.fetch_add(::count(window, needle), std::memory_order_relaxed);
+  });
+  return total.load(std::memory_order_relaxed);
+}
+
+String to_lower(StringView v, ThreadPool& pool) {
+  String result = String::uninitialized(v.length());
+  char* out = result.data();
+  ForEachChunk(pool, v.length(), [&](Size begin, Size end) {
+    simd::to_lower(out + begin, v.data() + begin, end - begin);
+  });
+  return result;
+}
+
+String to_upper(StringView v, ThreadPool& pool) {
+  String result = String::uninitialized(v.length());
+  char* out = result.data();
+  ForEachChunk(pool, v.length(), [&](Size begin, Size end) {
+    simd::to_upper(out + begin, v.data() + begin, end - begin);
+  });
+  return result;
+}
+
+void to_lower_in_place(String& s, ThreadPool& pool) {
+  char* data = s.data();
+  ForEachChunk(pool, s.length(), [&](Size begin, Size end) {
+    simd::to_lower(data + begin, data + begin, end - begin);
+  });
+}
+
+void to_upper_in_place(String& s, ThreadPool& pool) {
+  char* data = s.data();
+  ForEachChunk(pool, s.length(), [&](Size begin, Size end) {
+    simd::to_upper(data + begin, data + begin, end - begin);
+  });
+}
+
+String replace(StringView v, char from, char to, ThreadPool& pool) {
+  String result = String::uninitialized(v.length());
+  char* out = result.data();
+  ForEachChunk(pool, v.length(), [&](Size begin, Size end) {
+    simd::replace_byte(out + begin, v.data() + begin, end - begin, from, to);
+  });
+  return result;
+}
+
+void replace_in_place(String& s, char from, char to, ThreadPool& pool) {
+  char* data = s.data();
+  ForEachChunk(pool, s.length(), [&](Size begin, Size end) {
+    simd::replace_byte(data + begin, data + begin, end - begin, from, to);
+  });
+}
+
+}  // namespace parallel
@@ -0,0 +1,178 @@
+#include <atomic>
+#include <mutex>
+#include "../include/Profile.h"
+
+namespace profile {
+
+const char* name(Operation operation) {
+  switch (operation) {
+    case Operation::kFill: return "fill";
+    case Operation::kCString: return "c_string";
+    case Operation::kBuffer: return "buffer";
+    case Operation::kCopy: return "copy";
+    case Operation::kCopyAssign: return "copy_assign";
+    case Operation::kConcat: return "concat";
+    case Operation::kSubstring: return "substring";
+    case Operation::kShare: return "share";
+    case Operation::kUnshare: return "unshare";
+    case Operation::kAppend: return "append";
+    case Operation::kOther: return "other";
+    case Operation::kCount: break;
+  }
+  return "unknown";
+}
+
+int bucket(Size bytes) {
+  return bytes == 0 ? 0 : 63 - __builtin_clzll(bytes);
+}
+
+Snapshot difference(const Snapshot& later, const Snapshot& earlier) {
+  Snapshot result;
+  result.allocations = later.allocations - earlier.allocations;
+  result.deallocations = later.deallocations - earlier.deallocations;
+  result.total_bytes = later.total_bytes - earlier.total_bytes;
+  result.live_bytes = later.live_bytes;
+  for (int i = 0; i < kHistogramBuckets; i++) {
+    result.histogram[i] = later.histogram[i] - earlier.histogram[i];
+  }
+  for (int i = 0; i < static_cast<int>(Operation::kCount); i++) {
+    result.operations[i].allocations =
+        later.operations[i].allocations - earlier.operations[i].allocations;
+    result.operations[i].bytes =
+        later.operations[i].bytes - earlier.operations[i].bytes;
+  }
+  return result;
+}
+
+#ifdef STRING_PROFILING
+
+namespace {
+
+using Counter = std::atomic<Size>;
+
+// Each counter is only ever written by the thread it belongs to, so it can be
+// bumped with a plain load and store instead of an atomic read-modify-write.
+// The atomics are only there so that snapshot() can read them from another
+// thread without a data race.
+void Bump(Counter& counter, Size amount) {
+  counter.store(counter.load(std::memory_order_relaxed) + amount,
+                std::memory_order_relaxed);
+}
+
+struct Counters {
+  Counter allocations{0};
+  Counter deallocations{0};
+  Counter allocated_bytes{0};
+  Counter freed_bytes{0};
+  Counter histogram[kHistogramBuckets] = {};
+  Counter operation_allocations[static_cast<int>(Operation::kCount)] = {};
+  Counter operation_bytes[static_cast<int>(Operation::kCount)] = {};
+
+  // Adds these counts to a snapshot. Bytes freed on one thread may have been
+  // allocated on another, so live bytes are only meaningful in total.
+  void AddTo(Snapshot& snapshot) const {
+    auto read = [](const Counter& counter) {
+      return counter.load(std::memory_order_relaxed);
+    };
+    snapshot.allocations += read(allocations);
+    snapshot.deallocations += read(deallocations);
+    snapshot.total_bytes += read(allocated_bytes);
+    snapshot.live_bytes += read(allocated_bytes) - read(freed_bytes);
+    for (int i = 0; i < kHistogramBuckets; i++) {
+      snapshot.histogram[i] += read(histogram[i]);
+    }
+    for (int i = 0; i < static_cast<int>(Operation::kCount); i++) {
+      snapshot.operations[i].allocations += read(operation_allocations[i]);
+      snapshot.operations[i].bytes += read(operation_bytes[i]);
+    }
+  }
+};
+
+// Every thread's counters are kept in a list so that snapshot() can find them.
+// When a thread exits, its counts are folded into `retired`. The counters
+// themselves are trivially destructible, so strings destroyed after that (for
+// example, during static destruction) can still safely count themselves.
+struct Registration;
+std::mutex registry_mutex;
+Registration* registry = nullptr;
+Snapshot retired;
+
+thread_local Counters counters;
+thread_local bool registered = false;
+thread_local Operation scope_operation = Operation::kOther;
+thread_local bool in_scope = false;
+
+struct Registration {
+  Registration() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    next = registry;
+    registry = this;
+  }
+
+  ~Registration() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    counts->AddTo(retired);
+    Registration** link = &registry;
+    while (*link != this) link = &(*link)->next;
+    *link = next;
+  }
+
+  Counters* counts = &counters;
+  Registration* next;
+};
+
+Counters& Local() {
+  if (!registered) {
+    registered = true;
+    static thread_local Registration registration;
+  }
+  return counters;
+}
+
+}  // namespace
+
+Snapshot snapshot() {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  Snapshot result = retired;
+  for (Registration* r = registry; r != nullptr; r = r->next) {
+    r->counts->AddTo(result);
+  }
+  return result;
+}
+
+Scope::Scope(Operation operation)
+    : previous_(scope_operation), had_previous_(in_scope) {
+  scope_operation = operation;
+  in_scope = true;
+}
+
+Scope::~Scope() {
+  scope_operation = previous_;
+  in_scope = had_previous_;
+}
+
+void record_allocation(Operation operation, Size bytes) {
+  if (in_scope) operation = scope_operation;
+  Counters& local = Local();
+  Bump(local.allocations, 1);
+  Bump(local.allocated_bytes, bytes);
+  Bump(local.histogram[bucket(bytes)], 1);
+  Bump(local.operation_allocations[static_cast<int>(operation)], 1);
+  Bump(local.operation_bytes[static_cast<int>(operation)], bytes);
+}
+
+void record_deallocation(Size bytes) {
+  Counters& local = Local();
+  Bump(local.deallocations, 1);
+  Bump(local.freed_bytes, bytes);
+}
+
+#else
+
+Snapshot snapshot() {
+  return Snapshot();
+}
+
+#endif
+
+}  // namespace profile
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include "../include/Search.h"
+#include "../include/Simd.h"
+
+using Size = StringView::Size;
+
+namespace {
+
+// Needles up to this long are found with simd::find_pair, which compares at
+// most this many chars per candidate position and so is still linear in the
+// length of the haystack. Longer needles use TwoWay.
+constexpr Size kMaxPairNeedle = 32;
+
+// Reads a run of chars from the front or, with kReversed, from the back. This
+// lets the same two-way code search forwards for find() and backwards for
+// rfind(): a backwards search for a needle is a forwards search for the
+// reversed needle in the reversed haystack.
+template <bool kReversed>
+class Chars {
+ public:
+  explicit Chars(StringView v)
+      : data_(reinterpret_cast<const unsigned char*>(v.data())),
+        length_(v.length()) {}
+
+  unsigned char operator[](Size i) const {
+    return kReversed ? data_[length_ - 1 - i] : data_[i];
+  }
+
+  Size length() const { return length_; }
+
+ private:
+  const unsigned char* data_;
+  Size length_;
+};
+
+// The Crochemore-Perrin two-way string matching algorithm, with a Horspool
+// style shift on the last char of the window to skip quickly over text which
+// can't match. Preprocessing the needle takes O(needle length) time and
+// matching takes O(haystack length), with constant extra space.
+template <bool kReversed>
+class TwoWay {
+ public:
+  explicit TwoWay(StringView needle) : needle_(needle) {
+    Size length = needle_.length();
+    for (Size& shift : shift_) shift = length;
+    for (Size i = 0; i + 1 < length; i++) shift_[needle_[i]] = length - 1 - i;
+    shift_[needle_[length - 1]] = 0;
+    suffix_ = CriticalFactorization(&period_);
+    periodic_ = true;
+    for (Size i = 0; i < suffix_ && periodic_; i++) {
+      periodic_ = needle_[i] == needle_[i + period_];
+    }
+    if (!periodic_) period_ = std::max(suffix_, length - suffix_) + 1;
+  }
+
+  // Returns the position of the first match at or after start in the
+  // (possibly reversed) haystack, or kNotFound.
+  Size find(Chars<kReversed> haystack, Size start) const {
+    const Size length = needle_.length();
+    Size memory = 0;
+    for (Size j = start; haystack.length() - j >= length;) {
+      Size shift = shift_[haystack[j + length - 1]];
+      if (shift != 0) {
+        // After a partial match of a periodic needle, a shift shorter than the
+        // period can't reach a match either.
+        if (memory != 0 && shift < period_) shift = length - period_;
+        memory = 0;
+        j += shift;
+        continue;
+      }
+      // The last char already matches. Check the right half of the needle...
+      Size i = std::max(suffix_, memory);
+      while (i + 1 < length && needle_[i] == haystack[i + j]) i++;
+      if (i + 1 < length) {
+        j += i - suffix_ + 1;
+        memory = 0;
+        continue;
+      }
+      // ...then the left half, skipping whatever the previous window matched.
+      i = suffix_;
+      while (i > memory && needle_[i - 1] == haystack[i - 1 + j]) i--;
+      if (i <= memory) return j;
+      j += period_;
+      if (periodic_) memory = length - period_;
+    }
+    return kNotFound;
+  }
+
+ private:
+  // Splits the needle into u v such that the local period at the split is the
+  // global period, by taking the later of the maximal suffixes under the
+  // normal and the reversed char order. Returns the length of u and sets
+  // *period to the period of v.
+  Size CriticalFactorization(Size* period) const {
+    Size forward_period, reverse_period;
+    Size forward = MaximalSuffix(false, &forward_period);
+    Size reverse = MaximalSuffix(true, &reverse_period);
+    if (forward > reverse) {
+      *period = forward_period;
+      return forward;
+    }
+    *period = reverse_period;
+    return reverse;
+  }
+
+  // Returns the start of the lexicographically maximal suffix of the needle,
+  // with chars compared in reverse order if inverted, and sets *period to its
+  // period.
+  Size MaximalSuffix(bool inverted, Size* period) const {
+    const Size length = needle_.length();
+    // The suffix starts at start + 1; start wraps around to begin with.
+    Size start = ~Size{0}, j = 0, k = 1, p = 1;
+    while (j + k < length) {
+      unsigned char a = needle_[j + k], b = needle_[start + k];
+      if (inverted ? b < a : a < b) {
+        j += k;
+        k = 1;
+        p = j - start;
+      } else if (a == b) {
+        if (k != p) {
+          k++;
+        } else {
+          j += p;
+          k = 1;
+        }
+      } else {
+        start = j++;
+        k = p = 1;
+      }
+    }
+    *period = p;
+    return start + 1;
+  }
+
+  Chars<kReversed> needle_;
+  Size shift_[256];
+  Size suffix_;
+  Size period_;
+  bool periodic_;
+};
+
+}  // namespace
+
+Size find(StringView haystack, char c, Size start) {
+  if (start >= haystack.length()) return kNotFound;
+  Size rest = haystack.length() - start;
+  Size i = simd::find_byte(haystack.data() + start, rest, c);
+  return i == rest ? kNotFound : start + i;
+}
+
+Size find(StringView haystack, StringView needle, Size start) {
+  if (start > haystack.length()) return kNotFound;
+  Size rest = haystack.length() - start;
+  if (needle.length() > rest) return kNotFound;
+  if (needle.length() == 0) return start;
+  if (needle.length() == 1) return find(haystack, needle.data()[0], start);
+  if (needle.length() <= kMaxPairNeedle) {
+    Size i = simd::find_pair(haystack.data() + start, rest, needle.data(),
+                             needle.length());
+    return i == rest ? kNotFound : start + i;
+  }
+  return TwoWay<false>(needle).find(Chars<false>(haystack), start);
+}
+
+Size rfind(StringView haystack, char c) {
+  Size i = simd::rfind_byte(haystack.data(), haystack.length(), c);
+  return i == haystack.length() ? kNotFound : i;
+}
+
+Size rfind(StringView haystack, StringView needle) {
+  if (needle.length() > haystack.length()) return kNotFound;
+  if (needle.length() == 0) return haystack.length();
+  if (needle.length() == 1) return rfind(haystack, needle.data()[0]);
+  if (needle.length() <= kMaxPairNeedle) {
+    Size i = simd::rfind_pair(haystack.data(), haystack.length(),
+                              needle.data(), needle.length());
+    return i == haystack.length() ? kNotFound : i;
+  }
+  Size i = TwoWay<true>(needle).find(Chars<true>(haystack), 0);
+  if (i == kNotFound) return kNotFound;
+  return haystack.length() - i - needle.length();
+}
+
+bool contains(StringView haystack, char c) {
+  return find(haystack, c) != kNotFound;
+}
+
+bool contains(StringView haystack, StringView needle) {
+  return find(haystack, needle) != kNotFound;
+}
+
+Size count(StringView haystack, char c) {
+  return simd::count_byte(haystack.data(), haystack.length(), c);
+}
+
+Size count(StringView haystack, StringView needle) {
+  if (needle.length() == 0) return haystack.length() + 1;
+  if (needle.length() == 1) return count(haystack, needle.data()[0]);
+  Size result = 0;
+  if (needle.length() <= kMaxPairNeedle) {
+    for (Size i = find(haystack, needle); i != kNotFound;
+         i = find(haystack, needle, i + needle.length())) {
+      result++;
+    }
+    return result;
+  }
+  // Build the two-way tables once rather than once per match.
+  TwoWay<false> searcher(needle);
+  Chars<false> chars(haystack);
+  for (Size i = searcher.find(chars, 0); i != kNotFound;
+       i = searcher.find(chars, i + needle.length())) {
+    result++;
+  }
+  return result;
+}
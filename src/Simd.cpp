@@ -0,0 +1,995 @@
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include "../include/Simd.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SIMD_X86 1
+#endif
+
+namespace simd {
+namespace {
+
+// Scalar versions. These are the fallback on machines without SSE2 and also
+// handle the short heads and tails the vector versions leave over.
+Size ScalarLength(const char* c_str) {
+  const char* current = c_str;
+  while (*current != '\0') current++;
+  return current - c_str;
+}
+
+void ScalarFill(char* out, char c, Size size) {
+  for (Size i = 0; i < size; i++) out[i] = c;
+}
+
+void ScalarCopy(char* out, const char* in, Size size) {
+  for (Size i = 0; i < size; i++) out[i] = in[i];
+}
+
+
+Size ScalarFindByte(const char* data, Size size, char c) {
+  for (Size i = 0; i < size; i++) {
+    if (data[i] == c) return i;
+  }
+  return size;
+}
+
+Size ScalarRfindByte(const char* data, Size size, char c) {
+  for (Size i = size; i > 0; i--) {
+    if (data[i - 1] == c) return i - 1;
+  }
+  return size;
+}
+
+Size ScalarCountByte(const char* data, Size size, char c) {
+  Size count = 0;
+  for (Size i = 0; i < size; i++) count += data[i] == c;
+  return count;
+}
+
+std::uint64_t ScalarMatchMask(const char* data, Size size, char c) {
+  std::uint64_t mask = 0;
+  for (Size i = 0; i < size && i < 64; i++) {
+    mask |= std::uint64_t{data[i] == c} << i;
+  }
+  return mask;
+}
+
+// Returns the length of the valid UTF-8 sequence at the start of the size >= 1
+// chars at data, or 0 if they don't start with one. Overlong encodings,
+// surrogates and code points past U+10FFFF are invalid.
+Size Utf8SequenceLength(const unsigned char* data, Size size) {
+  unsigned char lead = data[0];
+  if (lead < 0x80) return 1;
+  // The range the second byte must be in. Only some leads narrow it.
+  unsigned char low = 0x80, high = 0xBF;
+  Size length;
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    length = 2;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    length = 3;
+    if (lead == 0xE0) low = 0xA0;  // overlong
+    if (lead == 0xED) high = 0x9F;  // surrogates
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    length = 4;
+    if (lead == 0xF0) low = 0x90;  // overlong
+    if (lead == 0xF4) high = 0x8F;  // past U+10FFFF
+  } else {
+    return 0;
+  }
+  if (size < length || data[1] < low || data[1] > high) return 0;
+  for (Size i = 2; i < length; i++) {
+    if ((data[i] & 0xC0) != 0x80) return 0;
+  }
+  return length;
+}
+
+bool ScalarValidUtf8(const char* data, Size size) {
+  auto* bytes = reinterpret_cast<const unsigned char*>(data);
+  for (Size i = 0; i < size;) {
+    Size length = Utf8SequenceLength(bytes + i, size - i);
+    if (length == 0) return false;
+    i += length;
+  }
+  return true;
+}
+
+// Continuation bytes are 0b10xxxxxx, which is -128 to -65 as a signed char, so
+// every other byte starts a code point.
+Size ScalarCountCodePoints(const char* data, Size size) {
+  Size count = 0;
+  for (Size i = 0; i < size; i++) {
+    count += static_cast<signed char>(data[i]) > -65;
+  }
+  return count;
+}
+
+// Checks whether the needle is at data[i], given that its first and last chars
+// are already known to match.
+bool MiddleMatches(const char* data, Size i, const char* needle,
+                   Size needle_length) {
+  return std::memcmp(data + i + 1, needle + 1, needle_length - 2) == 0;
+}
+
+bool PairMatches(const char* data, Size i, const char* needle,
+                 Size needle_length) {
+  return data[i] == needle[0] &&
+         data[i + needle_length - 1] == needle[needle_length - 1] &&
+         MiddleMatches(data, i, needle, needle_length);
+}
+
+// The vector versions hand positions [begin, end) that didn't fill a whole
+// vector over to these.
+Size ScalarFindPairFrom(const char* data, Size size, Size begin,
+                        const char* needle, Size needle_length) {
+  if (needle_length > size) return size;
+  for (Size i = begin; i <= size - needle_length; i++) {
+    if (PairMatches(data, i, needle, needle_length)) return i;
+  }
+  return size;
+}
+
+Size ScalarRfindPairBefore(const char* data, Size size, Size end,
+                           const char* needle, Size needle_length) {
+  for (Size i = end; i > 0; i--) {
+    if (PairMatches(data, i - 1, needle, needle_length)) return i - 1;
+  }
+  return size;
+}
+
+Size ScalarMismatch(const char* a, const char* b, Size size) {
+  for (Size i = 0; i < size; i++) {
+    if (a[i] != b[i]) return i;
+  }
+  return size;
+}
+
+// Returns c with A-Z, or with kUpper a-z, changed to the other case.
+template <bool kUpper> char ChangeCase(char c) {
+  char first = kUpper ? 'a' : 'A';
+  return c >= first && c <= first + 25 ? c ^ 0x20 : c;
+}
+
+template <bool kUpper> void ScalarChangeCase(char* out, const char* in,
+                                             Size size) {
+  for (Size i = 0; i < size; i++) out[i] = ChangeCase<kUpper>(in[i]);
+}
+
+void ScalarReplaceByte(char* out, const char* in, Size size, char from,
+                       char to) {
+  for (Size i = 0; i < size; i++) out[i] = in[i] == from ? to : in[i];
+}
+
+Size ScalarMismatchIgnoringCase(const char* a, const char* b, Size size) {
+  for (Size i = 0; i < size; i++) {
+    if (ChangeCase<false>(a[i]) != ChangeCase<false>(b[i])) return i;
+  }
+  return size;
+}
+
+Size ScalarFindPair(const char* data, Size size, const char* needle,
+                    Size needle_length) {
+  return ScalarFindPairFrom(data, size, 0, needle, needle_length);
+}
+
+Size ScalarRfindPair(const char* data, Size size, const char* needle,
+                     Size needle_length) {
+  if (needle_length > size) return size;
+  return ScalarRfindPairBefore(data, size, size - needle_length + 1, needle,
+                               needle_length);
+}
+
+#if SIMD_X86
+
+// The length scans start with an aligned load of the block containing c_str,
+// ignoring the bytes before it. An aligned load never crosses a page, so this
+// can't fault even when the nul is the last byte before an unmapped page,
+// which an unaligned load starting at c_str could. The blocks do read bytes
+// before c_str and past the nul, which is safe as they never reach another
+// page, but AddressSanitizer would report it, so it isn't applied to them.
+__attribute__((no_sanitize_address)) Size Sse2Length(const char* c_str) {
+  auto address = reinterpret_cast<std::uintptr_t>(c_str);
+  unsigned skip = address % 16;
+  auto block = reinterpret_cast<const __m128i*>(address - skip);
+  const __m128i zero = _mm_setzero_si128();
+  unsigned mask =
+      _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(block), zero)) >> skip;
+  if (mask != 0) return __builtin_ctz(mask);
+  while (true) {
+    ++block;
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(block), zero));
+    if (mask != 0) {
+      return reinterpret_cast<const char*>(block) - c_str +
+             __builtin_ctz(mask);
+    }
+  }
+}
+
+// The fill and copy kernels store whole vectors and finish with one vector
+// that ends exactly at the end of the buffer, overlapping the previous one,
+// rather than falling back to a scalar tail.
+void Sse2Fill(char* out, char c, Size size) {
+  if (size < 16) return ScalarFill(out, c, size);
+  const __m128i value = _mm_set1_epi8(c);
+  for (Size i = 0; i < size - 16; i += 16) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), value);
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out + size - 16), value);
+}
+
+void Sse2Copy(char* out, const char* in, Size size) {
+  if (size < 16) return ScalarCopy(out, in, size);
+  for (Size i = 0; i < size - 16; i += 16) {
+    __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), value);
+  }
+  __m128i tail =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + size - 16));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out + size - 16), tail);
+}
+
+__m128i Load16(const char* p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+// Returns a bit per byte: set where a and b are equal.
+unsigned EqualMask16(__m128i a, __m128i b) {
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+}
+
+Size Sse2FindByte(const char* data, Size size, char c) {
+  const __m128i value = _mm_set1_epi8(c);
+  Size i = 0;
+  for (; i + 16 <= size; i += 16) {
+    unsigned mask = EqualMask16(Load16(data + i), value);
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+  return i + ScalarFindByte(data + i, size - i, c);
+}
+
+Size Sse2RfindByte(const char* data, Size size, char c) {
+  const __m128i value = _mm_set1_epi8(c);
+  Size end = size;
+  for (; end >= 16; end -= 16) {
+    unsigned mask = EqualMask16(Load16(data + end - 16), value);
+    if (mask != 0) return end - 16 + 31 - __builtin_clz(mask);
+  }
+  Size result = ScalarRfindByte(data, end, c);
+  return result == end ? size : result;
+}
+
+Size Sse2CountByte(const char* data, Size size, char c) {
+  const __m128i value = _mm_set1_epi8(c);
+  Size count = 0, i = 0;
+  for (; i + 16 <= size; i += 16) {
+    count += __builtin_popcount(EqualMask16(Load16(data + i), value));
+  }
+  return count + ScalarCountByte(data + i, size - i, c);
+}
+
+std::uint64_t Sse2MatchMask(const char* data, Size size, char c) {
+  if (size > 64) size = 64;
+  const __m128i value = _mm_set1_epi8(c);
+  std::uint64_t mask = 0;
+  Size i = 0;
+  for (; i + 16 <= size; i += 16) {
+    mask |= std::uint64_t{EqualMask16(Load16(data + i), value)} << i;
+  }
+  // Shifting by 64 is undefined, so a full window has no tail to add.
+  if (i == size) return mask;
+  return mask | ScalarMatchMask(data + i, size - i, c) << i;
+}
+
+// SSE2 has no byte shuffle to classify bytes with, so this only skips runs of
+// ASCII 32 bytes at a time and checks each block with any other bytes in it
+// sequence by sequence.
+bool Sse2ValidUtf8(const char* data, Size size) {
+  auto* bytes = reinterpret_cast<const unsigned char*>(data);
+  Size i = 0;
+  while (i + 32 <= size) {
+    __m128i both = _mm_or_si128(Load16(data + i), Load16(data + i + 16));
+    if (_mm_movemask_epi8(both) == 0) {
+      i += 32;
+      continue;
+    }
+    // The last sequence may run on into the next block.
+    for (Size end = i + 32; i < end;) {
+      Size length = Utf8SequenceLength(bytes + i, size - i);
+      if (length == 0) return false;
+      i += length;
+    }
+  }
+  return ScalarValidUtf8(data + i, size - i);
+}
+
+Size Sse2CountCodePoints(const char* data, Size size) {
+  const __m128i limit = _mm_set1_epi8(-65);
+  Size count = 0, i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m128i first = _mm_cmpgt_epi8(Load16(data + i), limit);
+    __m128i second = _mm_cmpgt_epi8(Load16(data + i + 16), limit);
+    count += __builtin_popcount(_mm_movemask_epi8(first)) +
+             __builtin_popcount(_mm_movemask_epi8(second));
+  }
+  return count + ScalarCountCodePoints(data + i, size - i);
+}
+
+Size Sse2FindPair(const char* data, Size size, const char* needle,
+                  Size needle_length) {
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+  Size i = 0;
+  for (; i + needle_length - 1 + 16 <= size; i += 16) {
+    unsigned mask = EqualMask16(Load16(data + i), first) &
+                    EqualMask16(Load16(data + i + needle_length - 1), last);
+    while (mask != 0) {
+      Size candidate = i + __builtin_ctz(mask);
+      if (MiddleMatches(data, candidate, needle, needle_length)) {
+        return candidate;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return ScalarFindPairFrom(data, size, i, needle, needle_length);
+}
+
+Size Sse2RfindPair(const char* data, Size size, const char* needle,
+                   Size needle_length) {
+  if (needle_length > size) return size;
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+  // Candidate positions are [0, end).
+  Size end = size - needle_length + 1;
+  for (; end >= 16; end -= 16) {
+    Size i = end - 16;
+    unsigned mask = EqualMask16(Load16(data + i), first) &
+                    EqualMask16(Load16(data + i + needle_length - 1), last);
+    while (mask != 0) {
+      int bit = 31 - __builtin_clz(mask);
+      if (MiddleMatches(data, i + bit, needle, needle_length)) return i + bit;
+      mask &= ~(1u << bit);
+    }
+  }
+  return ScalarRfindPairBefore(data, size, end, needle, needle_length);
+}
+
+// Returns the index of the lowest byte which differs between two words, given
+// that they differ. x86 is little-endian, so that is the first such char.
+int FirstDifferentByte(std::uint64_t x, std::uint64_t y) {
+  return __builtin_ctzll(x ^ y) / 8;
+}
+
+// Handles runs too short for a vector with two overlapping loads of eight or
+// four bytes, like the vector versions do with their last vector.
+Size ShortMismatch(const char* a, const char* b, Size size) {
+  std::uint64_t x = 0, y = 0;
+  if (size >= 8) {
+    std::memcpy(&x, a, 8);
+    std::memcpy(&y, b, 8);
+    if (x != y) return FirstDifferentByte(x, y);
+    std::memcpy(&x, a + size - 8, 8);
+    std::memcpy(&y, b + size - 8, 8);
+    return x != y ? size - 8 + FirstDifferentByte(x, y) : size;
+  }
+  if (size >= 4) {
+    std::memcpy(&x, a, 4);
+    std::memcpy(&y, b, 4);
+    if (x != y) return FirstDifferentByte(x, y);
+    std::memcpy(&x, a + size - 4, 4);
+    std::memcpy(&y, b + size - 4, 4);
+    return x != y ? size - 4 + FirstDifferentByte(x, y) : size;
+  }
+  return ScalarMismatch(a, b, size);
+}
+
+// The mismatch kernels finish with one vector that ends exactly at the end of
+// the buffers. Its overlap with the previous vector is known to match, so the
+// first difference it finds is the first difference overall.
+Size Sse2Mismatch(const char* a, const char* b, Size size) {
+  if (size < 16) return ShortMismatch(a, b, size);
+  for (Size i = 0; i < size - 16; i += 16) {
+    unsigned mask = EqualMask16(Load16(a + i), Load16(b + i)) ^ 0xffff;
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+  Size tail = size - 16;
+  unsigned mask = EqualMask16(Load16(a + tail), Load16(b + tail)) ^ 0xffff;
+  return mask != 0 ? tail + __builtin_ctz(mask) : size;
+}
+
+// The case and replace kernels may be given the same buffer for in and out,
+// so each vector is loaded before it is stored and the tail is left to the
+// scalar version rather than overlapping the last vector.
+
+// Returns v with A-Z, or with kUpper a-z, changed to the other case. The
+// letters are shifted down to the bottom of the signed range, so that one
+// signed comparison finds them.
+template <bool kUpper> __m128i Sse2ChangeCase(__m128i v) {
+  const char first = kUpper ? 'a' : 'A';
+  __m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8(first - 128));
+  __m128i letters = _mm_cmplt_epi8(shifted, _mm_set1_epi8(-128 + 26));
+  return _mm_xor_si128(v, _mm_and_si128(letters, _mm_set1_epi8(0x20)));
+}
+
+template <bool kUpper> void Sse2ChangeCase(char* out, const char* in,
+                                           Size size) {
+  Size i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i changed = Sse2ChangeCase<kUpper>(Load16(in + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), changed);
+  }
+  ScalarChangeCase<kUpper>(out + i, in + i, size - i);
+}
+
+void Sse2ReplaceByte(char* out, const char* in, Size size, char from,
+                     char to) {
+  const __m128i match = _mm_set1_epi8(from), replacement = _mm_set1_epi8(to);
+  Size i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i v = Load16(in + i);
+    __m128i found = _mm_cmpeq_epi8(v, match);
+    __m128i replaced = _mm_or_si128(_mm_and_si128(found, replacement),
+                                    _mm_andnot_si128(found, v));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), replaced);
+  }
+  ScalarReplaceByte(out + i, in + i, size - i, from, to);
+}
+
+Size Sse2MismatchIgnoringCase(const char* a, const char* b, Size size) {
+  Size i = 0;
+  for (; i + 16 <= size; i += 16) {
+    unsigned mask = EqualMask16(Sse2ChangeCase<false>(Load16(a + i)),
+                                Sse2ChangeCase<false>(Load16(b + i)));
+    if (mask != 0xffff) return i + __builtin_ctz(mask ^ 0xffff);
+  }
+  return i + ScalarMismatchIgnoringCase(a + i, b + i, size - i);
+}
+
+// Reads whole aligned blocks, like Sse2Length().
+__attribute__((target("avx2"), no_sanitize_address)) Size Avx2Length(
+    const char* c_str) {
+  auto address = reinterpret_cast<std::uintptr_t>(c_str);
+  unsigned skip = address % 32;
+  auto block = reinterpret_cast<const __m256i*>(address - skip);
+  const __m256i zero = _mm256_setzero_si256();
+  unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+                      _mm256_cmpeq_epi8(_mm256_load_si256(block), zero))) >>
+                  skip;
+  if (mask != 0) return __builtin_ctz(mask);
+  while (true) {
+    ++block;
+    mask = _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_load_si256(block), zero));
+    if (mask != 0) {
+      return reinterpret_cast<const char*>(block) - c_str +
+             __builtin_ctz(mask);
+    }
+  }
+}
+
+__attribute__((target("avx2"))) void Avx2Fill(char* out, char c, Size size) {
+  if (size < 32) return Sse2Fill(out, c, size);
+  const __m256i value = _mm256_set1_epi8(c);
+  for (Size i = 0; i < size - 32; i += 32) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), value);
+  }
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + size - 32), value);
+}
+
+__attribute__((target("avx2"))) void Avx2Copy(char* out, const char* in,
+                                              Size size) {
+  if (size < 32) return Sse2Copy(out, in, size);
+  for (Size i = 0; i < size - 32; i += 32) {
+    __m256i value =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), value);
+  }
+  __m256i tail =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + size - 32));
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + size - 32), tail);
+}
+
+__attribute__((target("avx2"))) __m256i Load32(const char* p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+__attribute__((target("avx2"))) unsigned EqualMask32(__m256i a, __m256i b) {
+  return _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+}
+
+__attribute__((target("avx2"))) Size Avx2FindByte(const char* data, Size size,
+                                                  char c) {
+  const __m256i value = _mm256_set1_epi8(c);
+  Size i = 0;
+  for (; i + 32 <= size; i += 32) {
+    unsigned mask = EqualMask32(Load32(data + i), value);
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+  return i + Sse2FindByte(data + i, size - i, c);
+}
+
+__attribute__((target("avx2"))) Size Avx2RfindByte(const char* data,
+                                                   Size size, char c) {
+  const __m256i value = _mm256_set1_epi8(c);
+  Size end = size;
+  for (; end >= 32; end -= 32) {
+    unsigned mask = EqualMask32(Load32(data + end - 32), value);
+    if (mask != 0) return end - 32 + 31 - __builtin_clz(mask);
+  }
+  Size result = Sse2RfindByte(data, end, c);
+  return result == end ? size : result;
+}
+
+__attribute__((target("avx2"))) Size Avx2CountByte(const char* data,
+                                                   Size size, char c) {
+  const __m256i value = _mm256_set1_epi8(c);
+  Size count = 0, i = 0;
+  for (; i + 32 <= size; i += 32) {
+    count += __builtin_popcount(EqualMask32(Load32(data + i), value));
+  }
+  return count + Sse2CountByte(data + i, size - i, c);
+}
+
+__attribute__((target("avx2"))) std::uint64_t Avx2MatchMask(const char* data,
+                                                            Size size,
+                                                            char c) {
+  if (size < 32) return Sse2MatchMask(data, size, c);
+  const __m256i value = _mm256_set1_epi8(c);
+  std::uint64_t mask = EqualMask32(Load32(data), value);
+  if (size < 64) return mask | Sse2MatchMask(data + 32, size - 32, c) << 32;
+  return mask | std::uint64_t{EqualMask32(Load32(data + 32), value)} << 32;
+}
+
+__attribute__((target("avx2"))) Size Avx2FindPair(const char* data, Size size,
+                                                  const char* needle,
+                                                  Size needle_length) {
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[needle_length - 1]);
+  Size i = 0;
+  for (; i + needle_length - 1 + 32 <= size; i += 32) {
+    unsigned mask = EqualMask32(Load32(data + i), first) &
+                    EqualMask32(Load32(data + i + needle_length - 1), last);
+    while (mask != 0) {
+      Size candidate = i + __builtin_ctz(mask);
+      if (MiddleMatches(data, candidate, needle, needle_length)) {
+        return candidate;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return ScalarFindPairFrom(data, size, i, needle, needle_length);
+}
+
+__attribute__((target("avx2"))) Size Avx2RfindPair(const char* data,
+                                                   Size size,
+                                                   const char* needle,
+                                                   Size needle_length) {
+  if (needle_length > size) return size;
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[needle_length - 1]);
+  // Candidate positions are [0, end).
+  Size end = size - needle_length + 1;
+  for (; end >= 32; end -= 32) {
+    Size i = end - 32;
+    unsigned mask = EqualMask32(Load32(data + i), first) &
+                    EqualMask32(Load32(data + i + needle_length - 1), last);
+    while (mask != 0) {
+      int bit = 31 - __builtin_clz(mask);
+      if (MiddleMatches(data, i + bit, needle, needle_length)) return i + bit;
+      mask &= ~(1u << bit);
+    }
+  }
+  return ScalarRfindPairBefore(data, size, end, needle, needle_length);
+}
+
+__attribute__((target("avx2"))) Size Avx2Mismatch(const char* a,
+                                                  const char* b, Size size) {
+  if (size < 32) return Sse2Mismatch(a, b, size);
+  for (Size i = 0; i < size - 32; i += 32) {
+    unsigned mask = ~EqualMask32(Load32(a + i), Load32(b + i));
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+  Size tail = size - 32;
+  unsigned mask = ~EqualMask32(Load32(a + tail), Load32(b + tail));
+  return mask != 0 ? tail + __builtin_ctz(mask) : size;
+}
+
+template <bool kUpper>
+__attribute__((target("avx2"))) __m256i Avx2ChangeCase(__m256i v) {
+  const char first = kUpper ? 'a' : 'A';
+  __m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8(first - 128));
+  __m256i letters = _mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 26), shifted);
+  return _mm256_xor_si256(v,
+                          _mm256_and_si256(letters, _mm256_set1_epi8(0x20)));
+}
+
+template <bool kUpper>
+__attribute__((target("avx2"))) void Avx2ChangeCase(char* out, const char* in,
+                                                    Size size) {
+  Size i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i changed = Avx2ChangeCase<kUpper>(Load32(in + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), changed);
+  }
+  Sse2ChangeCase<kUpper>(out + i, in + i, size - i);
+}
+
+__attribute__((target("avx2"))) void Avx2ReplaceByte(char* out,
+                                                     const char* in, Size size,
+                                                     char from, char to) {
+  const __m256i match = _mm256_set1_epi8(from);
+  const __m256i replacement = _mm256_set1_epi8(to);
+  Size i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i v = Load32(in + i);
+    __m256i found = _mm256_cmpeq_epi8(v, match);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i),
+                        _mm256_blendv_epi8(v, replacement, found));
+  }
+  Sse2ReplaceByte(out + i, in + i, size - i, from, to);
+}
+
+__attribute__((target("avx2"))) Size Avx2MismatchIgnoringCase(const char* a,
+                                                              const char* b,
+                                                              Size size) {
+  Size i = 0;
+  for (; i + 32 <= size; i += 32) {
+    unsigned mask = EqualMask32(Avx2ChangeCase<false>(Load32(a + i)),
+                                Avx2ChangeCase<false>(Load32(b + i)));
+    if (mask != ~0u) return i + __builtin_ctz(~mask);
+  }
+  return i + Sse2MismatchIgnoringCase(a + i, b + i, size - i);
+}
+
+// UTF-8 validation after Keiser and Lemire, "Validating UTF-8 In Less Than One
+// Instruction Per Byte". Each byte is checked against the one before it by
+// looking up three nibbles (the high and low nibbles of the byte before, and
+// its own high nibble) in tables of the errors each could be part of. An
+// error shows up as a bit set in all three lookups. The bytes two and three
+// after a 3- or 4-byte lead are checked separately: they must be exactly the
+// bytes where two continuations in a row were seen.
+constexpr char kTooShort = 1 << 0;  // a lead not followed by a continuation
+constexpr char kTooLong = 1 << 1;  // a continuation after ASCII
+constexpr char kOverlong3 = 1 << 2;  // 11100000 100_____
+constexpr char kTooLarge = 1 << 3;  // 11110100 1001____ and above
+constexpr char kSurrogate = 1 << 4;  // 11101101 101_____
+constexpr char kOverlong2 = 1 << 5;  // 1100000_ 10______
+constexpr char kTooLarge1000 = 1 << 6;  // 11110101 1000____ and above
+constexpr char kOverlong4 = 1 << 6;  // 11110000 1000____
+constexpr char kTwoContinuations = static_cast<char>(1 << 7);
+constexpr char kCarry = kTooShort | kTooLong | kTwoContinuations;
+
+// Indexed by the high nibble of the byte before.
+alignas(16) constexpr char kPreviousHigh[16] = {
+    // ASCII.
+    kTooLong, kTooLong, kTooLong, kTooLong,
+    kTooLong, kTooLong, kTooLong, kTooLong,
+    // Continuation.
+    kTwoContinuations, kTwoContinuations, kTwoContinuations, kTwoContinuations,
+    // 2-byte leads.
+    kTooShort | kOverlong2,
+    kTooShort,
+    // 3-byte leads.
+    kTooShort | kOverlong3 | kSurrogate,
+    // 4-byte leads and invalid bytes.
+    kTooShort | kTooLarge | kTooLarge1000 | kOverlong4,
+};
+
+// Indexed by the low nibble of the byte before.
+alignas(16) constexpr char kPreviousLow[16] = {
+    kCarry | kOverlong3 | kOverlong2 | kOverlong4,
+    kCarry | kOverlong2,
+    kCarry,
+    kCarry,
+    kCarry | kTooLarge,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000 | kSurrogate,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+};
+
+// Indexed by the high nibble of the byte itself.
+alignas(16) constexpr char kCurrentHigh[16] = {
+    // ASCII.
+    kTooShort, kTooShort, kTooShort, kTooShort,
+    kTooShort, kTooShort, kTooShort, kTooShort,
+    // Continuations.
+    kTooLong | kOverlong2 | kTwoContinuations | kOverlong3 | kTooLarge1000 |
+        kOverlong4,
+    kTooLong | kOverlong2 | kTwoContinuations | kOverlong3 | kTooLarge,
+    kTooLong | kOverlong2 | kTwoContinuations | kSurrogate | kTooLarge,
+    kTooLong | kOverlong2 | kTwoContinuations | kSurrogate | kTooLarge,
+    // Leads.
+    kTooShort, kTooShort, kTooShort, kTooShort,
+};
+
+__attribute__((target("avx2"))) __m256i Lookup16(const char* table,
+                                                 __m256i nibbles) {
+  __m128i entries = _mm_load_si128(reinterpret_cast<const __m128i*>(table));
+  return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(entries), nibbles);
+}
+
+__attribute__((target("avx2"))) __m256i HighNibbles(__m256i v) {
+  return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+// Returns the 32 bytes starting kShift bytes before input, where previous is
+// the block before it.
+template <int kShift>
+__attribute__((target("avx2"))) __m256i Before(__m256i input,
+                                               __m256i previous) {
+  __m256i middle = _mm256_permute2x128_si256(previous, input, 0x21);
+  return _mm256_alignr_epi8(input, middle, 16 - kShift);
+}
+
+// Returns a vector which is nonzero wherever input, following previous, is
+// not valid UTF-8.
+__attribute__((target("avx2"))) __m256i Utf8Errors(__m256i input,
+                                                   __m256i previous) {
+  __m256i previous1 = Before<1>(input, previous);
+  __m256i low = _mm256_and_si256(previous1, _mm256_set1_epi8(0x0F));
+  __m256i special = _mm256_and_si256(
+      _mm256_and_si256(Lookup16(kPreviousHigh, HighNibbles(previous1)),
+                       Lookup16(kPreviousLow, low)),
+      Lookup16(kCurrentHigh, HighNibbles(input)));
+  // Only 3- and 4-byte leads are at least 0xE0 and 0xF0, so only they leave
+  // the top bit set.
+  __m256i third = _mm256_subs_epu8(Before<2>(input, previous),
+                                   _mm256_set1_epi8(0xE0 - 0x80));
+  __m256i fourth = _mm256_subs_epu8(Before<3>(input, previous),
+                                    _mm256_set1_epi8(0xF0 - 0x80));
+  __m256i continuation = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                          _mm256_set1_epi8(kTwoContinuations));
+  return _mm256_xor_si256(continuation, special);
+}
+
+// Returns a vector which is nonzero if the block ends part way through a
+// sequence: with a lead in its last byte, a 3- or 4-byte lead in the one
+// before, or a 4-byte lead in the one before that.
+__attribute__((target("avx2"))) __m256i Utf8Incomplete(__m256i block) {
+  const __m256i limits = _mm256_setr_epi8(
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1),
+      static_cast<char>(0xC0 - 1));
+  return _mm256_subs_epu8(block, limits);
+}
+
+__attribute__((target("avx2"))) __m256i Utf8BlockErrors(__m256i input,
+                                                        __m256i previous) {
+  // A block of ASCII is valid, as long as the one before it was complete.
+  if (_mm256_movemask_epi8(input) == 0) return Utf8Incomplete(previous);
+  return Utf8Errors(input, previous);
+}
+
+__attribute__((target("avx2"))) bool Avx2ValidUtf8(const char* data,
+                                                   Size size) {
+  __m256i previous = _mm256_setzero_si256();
+  __m256i errors = _mm256_setzero_si256();
+  Size i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i input = Load32(data + i);
+    errors = _mm256_or_si256(errors, Utf8BlockErrors(input, previous));
+    previous = input;
+  }
+  // The last block is padded with nuls, which also makes any sequence cut
+  // off by the end of the data show up as too short.
+  alignas(32) char tail[32] = {};
+  std::memcpy(tail, data + i, size - i);
+  errors = _mm256_or_si256(errors, Utf8BlockErrors(Load32(tail), previous));
+  return _mm256_testz_si256(errors, errors);
+}
+
+__attribute__((target("avx2"))) Size Avx2CountCodePoints(const char* data,
+                                                         Size size) {
+  const __m256i limit = _mm256_set1_epi8(-65);
+  Size count = 0, i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i starts = _mm256_cmpgt_epi8(Load32(data + i), limit);
+    count += __builtin_popcount(_mm256_movemask_epi8(starts));
+  }
+  return count + Sse2CountCodePoints(data + i, size - i);
+}
+
+#endif  // SIMD_X86
+
+struct Kernels {
+  Size (*length)(const char* c_str);
+  void (*fill)(char* out, char c, Size size);
+  void (*copy)(char* out, const char* in, Size size);
+  Size (*find_byte)(const char* data, Size size, char c);
+  Size (*rfind_byte)(const char* data, Size size, char c);
+  Size (*count_byte)(const char* data, Size size, char c);
+  std::uint64_t (*match_mask)(const char* data, Size size, char c);
+  bool (*valid_utf8)(const char* data, Size size);
+  Size (*count_code_points)(const char* data, Size size);
+  void (*to_lower)(char* out, const char* in, Size size);
+  void (*to_upper)(char* out, const char* in, Size size);
+  void (*replace_byte)(char* out, const char* in, Size size, char from,
+                       char to);
+  Size (*mismatch_ignoring_case)(const char* a, const char* b, Size size);
+  Size (*mismatch)(const char* a, const char* b, Size size);
+  Size (*find_pair)(const char* data, Size size, const char* needle,
+                    Size needle_length);
+  Size (*rfind_pair)(const char* data, Size size, const char* needle,
+                     Size needle_length);
+};
+
+const Kernels kScalarKernels = {
+    ScalarLength,
+    ScalarFill,
+    ScalarCopy,
+    ScalarFindByte,
+    ScalarRfindByte,
+    ScalarCountByte,
+    ScalarMatchMask,
+    ScalarValidUtf8,
+    ScalarCountCodePoints,
+    ScalarChangeCase<false>,
+    ScalarChangeCase<true>,
+    ScalarReplaceByte,
+    ScalarMismatchIgnoringCase,
+    ScalarMismatch,
+    ScalarFindPair,
+    ScalarRfindPair,
+};
+#if SIMD_X86
+const Kernels kSse2Kernels = {
+    Sse2Length,
+    Sse2Fill,
+    Sse2Copy,
+    Sse2FindByte,
+    Sse2RfindByte,
+    Sse2CountByte,
+    Sse2MatchMask,
+    Sse2ValidUtf8,
+    Sse2CountCodePoints,
+    Sse2ChangeCase<false>,
+    Sse2ChangeCase<true>,
+    Sse2ReplaceByte,
+    Sse2MismatchIgnoringCase,
+    Sse2Mismatch,
+    Sse2FindPair,
+    Sse2RfindPair,
+};
+const Kernels kAvx2Kernels = {
+    Avx2Length,
+    Avx2Fill,
+    Avx2Copy,
+    Avx2FindByte,
+    Avx2RfindByte,
+    Avx2CountByte,
+    Avx2MatchMask,
+    Avx2ValidUtf8,
+    Avx2CountCodePoints,
+    Avx2ChangeCase<false>,
+    Avx2ChangeCase<true>,
+    Avx2ReplaceByte,
+    Avx2MismatchIgnoringCase,
+    Avx2Mismatch,
+    Avx2FindPair,
+    Avx2RfindPair,
+};
+#endif
+
+const Kernels& KernelsFor(Isa isa) {
+  switch (isa) {
+#if SIMD_X86
+    case Isa::kAvx2:
+      return kAvx2Kernels;
+    case Isa::kSse2:
+      return kSse2Kernels;
+#endif
+    default:
+      return kScalarKernels;
+  }
+}
+
+// Null until the first kernel call, so that strings built during static
+// initialization still get the right kernels.
+std::atomic<const Kernels*> current_kernels{nullptr};
+
+const Kernels& Current() {
+  const Kernels* kernels = current_kernels.load(std::memory_order_acquire);
+  if (kernels == nullptr) {
+    kernels = &KernelsFor(detect());
+    current_kernels.store(kernels, std::memory_order_release);
+  }
+  return *kernels;
+}
+
+}  // namespace
+
+Isa detect() {
+#if SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return Isa::kAvx2;
+  return Isa::kSse2;
+#else
+  return Isa::kScalar;
+#endif
+}
+
+Isa selected() {
+  const Kernels* kernels = &Current();
+#if SIMD_X86
+  if (kernels == &kAvx2Kernels) return Isa::kAvx2;
+  if (kernels == &kSse2Kernels) return Isa::kSse2;
+#endif
+  return Isa::kScalar;
+}
+
+void select(Isa isa) {
+  current_kernels.store(&KernelsFor(isa), std::memory_order_release);
+}
+
+Size length(const char* c_str) { return Current().length(c_str); }
+
+void fill(char* out, char c, Size size) { Current().fill(out, c, size); }
+
+void copy(char* out, const char* in, Size size) {
+  Current().copy(out, in, size);
+}
+
+Size find_byte(const char* data, Size size, char c) {
+  return Current().find_byte(data, size, c);
+}
+
+Size rfind_byte(const char* data, Size size, char c) {
+  return Current().rfind_byte(data, size, c);
+}
+
+Size count_byte(const char* data, Size size, char c) {
+  return Current().count_byte(data, size, c);
+}
+
+std::uint64_t match_mask(const char* data, Size size, char c) {
+  return Current().match_mask(data, size, c);
+}
+
+bool valid_utf8(const char* data, Size size) {
+  return Current().valid_utf8(data, size);
+}
+
+Size count_code_points(const char* data, Size size) {
+  return Current().count_code_points(data, size);
+}
+
+void to_lower(char* out, const char* in, Size size) {
+  Current().to_lower(out, in, size);
+}
+
+void to_upper(char* out, const char* in, Size size) {
+  Current().to_upper(out, in, size);
+}
+
+void replace_byte(char* out, const char* in, Size size, char from, char to) {
+  Current().replace_byte(out, in, size, from, to);
+}
+
+Size mismatch_ignoring_case(const char* a, const char* b, Size size) {
+  return Current().mismatch_ignoring_case(a, b, size);
+}
+
+Size mismatch(const char* a, const char* b, Size size) {
+  return Current().mismatch(a, b, size);
+}
+
+Size find_pair(const char* data, Size size, const char* needle,
+               Size needle_length) {
+  return Current().find_pair(data, size, needle, needle_length);
+}
+
+Size rfind_pair(const char* data, Size size, const char* needle,
+                Size needle_length) {
+  return Current().rfind_pair(data, size, needle, needle_length);
+}
+
+}  // namespace simd
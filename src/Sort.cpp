@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "../include/Sort.h"
+
+namespace {
+
+using Size = String::Size;
+
+// How many chars of each key are kept beside it.
+constexpr Size kPrefixLength = 8;
+
+// Pieces with fewer keys than this are sorted with a multikey quicksort rather
+// than dealt into buckets, as counting into 257 buckets costs more than it
+// saves.
+constexpr Size kRadixFrom = 64;
+
+// How many keys ahead to prefetch the chars of when loading prefixes.
+constexpr Size kPrefetchAhead = 8;
+
+// Pieces with fewer keys than this are sorted by insertion.
+constexpr Size kInsertionBelow = 12;
+
+// A key being sorted. Every piece of the sort holds keys whose first depth
+// chars are the same, and prefix holds the key's chars from the start of the
+// 8 which contain char depth: from base = depth rounded down to a multiple of
+// 8. The chars are in big-endian order and padded with zeros past the end of
+// the key, so that comparing prefixes as numbers compares the chars. width is
+// how many of them are really the key's. Entries are kept to 16 bytes, as
+// every pass of the radix sort moves all of them; the key itself is only
+// looked up by its index when the prefix runs out.
+struct Entry {
+  std::uint64_t prefix;
+  std::uint32_t index;
+  std::uint32_t width;
+};
+
+// A piece of the sort which can be finished on its own.
+struct Piece {
+  Entry* entries;
+  Entry* temp;
+  Size n;
+  Size depth;
+};
+
+// Compares the (prefix, width) of two keys: a negative number, zero or a
+// positive number when a orders before, level with or after b on the 8 chars
+// of the prefix. Keys with equal prefixes order by width, as one which ends
+// inside the prefix is a proper prefix of one which goes on, and keys which
+// end at the same place are equal.
+int ComparePrefix(const Entry& a, const Entry& b) {
+  if (a.prefix != b.prefix) return a.prefix < b.prefix ? -1 : 1;
+  if (a.width != b.width) return a.width < b.width ? -1 : 1;
+  return 0;
+}
+
+// Returns the bucket entry goes in at depth: 0 if the key has ended, or 1 plus
+// the char at depth.
+unsigned Bucket(const Entry& entry, Size depth) {
+  Size offset = depth % kPrefixLength;
+  if (offset >= entry.width) return 0;
+  unsigned shift = 8 * (kPrefixLength - 1 - offset);
+  return 1 + static_cast<unsigned>((entry.prefix >> shift) & 0xff);
+}
+
+// Deals the keys of a piece into buckets by their char at depth, using temp
+// (which has room for n keys) as scratch, and calls each(entries, temp, count)
+// for each bucket of more than one key which hasn't ended.
+template <typename F>
+void Distribute(Entry* entries, Entry* temp, Size n, Size depth,
+                const F& each) {
+  Size counts[257] = {};
+  for (Size i = 0; i < n; i++) counts[Bucket(entries[i], depth)]++;
+  unsigned only = Bucket(entries[0], depth);
+  if (counts[only] == n) {
+    // Every key has the same char here, so there is nothing to move.
+    if (only != 0) each(entries, temp, n);
+    return;
+  }
+  Size starts[257];
+  for (Size b = 0, start = 0; b < 257; b++) {
+    starts[b] = start;
+    start += counts[b];
+  }
+  for (Size i = 0; i < n; i++) {
+    temp[starts[Bucket(entries[i], depth)]++] = entries[i];
+  }
+  std::copy(temp, temp + n, entries);
+  for (Size b = 1, start = counts[0]; b < 257; start += counts[b], b++) {
+    if (counts[b] > 1) each(entries + start, temp + start, counts[b]);
+  }
+}
+
+// Sorts entries of the keys it is given.
+class Sorter {
+ public:
+  explicit Sorter(const StringView* keys) : keys_(keys) {}
+
+  // Sorts a piece whose keys agree on their first depth chars.
+  void Descend(Entry* entries, Entry* temp, Size n, Size depth) const {
+    if (n < 2) return;
+    SortLoaded(entries, temp, n, Load(entries, n, depth));
+  }
+
+  // Loads new prefixes for a piece if the old ones have been used up, and
+  // returns the depth to go on sorting from. Keys which all go on with the
+  // same 8 chars, such as URLs with the same scheme and host, skip to the
+  // next 8 rather than being dealt into the same bucket 8 times.
+  Size Load(Entry* entries, Size n, Size depth) const {
+    while (depth % kPrefixLength == 0) {
+      bool all_same = true;
+      for (Size i = 0; i < n; i++) {
+        // The keys are all over memory, so fetch them well ahead: first the
+        // view, then, once that has arrived, the chars it points at.
+        if (i + 2 * kPrefetchAhead < n) {
+          __builtin_prefetch(&keys_[entries[i + 2 * kPrefetchAhead].index]);
+        }
+        if (i + kPrefetchAhead < n) {
+          __builtin_prefetch(
+              keys_[entries[i + kPrefetchAhead].index].data() + depth);
+        }
+        Entry& entry = entries[i];
+        StringView key = keys_[entry.index];
+        entry.width = depth < key.length()
+                          ? std::min(key.length() - depth, kPrefixLength)
+                          : 0;
+        entry.prefix = 0;
+        std::memcpy(&entry.prefix, key.data() + depth, entry.width);
+        entry.prefix = __builtin_bswap64(entry.prefix);
+        all_same &= entry.prefix == entries[0].prefix &&
+                    key.length() > depth + kPrefixLength;
+      }
+      if (!all_same) break;
+      depth += kPrefixLength;
+    }
+    return depth;
+  }
+
+  // Sorts a piece whose prefixes are loaded.
+  void SortLoaded(Entry* entries, Entry* temp, Size n, Size depth) const {
+    if (n < kRadixFrom) {
+      Multikey(entries, temp, n, depth - depth % kPrefixLength);
+      return;
+    }
+    Distribute(entries, temp, n, depth,
+               [&](Entry* bucket, Entry* bucket_temp, Size count) {
+                 Descend(bucket, bucket_temp, count, depth + 1);
+               });
+  }
+
+ private:
+  // Whole-key comparison, reading past the prefix only when the prefixes are
+  // equal and both keys go on past them.
+  bool Less(const Entry& a, const Entry& b, Size base) const {
+    int order = ComparePrefix(a, b);
+    if (order != 0) return order < 0;
+    if (a.width < kPrefixLength) return false;
+    Size rest = base + kPrefixLength;
+    return substring(keys_[a.index], rest) < substring(keys_[b.index], rest);
+  }
+
+  void InsertionSort(Entry* entries, Size n, Size base) const {
+    for (Size i = 1; i < n; i++) {
+      Entry entry = entries[i];
+      Size j = i;
+      for (; j > 0 && Less(entry, entries[j - 1], base); j--) {
+        entries[j] = entries[j - 1];
+      }
+      entries[j] = entry;
+    }
+  }
+
+  // A multikey quicksort which takes all 8 chars of the prefix as one "char":
+  // split into keys with smaller, equal and larger prefixes than a pivot's,
+  // sort the smaller and larger parts the same way, and the equal part from
+  // the next 8 chars on.
+  void Multikey(Entry* entries, Entry* temp, Size n, Size base) const {
+    while (n >= kInsertionBelow) {
+      // The median of the first, middle and last keys.
+      Entry a = entries[0], b = entries[n / 2], c = entries[n - 1];
+      if (ComparePrefix(b, a) < 0) std::swap(a, b);
+      if (ComparePrefix(c, b) < 0) {
+        b = c;
+        if (ComparePrefix(b, a) < 0) b = a;
+      }
+      const Entry pivot = b;
+      Size less = 0, i = 0, greater = n;
+      while (i < greater) {
+        int order = ComparePrefix(entries[i], pivot);
+        if (order < 0) {
+          std::swap(entries[less++], entries[i++]);
+        } else if (order > 0) {
+          std::swap(entries[i], entries[--greater]);
+        } else {
+          i++;
+        }
+      }
+      if (pivot.width == kPrefixLength) {
+        Descend(entries + less, temp + less, greater - less,
+                base + kPrefixLength);
+      }
+      // Recurse into the smaller side and loop on the larger, so that the
+      // stack stays shallow.
+      if (less < n - greater) {
+        Multikey(entries, temp, less, base);
+        entries += greater;
+        temp += greater;
+        n -= greater;
+      } else {
+        Multikey(entries + greater, temp + greater, n - greater, base);
+        n = less;
+      }
+    }
+    InsertionSort(entries, n, base);
+  }
+
+  const StringView* keys_;
+};
+
+}  // namespace
+
+std::vector<Size> sorted_order(const std::vector<StringView>& keys,
+                               parallel::ThreadPool& pool) {
+  Size n = keys.size();
+  if (n > UINT32_MAX) throw std::length_error("too many keys to sort");
+  std::unique_ptr<Entry[]> entries{new Entry[n]};
+  std::unique_ptr<Entry[]> temp{new Entry[n]};
+  for (Size i = 0; i < n; i++) entries[i].index = i;
+  Sorter sorter{keys.data()};
+  if (n < kParallelSortFrom || pool.threads() == 1) {
+    sorter.Descend(entries.get(), temp.get(), n, 0);
+  } else {
+    // Split the biggest pieces into buckets here until there are enough
+    // pieces for the threads to share out evenly, even if the keys all start
+    // the same way, then sort the pieces on every thread, biggest first.
+    Size most = std::max(n / (pool.threads() * 16), kRadixFrom);
+    std::vector<Piece> pending, pieces;
+    Size depth = sorter.Load(entries.get(), n, 0);
+    pending.push_back(Piece{entries.get(), temp.get(), n, depth});
+    while (!pending.empty()) {
+      Piece piece = pending.back();
+      pending.pop_back();
+      if (piece.n <= most) {
+        pieces.push_back(piece);
+        continue;
+      }
+      Distribute(piece.entries, piece.temp, piece.n, piece.depth,
+                 [&](Entry* bucket, Entry* bucket_temp, Size count) {
+                   Size depth = sorter.Load(bucket, count, piece.depth + 1);
+                   pending.push_back(Piece{bucket, bucket_temp, count, depth});
+                 });
+    }
+    std::sort(pieces.begin(), pieces.end(),
+              [](const Piece& a, const Piece& b) { return a.n > b.n; });
+    pool.run(pieces.size(), [&](Size i) {
+      sorter.SortLoaded(pieces[i].entries, pieces[i].temp, pieces[i].n,
+                        pieces[i].depth);
+    });
+  }
+  std::vector<Size> order(n);
+  for (Size i = 0; i < n; i++) order[i] = entries[i].index;
+  return order;
+}
@@ -0,0 +1,83 @@
+#include "../include/Search.h"
+#include "../include/Simd.h"
+#include "../include/Split.h"
+#include "../include/Transform.h"
+
+using Size = Split::Size;
+
+Split::Iterator::Iterator(const Split* split)
+    : split_(split), rest_(split->text_.data()) {
+  // An empty text has one empty field, but no lines.
+  if (split->mode_ == Mode::kLines && split->text_.length() == 0) {
+    rest_ = nullptr;
+  }
+  advance();
+}
+
+void Split::Iterator::advance() {
+  if (split_ == nullptr) return;
+  const char* end = split_->text_.data() + split_->text_.length();
+  while (rest_ != nullptr) {
+    Size remaining = end - rest_;
+    Size length = remaining, skip = 0;
+    if (split_->mode_ == Mode::kString) {
+      Size i = split_->delimiter_.length() == 0
+                   ? kNotFound
+                   : find(StringView{rest_, remaining}, split_->delimiter_);
+      if (i != kNotFound) {
+        length = i;
+        skip = split_->delimiter_.length();
+      }
+    } else {
+      const char* found = find_char(rest_, end);
+      if (found != end) {
+        length = found - rest_;
+        skip = 1;
+      }
+    }
+    field_ = StringView{rest_, length};
+    if (skip == 0) {
+      rest_ = nullptr;
+    } else {
+      rest_ += length + skip;
+      // A newline at the very end finishes the last line.
+      if (split_->mode_ == Mode::kLines && rest_ == end) rest_ = nullptr;
+    }
+    if (split_->mode_ == Mode::kLines && length > 0 &&
+        field_.data()[length - 1] == '\r') {
+      field_ = StringView{field_.data(), length - 1};
+    }
+    if (split_->options_ & kTrimWhitespace) field_ = trim(field_);
+    if (!(split_->options_ & kSkipEmpty) || field_.length() > 0) return;
+  }
+  // Past the last field: become an end iterator.
+  *this = Iterator{};
+}
+
+const char* Split::Iterator::find_char(const char* from, const char* end) {
+  constexpr Size kBlock = 64;
+  while (true) {
+    if (block_ != nullptr && Size(from - block_) < kBlock) {
+      std::uint64_t later = matches_ >> (from - block_);
+      if (later != 0) return from + __builtin_ctzll(later);
+      // The mask is cut short at end, so nothing past the block is left.
+      if (Size(end - block_) <= kBlock) return end;
+      from = block_ + kBlock;
+    }
+    if (from == end) return end;
+    block_ = from;
+    matches_ = simd::match_mask(from, end - from, split_->c_);
+  }
+}
+
+Split split(StringView s, char delimiter, SplitOptions options) {
+  return Split{s, Split::Mode::kChar, delimiter, StringView{}, options};
+}
+
+Split split(StringView s, StringView delimiter, SplitOptions options) {
+  return Split{s, Split::Mode::kString, '\0', delimiter, options};
+}
+
+Split lines(StringView s, SplitOptions options) {
+  return Split{s, Split::Mode::kLines, '\n', StringView{}, options};
+}
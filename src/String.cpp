@@ -1,57 +1,212 @@
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <new>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../include/Hash.h"
+#include "../include/Simd.h"
 #include "../include/String.h"
+#include "../include/StringView.h"
 
 using Size = unsigned long long;
 
+static_assert(sizeof(String) == 16, "String should fit in two words.");
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "The inline/heap tag relies on a little-endian length_.");
+
+// Returns the size of the mapping for a file of length bytes: whole pages,
+// with at least one byte to spare for the nul terminator.
+static Size MappingSize(Size length) {
+  static const Size page = sysconf(_SC_PAGESIZE);
+  return (length + page) / page * page;
+}
+
+bool String::is_inline() const {
+  return !(static_cast<unsigned char>(inline_[kInlineCapacity]) & 0x80);
+}
+
+bool String::is_shared() const {
+  return !is_inline() && (heap_.length_ & kSharedFlag);
+}
+
+bool String::is_static() const {
+  return !is_inline() && (heap_.length_ & kStaticFlag);
+}
+
+bool String::is_read_only() const {
+  return !is_inline() &&
+         (heap_.length_ & (kSharedFlag | kMappedFlag | kStaticFlag));
+}
+
+String::SharedHeader* String::shared_header() const {
+  void* block = heap_.first_char_ - sizeof(SharedHeader);
+  return static_cast<SharedHeader*>(block);
+}
+
+String::GrowableHeader* String::growable_header() const {
+  void* block = heap_.first_char_ - sizeof(GrowableHeader);
+  return static_cast<GrowableHeader*>(block);
+}
+
+Size String::spare() const {
+  if (is_inline() || !(heap_.length_ & kTrimmedFlag)) return 0;
+  const char* after = heap_.first_char_ + length() + 1;
+  if (after[0] != 0) return static_cast<unsigned char>(after[0]);
+  Size spare;
+  std::memcpy(&spare, after + 1, sizeof(spare));
+  return spare;
+}
+
+void String::set_spare(Size spare) {
+  char* after = heap_.first_char_ + length() + 1;
+  if (spare <= sizeof(Size)) {
+    after[0] = static_cast<char>(spare);
+  } else {
+    after[0] = 0;
+    std::memcpy(after + 1, &spare, sizeof(spare));
+  }
+}
+
+void String::release() {
+  if (heap_.length_ & kStaticFlag) {
+    return;
+  } else if (heap_.length_ & kMappedFlag) {
+    munmap(heap_.first_char_, MappingSize(length()));
+  } else if (heap_.length_ & kSharedFlag) {
+    SharedHeader* header = shared_header();
+    // The last reference frees the buffer. acq_rel makes sure that every other
+    // owner's reads of the buffer happen before it is freed.
+    if (header->references.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return;
+    }
+    std::pmr::memory_resource* resource = header->resource;
+    Size bytes = sizeof(SharedHeader) + length() + 1;
+    header->~SharedHeader();
+    if (resource != nullptr) {
+      resource->deallocate(header, bytes, alignof(SharedHeader));
+    } else {
+      delete[] reinterpret_cast<char*>(header);
+    }
+    profile::record_deallocation(bytes);
+  } else if (heap_.length_ & kGrowableFlag) {
+    GrowableHeader* header = growable_header();
+    Size bytes = sizeof(GrowableHeader) + header->capacity + 1;
+    if (header->resource != nullptr) {
+      header->resource->deallocate(header, bytes, alignof(GrowableHeader));
+    } else {
+      delete[] reinterpret_cast<char*>(header);
+    }
+    profile::record_deallocation(bytes);
+  } else if (heap_.length_ & kResourceFlag) {
+    void* block = heap_.first_char_ - sizeof(ResourceHeader);
+    auto* header = static_cast<ResourceHeader*>(block);
+    Size bytes = sizeof(ResourceHeader) + length() + 1 + spare();
+    header->resource->deallocate(block, bytes, alignof(ResourceHeader));
+    profile::record_deallocation(bytes);
+  } else {
+    Size bytes = length() + 1 + spare();
+    delete[] heap_.first_char_;
+    profile::record_deallocation(bytes);
+  }
+}
+
+char* String::initialize(Size length, std::pmr::memory_resource* resource,
+                         profile::Operation operation) {
+  if (length <= kInlineCapacity) {
+    inline_[kInlineCapacity] = static_cast<char>(kInlineCapacity - length);
+    inline_[length] = '\0';
+    return inline_;
+  }
+  char* buffer;
+  if (resource == nullptr) {
+    buffer = new char[length + 1];
+    heap_.length_ = length | kHeapFlag;
+    profile::record_allocation(operation, length + 1);
+  } else {
+    Size bytes = sizeof(ResourceHeader) + length + 1;
+    void* block = resource->allocate(bytes, alignof(ResourceHeader));
+    profile::record_allocation(operation, bytes);
+    new (block) ResourceHeader{resource};
+    buffer = static_cast<char*>(block) + sizeof(ResourceHeader);
+    heap_.length_ = length | kHeapFlag | kResourceFlag;
+  }
+  buffer[length] = '\0';
+  heap_.first_char_ = buffer;
+  return buffer;
+}
+
+void String::initialize_growable(Size capacity,
+                                 std::pmr::memory_resource* resource) {
+  if (capacity <= kInlineCapacity) {
+    initialize(0);
+    return;
+  }
+  Size bytes = sizeof(GrowableHeader) + capacity + 1;
+  void* block = resource != nullptr
+                    ? resource->allocate(bytes, alignof(GrowableHeader))
+                    : new char[bytes];
+  profile::record_allocation(profile::Operation::kAppend, bytes);
+  new (block) GrowableHeader{capacity, resource};
+  heap_.first_char_ = static_cast<char*>(block) + sizeof(GrowableHeader);
+  heap_.first_char_[0] = '\0';
+  heap_.length_ = kHeapFlag | kGrowableFlag;
+}
+
+void String::set_length(Size length) {
+  if (is_inline()) {
+    inline_[kInlineCapacity] = static_cast<char>(kInlineCapacity - length);
+    inline_[length] = '\0';
+  } else {
+    heap_.length_ = (heap_.length_ & ~kLengthMask) | length;
+    heap_.first_char_[length] = '\0';
+  }
+}
+
 // Constructs an empty string.
 // String foo;
 String::String() {
-  first_char_ = new char[1];
-  first_char_[0] = '\0';
-  length_ = 0;
+  initialize(0);
 }
 
 // Constructs a new string containing a given repeated character.
-String::String(char c, Size size) {
-  length_ = size;
-  first_char_ = new char[length_ + 1]();
-  for (Size i = 0; i < length_; i++) {
-    first_char_[i] = c;
-  }
-  first_char_[length_] = '\0';
+String::String(char c, Size size, std::pmr::memory_resource* resource) {
+  simd::fill(initialize(size, resource, profile::Operation::kFill), c, size);
 }
 
 // Construct a string by copying the value of a null-terminated string.
 // String foo{"Hello!"};
-String::String(const char* c_str) {
-  // tis inefficient
-  length_ = 0;
-  const char* current = c_str;
-  while (*current != '\0') {
-    length_++;
-    current++;
-  }
-  current = c_str;
-  first_char_ = new char[length_ + 1];
-  for (Size i = 0; i < length_; i ++) {
-    first_char_[i] = *current;
-    current++;
-  }
-  first_char_[length_] = '\0';
+String::String(const char* c_str, std::pmr::memory_resource* resource) {
+  Size length = simd::length(c_str);
+  char* first_char =
+      initialize(length, resource, profile::Operation::kCString);
+  simd::copy(first_char, c_str, length);
 }
 
-
 // Construct a string by copying a fixed number of bytes from a buffer.
 // String foo{"Hello!", 6};
-String::String(const char* data, Size size) {
-  length_ = size;
-  first_char_ = new char[length_ +1]();
-  const char* current = data;
-  for (Size i = 0; i < length_; i++) {
-    first_char_[i] = *current;
-    current++;
-  }
-  first_char_[length_] = '\0';
+String::String(const char* data, Size size,
+               std::pmr::memory_resource* resource) {
+  simd::copy(initialize(size, resource, profile::Operation::kBuffer), data,
+             size);
+}
+
+// Construct a string by copying the contents of a view.
+// String foo{substring(view(bar), 3)};
+String::String(StringView view, std::pmr::memory_resource* resource)
+    : String(view.data(), view.length(), resource) {}
+
+// Construct a copy of other with its buffer allocated from resource.
+// Arena arena;
+// String foo{bar, &arena};
+String::String(const String& other, std::pmr::memory_resource* resource) {
+  Size length = other.length();
+  char* first_char = initialize(length, resource, profile::Operation::kCopy);
+  simd::copy(first_char, other.data(), length);
 }
 
 // Rule of five - if you ever have to implement any of the next five
@@ -60,7 +215,7 @@ String::String(const char* data, Size size) {
 
 // Destructor.
 String::~String() {
-  delete[] first_char_;
+  if (!is_inline()) release();
 }
 
 // Copy constructor: Create a new string which is a copy of other.
@@ -69,13 +224,21 @@ String::~String() {
 // std::cout << bar << "\n";  // shows "Hello!"
 // std::cout << foo << "\n";  // shows "Hello!"
 String::String(const String& other) {
-  length_ = other.length();
-  first_char_ = new char[length_ + 1]();
-  const char* current = other.data();
-  for (Size i = 0; i < length_; i++) {
-    first_char_[i] = *current;
-    ++current;
+  if (other.is_shared()) {
+    // Nothing can happen to the buffer before this returns, because other
+    // holds a reference to it, so the increment needs no ordering.
+    other.shared_header()->references.fetch_add(1, std::memory_order_relaxed);
+    std::memcpy(&heap_, &other.heap_, sizeof(heap_));
+    return;
+  }
+  if (other.is_static()) {
+    // Literals are never freed, so the copy can point at the same chars.
+    std::memcpy(&heap_, &other.heap_, sizeof(heap_));
+    return;
   }
+  Size length = other.length();
+  char* first_char = initialize(length, nullptr, profile::Operation::kCopy);
+  simd::copy(first_char, other.data(), length);
 }
 
 // Move constructor: Create a new string from other, potentially
@@ -86,11 +249,11 @@ String::String(const String& other) {
 // String bar{std::move(foo)};  // move
 // std::cout << bar << "\n";  // shows "Hello!"
 // std::cout << foo << "\n";  // allowed to show anything but must not crash.
-String::String(String&& other) {
-  first_char_ = other.data();
-  length_ = other.length();
-  other.first_char_ = new char[1]{'\0'};
-  other.length_ = 0;
+String::String(String&& other) noexcept {
+  // Either representation can be moved by copying its bytes: an inline string
+  // brings its chars along and a heap string brings its buffer.
+  std::memcpy(&heap_, &other.heap_, sizeof(heap_));
+  other.initialize(0);
 }
 
 // Copy-assignment operator: Overwrite this string with a copy of other.
@@ -101,16 +264,10 @@ String::String(String&& other) {
 // std::cout << foo << "\n" << bar << "\n";  // shows "Hello!" twice.
 String& String::operator=(const String& other) {
   if (this != &other) {
-    char* temp = new char[other.length() + 1];
-    length_ = other.length();
-    delete[] first_char_;
-    first_char_ = temp;
-    const char* current = other.data();
-    for (Size i = 0; i < length_; i++) {
-      first_char_[i] = *current;
-      ++current;
-    }
-    first_char_[length_] = '\0';
+    // Copy first so that a failed allocation leaves this string untouched.
+    profile::Scope scope{profile::Operation::kCopyAssign};
+    String copy{other};
+    *this = std::move(copy);
   }
   return *this;
 }
@@ -123,15 +280,12 @@ String& String::operator=(const String& other) {
 // foo = std::move(bar);  // move-assign.
 // std::cout << bar << "\n";  // shows "Hello!"
 // std::cout << foo << "\n";  // allowed to show anything but must not crash.
-String& String::operator=(String&& other) {
-  // first_char_ = new char[1]{'\0'};.
-  char* temp_char = data();
-  Size temp_length = length();
-  first_char_ = other.data();
-  length_ = other.length();
-  other.length_ = temp_length;
-  other.first_char_ = temp_char;
-  //other.~String();
+String& String::operator=(String&& other) noexcept {
+  // Swap representations; other's destructor will release our old buffer.
+  Heap temp;
+  std::memcpy(&temp, &heap_, sizeof(heap_));
+  std::memcpy(&heap_, &other.heap_, sizeof(heap_));
+  std::memcpy(&other.heap_, &temp, sizeof(heap_));
   return *this;
 }
 
@@ -141,20 +295,235 @@ String& String::operator=(String&& other) {
 // char* c_string = foo.data();
 // std::cout << c_string << "\n";  // shows "Hello!"
 const char* String::data() const {
-  return first_char_;
+  return is_inline() ? inline_ : heap_.first_char_;
 }
 
 char* String::data() {
-  return first_char_;
+  if (is_inline()) return inline_;
+  if (is_read_only()) {
+    // Make a private copy; swapping it in drops our reference to the shared
+    // buffer (or the mapping, or nothing for a literal) when the copy is
+    // destroyed.
+    profile::Scope scope{profile::Operation::kUnshare};
+    String copy{*this, resource()};
+    *this = std::move(copy);
+    // A short literal's copy is stored inline.
+    if (is_inline()) return inline_;
+  }
+  return heap_.first_char_;
 }
 
 // Returns the length of the string.
 // String foo{"Hello!"};
 // std::cout << foo.length() << "\n";  // shows 6.
 Size String::length() const {
-  return length_;
+  if (is_inline()) {
+    auto spare = static_cast<unsigned char>(inline_[kInlineCapacity]);
+    return kInlineCapacity - spare;
+  }
+  return heap_.length_ & kLengthMask;
+}
+
+// Returns the memory resource this string's buffer was allocated from, or
+// nullptr if the string is stored inline or on the global heap.
+std::pmr::memory_resource* String::resource() const {
+  if (is_shared()) return shared_header()->resource;
+  if (!is_inline() && (heap_.length_ & kGrowableFlag)) {
+    return growable_header()->resource;
+  }
+  if (is_inline() || !(heap_.length_ & kResourceFlag)) return nullptr;
+  const void* block = heap_.first_char_ - sizeof(ResourceHeader);
+  return static_cast<const ResourceHeader*>(block)->resource;
+}
+
+// Returns the number of chars the string can hold without reallocating.
+Size String::capacity() const {
+  if (is_inline()) return kInlineCapacity;
+  if (heap_.length_ & kGrowableFlag) return growable_header()->capacity;
+  return length();
+}
+
+// Makes room for at least capacity chars.
+void String::reserve(Size capacity) {
+  if (capacity <= this->capacity()) return;
+  Size length = this->length();
+  // Build the new buffer alongside the old one; moving it in releases the old.
+  String grown;
+  grown.initialize_growable(capacity, resource());
+  simd::copy(grown.data(), std::as_const(*this).data(), length);
+  grown.set_length(length);
+  *this = std::move(grown);
+}
+
+void String::push_back(char c) {
+  Size length = this->length();
+  if (length == capacity() || is_read_only()) return append(&c, 1);
+  char* first_char = is_inline() ? inline_ : heap_.first_char_;
+  first_char[length] = c;
+  set_length(length + 1);
+}
+
+void String::append(const char* data, Size size) {
+  // The common case when building a long string: room left in the buffer.
+  if (!is_inline() && (heap_.length_ & kGrowableFlag)) {
+    Size length = heap_.length_ & kLengthMask;
+    if (length + size <= growable_header()->capacity) {
+      simd::copy(heap_.first_char_ + length, data, size);
+      heap_.length_ += size;
+      heap_.first_char_[length + size] = '\0';
+      return;
+    }
+  }
+  Size length = this->length();
+  if (length + size > capacity() || is_read_only()) {
+    // Doubling means that each char is copied O(1) times on average over any
+    // number of appends. The old buffer lives until the new one is filled,
+    // in case data points into it.
+    Size capacity = std::max(length + size, 2 * this->capacity());
+    String grown;
+    grown.initialize_growable(capacity, resource());
+    // Growing a short literal can leave it inline.
+    char* first_char = grown.data();
+    simd::copy(first_char, std::as_const(*this).data(), length);
+    simd::copy(first_char + length, data, size);
+    grown.set_length(length + size);
+    *this = std::move(grown);
+    return;
+  }
+  char* first_char = is_inline() ? inline_ : heap_.first_char_;
+  simd::copy(first_char + length, data, size);
+  set_length(length + size);
+}
+
+void String::append(const String& s) {
+  append(s.data(), s.length());
+}
+
+// Shortens the string to its first length chars, in its own buffer if it can.
+void String::truncate(Size length) {
+  Size old_length = this->length();
+  if (length >= old_length) return;
+  if (is_read_only()) {
+    *this = String{std::as_const(*this).data(), length, resource()};
+    return;
+  }
+  if (is_inline() || (heap_.length_ & kGrowableFlag)) {
+    set_length(length);
+    return;
+  }
+  // An exact-fit buffer must remember how long it really is, to free it.
+  Size spare = old_length - length + this->spare();
+  set_length(length);
+  heap_.length_ |= kTrimmedFlag;
+  set_spare(spare);
+}
+
+// Drops the first count chars, moving the rest to the front of the buffer.
+void String::remove_prefix(Size count) {
+  Size length = this->length();
+  if (count == 0) return;
+  if (count >= length) return truncate(0);
+  if (is_read_only()) {
+    *this = String{std::as_const(*this).data() + count, length - count,
+                   resource()};
+    return;
+  }
+  char* first_char = data();
+  std::memmove(first_char, first_char + count, length - count);
+  truncate(length - count);
+}
+
+// Moves this string into a buffer which copies will share rather than copy.
+void String::share() {
+  if (is_inline() || is_shared() || is_static()) return;
+  Size length = this->length();
+  std::pmr::memory_resource* resource = this->resource();
+  Size bytes = sizeof(SharedHeader) + length + 1;
+  void* block = resource != nullptr
+                    ? resource->allocate(bytes, alignof(SharedHeader))
+                    : new char[bytes];
+  profile::record_allocation(profile::Operation::kShare, bytes);
+  new (block) SharedHeader{{1}, resource, {0}};
+  char* buffer = static_cast<char*>(block) + sizeof(SharedHeader);
+  simd::copy(buffer, heap_.first_char_, length + 1);
+  release();
+  heap_.first_char_ = buffer;
+  heap_.length_ = length | kHeapFlag | kSharedFlag;
 }
 
+// Returns how many strings share this string's buffer.
+Size String::share_count() const {
+  if (!is_shared()) return 1;
+  return shared_header()->references.load(std::memory_order_relaxed);
+}
+
+String String::uninitialized(Size length,
+                             std::pmr::memory_resource* resource) {
+  String result;
+  result.initialize(length, resource);
+  return result;
+}
+
+// Maps a file into memory read-only.
+String String::map_file(const char* path) {
+  int file = open(path, O_RDONLY | O_CLOEXEC);
+  if (file == -1) throw std::system_error(errno, std::generic_category(), path);
+  // Close the file however this returns; the mapping doesn't need it open.
+  struct Closer {
+    int file;
+    ~Closer() { close(file); }
+  } closer{file};
+  struct stat status;
+  if (fstat(file, &status) == -1) {
+    throw std::system_error(errno, std::generic_category(), path);
+  }
+  Size length = status.st_size;
+  String result;
+  if (length <= kInlineCapacity) {
+    // Not worth a page: read it instead.
+    char* first_char = result.initialize(length);
+    for (Size done = 0; done < length;) {
+      ssize_t count = read(file, first_char + done, length - done);
+      if (count <= 0) {
+        if (count == -1 && errno == EINTR) continue;
+        throw std::system_error(count == 0 ? EIO : errno,
+                                std::generic_category(), path);
+      }
+      done += count;
+    }
+    return result;
+  }
+  // Reserve the whole range with zero pages, then map the file over the
+  // start of it. Any zero page left at the end holds the terminator.
+  Size size = MappingSize(length);
+  void* region = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+  if (region == MAP_FAILED) {
+    throw std::system_error(errno, std::generic_category(), path);
+  }
+  if (mmap(region, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, file, 0) ==
+      MAP_FAILED) {
+    int error = errno;
+    munmap(region, size);
+    throw std::system_error(error, std::generic_category(), path);
+  }
+  result.heap_.first_char_ = static_cast<char*>(region);
+  result.heap_.length_ = length | kHeapFlag | kMappedFlag;
+  return result;
+}
+
+// Returns the hash of the string, cached in the buffer if it is shared.
+Size String::hash() const {
+  if (!is_shared()) return ::hash(*this);
+  std::atomic<Size>& cached = shared_header()->hash;
+  Size value = cached.load(std::memory_order_relaxed);
+  if (value == 0) {
+    // A string which really hashes to zero just isn't cached.
+    value = ::hash(*this);
+    cached.store(value, std::memory_order_relaxed);
+  }
+  return value;
+}
 
 // None of these functions should need access to anything except the existing
 // public interface of the string to be implemented efficiently.
@@ -167,36 +536,25 @@ std::ostream& operator<<(std::ostream& output, const String& s) {
 
 // substring from start position to end. start must be <= s.length().
 String substring(const String& s, String::Size start) {
-  if (start > s.length()) {
-    return String();
-  }
-  return String(s.data() + start, s.length() - start);
+  profile::Scope scope{profile::Operation::kSubstring};
+  return String(view(s, start));
 }
 
 // substring [start, start + length). substring indices must be fully inside s.
 String substring(const String& s, String::Size start, String::Size length) {
-  if (start > s.length() - length) {
-    return String();
-  }
-  return String(s.data() + start, length);
-}
-
-// String concatenation.
-String operator+(const String& s1, const String& s2) {
-  int length_ =  s1.length() + s2.length();
-  String res('1', length_);
-  char* first_char_ = res.data();
-  const char* current = s1.data();
-  for (Size i = 0; i < s1.length(); i++) {
-    first_char_[i] = *current;
-    ++current;
-  }
-  current = s2.data();
-  for (Size j = 0; j < s2.length(); j++) {
-    first_char_[j + s1.length()] = *current;
-   ++current;
-  }
-  //String* res = new String(first_char_, length_);
-  //delete[] first_char_;
-  return res;
+  profile::Scope scope{profile::Operation::kSubstring};
+  return String(view(s, start, length));
+}
+
+// Views of s, or of part of it. These never copy.
+StringView view(const String& s) {
+  return StringView(s);
+}
+
+StringView view(const String& s, String::Size start) {
+  return substring(StringView(s), start);
+}
+
+StringView view(const String& s, String::Size start, String::Size length) {
+  return substring(StringView(s), start, length);
 }
@@ -0,0 +1,43 @@
+#include <utility>
+#include "../include/StringBuilder.h"
+
+using Size = StringBuilder::Size;
+
+StringBuilder::StringBuilder(Size capacity) {
+  buffer_.reserve(capacity);
+}
+
+StringBuilder& StringBuilder::append(char c) {
+  buffer_.push_back(c);
+  return *this;
+}
+
+StringBuilder& StringBuilder::append(const char* data, Size size) {
+  buffer_.append(data, size);
+  return *this;
+}
+
+StringBuilder& StringBuilder::append(StringView v) {
+  buffer_.append(v.data(), v.length());
+  return *this;
+}
+
+void StringBuilder::reserve(Size capacity) {
+  buffer_.reserve(capacity);
+}
+
+Size StringBuilder::length() const {
+  return buffer_.length();
+}
+
+Size StringBuilder::capacity() const {
+  return buffer_.capacity();
+}
+
+StringView StringBuilder::view() const {
+  return StringView{buffer_};
+}
+
+String StringBuilder::build() {
+  return std::move(buffer_);
+}
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include "../include/Search.h"
+#include "../include/Simd.h"
+#include "../include/StringColumn.h"
+
+using Size = StringColumn::Size;
+
+namespace {
+
+// The most chars a column can hold, as its offsets are 32 bits.
+constexpr Size kMaxBytes = UINT32_MAX;
+
+}  // namespace
+
+StringColumn::StringColumn() : offsets_{0} {}
+
+StringColumn::StringColumn(const std::vector<String>& strings) {
+  Size total = 0;
+  for (const String& s : strings) total += s.length();
+  if (total > kMaxBytes) throw std::length_error("StringColumn too long");
+  bytes_ = String::uninitialized(total);
+  offsets_.reserve(strings.size() + 1);
+  offsets_.push_back(0);
+  char* out = bytes_.data();
+  for (const String& s : strings) {
+    simd::copy(out + offsets_.back(), s.data(), s.length());
+    offsets_.push_back(offsets_.back() + s.length());
+  }
+}
+
+void StringColumn::append(StringView v) {
+  if (v.length() > kMaxBytes - bytes_.length()) {
+    throw std::length_error("StringColumn too long");
+  }
+  bytes_.append(v.data(), v.length());
+  offsets_.push_back(bytes_.length());
+}
+
+void StringColumn::reserve(Size rows, Size bytes) {
+  offsets_.reserve(offsets_.size() + rows);
+  bytes_.reserve(bytes_.length() + bytes);
+}
+
+Size StringColumn::size() const { return offsets_.size() - 1; }
+
+StringView StringColumn::operator[](Size i) const {
+  return StringView{data() + offsets_[i], offsets_[i + 1] - offsets_[i]};
+}
+
+Size StringColumn::offset(Size i) const { return offsets_[i]; }
+
+const std::uint32_t* StringColumn::offsets() const { return offsets_.data(); }
+
+const char* StringColumn::data() const { return bytes_.data(); }
+
+Size StringColumn::bytes() const { return bytes_.length(); }
+
+Size StringColumn::bytes_used() const {
+  return bytes_.capacity() + offsets_.capacity() * sizeof(offsets_[0]);
+}
+
+std::vector<String> StringColumn::to_strings() const {
+  std::vector<String> strings;
+  strings.reserve(size());
+  for (Size i = 0; i < size(); i++) {
+    strings.emplace_back(data() + offsets_[i], offsets_[i + 1] - offsets_[i]);
+  }
+  return strings;
+}
+
+StringColumn StringColumn::take(const std::vector<Size>& rows) const {
+  Size total = 0;
+  for (Size row : rows) total += offsets_[row + 1] - offsets_[row];
+  StringColumn result;
+  result.reserve(rows.size(), total);
+  for (Size row : rows) result.append((*this)[row]);
+  return result;
+}
+
+std::vector<Size> StringColumn::find(StringView needle) const {
+  std::vector<Size> rows;
+  if (needle.length() == 0) {
+    rows.resize(size());
+    for (Size i = 0; i < size(); i++) rows[i] = i;
+    return rows;
+  }
+  StringView all{data(), bytes()};
+  // Rows before first_row have been dealt with.
+  auto first_row = offsets_.begin() + 1;
+  for (Size start = ::find(all, needle); start != kNotFound;
+       start = ::find(all, needle, start)) {
+    // The match is in the last row which starts at or before it; empty rows
+    // start where the row after them does.
+    first_row = std::upper_bound(first_row, offsets_.end(), start);
+    Size row = first_row - offsets_.begin() - 1;
+    Size end = *first_row;
+    if (start + needle.length() <= end) rows.push_back(row);
+    // Either the row has a match or no match starting in it fits inside it,
+    // so go on from the next row.
+    start = end;
+  }
+  return rows;
+}
+
+std::vector<Size> StringColumn::find_equal(StringView value) const {
+  std::vector<Size> rows;
+  const char* chars = data();
+  for (Size i = 0; i < size(); i++) {
+    if (offsets_[i + 1] - offsets_[i] == value.length() &&
+        StringView{chars + offsets_[i], value.length()} == value) {
+      rows.push_back(i);
+    }
+  }
+  return rows;
+}
@@ -0,0 +1,207 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../include/Hash.h"
+#include "../include/Output.h"
+#include "../include/Search.h"
+#include "../include/StringTable.h"
+
+using Size = StringTable::Size;
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 't', 'r', 'T', 'a', 'b', 'l', 'e'};
+
+// Set in Header::flags when the file has an index.
+constexpr std::uint32_t kHasIndex = 1;
+
+struct Header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t flags;
+  std::uint64_t rows;
+  std::uint64_t chars;
+  std::uint64_t index_slots;
+  // hash() of the offsets (not counting the padding), of the index and of
+  // the chars.
+  std::uint64_t offsets_checksum;
+  std::uint64_t index_checksum;
+  std::uint64_t chars_checksum;
+};
+static_assert(sizeof(Header) == 64, "The header is part of the format");
+
+// Rows are numbered from 1 in the index's 32 bits, and 0 means empty.
+constexpr Size kMaxRows = UINT32_MAX - 1;
+
+// Returns the size of the offsets section of a table of rows rows, padded so
+// that the index after it is 8-byte aligned.
+Size OffsetsSize(Size rows) { return ((rows + 1) * 4 + 7) / 8 * 8; }
+
+std::uint64_t Checksum(const void* data, Size size) {
+  return hash(StringView{static_cast<const char*>(data), size});
+}
+
+[[noreturn]] void Invalid(const char* path, const char* reason) {
+  throw std::runtime_error(std::string{path} + ": " + reason);
+}
+
+}  // namespace
+
+void write_string_table(const char* path, const StringColumn& column,
+                        bool with_index) {
+  Size rows = column.size();
+  if (rows > kMaxRows) throw std::length_error("too many rows for a table");
+  // At most half full, so that probes stay short.
+  std::vector<std::uint64_t> index;
+  if (with_index) {
+    Size slots = 1;
+    while (slots < 2 * rows) slots *= 2;
+    index.assign(slots, 0);
+    for (Size row = 0; row < rows; row++) {
+      Size row_hash = hash(column[row]);
+      Size i = row_hash & (slots - 1);
+      while (index[i] != 0) i = (i + 1) & (slots - 1);
+      index[i] = (row_hash >> 32 << 32) | (row + 1);
+    }
+  }
+  Size offsets_length = (rows + 1) * sizeof(std::uint32_t);
+  Size index_length = index.size() * sizeof(std::uint64_t);
+  Header header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = StringTable::kVersion;
+  header.flags = with_index ? kHasIndex : 0;
+  header.rows = rows;
+  header.chars = column.bytes();
+  header.index_slots = index.size();
+  header.offsets_checksum = Checksum(column.offsets(), offsets_length);
+  header.index_checksum = Checksum(index.data(), index_length);
+  header.chars_checksum = Checksum(column.data(), column.bytes());
+
+  // Write a new file and rename it over the old one, so that readers which
+  // have the old table mapped keep it whole and a writer which dies halfway
+  // leaves the old table in place.
+  std::string temporary = std::string{path} + ".tmp";
+  int file = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                  0644);
+  if (file == -1) {
+    throw std::system_error(errno, std::generic_category(), temporary);
+  }
+  try {
+    // The offsets, index and chars go straight from memory to the file.
+    const char padding[8] = {};
+    OutputBatch out{file};
+    out << StringView{reinterpret_cast<const char*>(&header), sizeof(header)}
+        << StringView{reinterpret_cast<const char*>(column.offsets()),
+                      offsets_length}
+        << StringView{padding, OffsetsSize(rows) - offsets_length}
+        << StringView{reinterpret_cast<const char*>(index.data()),
+                      index_length}
+        << StringView{column.data(), column.bytes()};
+    out.flush();
+    // The data must be on disk before the rename is, or a crash could leave
+    // path naming a file with holes in it.
+    if (fsync(file) == -1) {
+      throw std::system_error(errno, std::generic_category(), temporary);
+    }
+  } catch (...) {
+    close(file);
+    unlink(temporary.c_str());
+    throw;
+  }
+  if (close(file) == -1 || rename(temporary.c_str(), path) == -1) {
+    int error = errno;
+    unlink(temporary.c_str());
+    throw std::system_error(error, std::generic_category(), path);
+  }
+}
+
+void write_string_table(const char* path, const std::vector<String>& strings,
+                        bool with_index) {
+  write_string_table(path, StringColumn{strings}, with_index);
+}
+
+StringTable::StringTable(const char* path, bool verify)
+    : file_(String::map_file(path)) {
+  // The const data(), which never copies the mapping.
+  const char* data = std::as_const(file_).data();
+  Size length = file_.length();
+  Header header;
+  if (length < sizeof(header)) Invalid(path, "too short for a string table");
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    Invalid(path, "not a string table");
+  }
+  if (header.version != kVersion) Invalid(path, "unsupported table version");
+  // Check each size against the file before adding them up, so that a huge
+  // one can't wrap around.
+  Size slots = header.index_slots;
+  bool has_index = (header.flags & kHasIndex) != 0;
+  if (header.rows > kMaxRows || header.chars > length ||
+      slots > length / sizeof(std::uint64_t) ||
+      (slots & (slots - 1)) != 0 || has_index != (slots != 0) ||
+      sizeof(header) + OffsetsSize(header.rows) +
+              slots * sizeof(std::uint64_t) + header.chars !=
+          length) {
+    Invalid(path, "table sections don't match the file");
+  }
+  size_ = header.rows;
+  offsets_ = reinterpret_cast<const std::uint32_t*>(data + sizeof(header));
+  index_ = has_index ? reinterpret_cast<const std::uint64_t*>(
+                           data + sizeof(header) + OffsetsSize(size_))
+                     : nullptr;
+  index_mask_ = slots - 1;
+  chars_ = data + sizeof(header) + OffsetsSize(size_) +
+           slots * sizeof(std::uint64_t);
+  if (offsets_[size_] != header.chars) {
+    Invalid(path, "table offsets don't match the chars");
+  }
+  if (!verify) return;
+  if (Checksum(offsets_, (size_ + 1) * sizeof(std::uint32_t)) !=
+          header.offsets_checksum ||
+      Checksum(index_, slots * sizeof(std::uint64_t)) !=
+          header.index_checksum ||
+      Checksum(chars_, header.chars) != header.chars_checksum) {
+    Invalid(path, "table checksum mismatch");
+  }
+  if (offsets_[0] != 0) Invalid(path, "table offsets out of order");
+  for (Size i = 0; i < size_; i++) {
+    if (offsets_[i] > offsets_[i + 1]) {
+      Invalid(path, "table offsets out of order");
+    }
+  }
+}
+
+Size StringTable::size() const { return size_; }
+
+StringView StringTable::operator[](Size i) const {
+  return StringView{chars_ + offsets_[i], offsets_[i + 1] - offsets_[i]};
+}
+
+bool StringTable::has_index() const { return index_ != nullptr; }
+
+Size StringTable::find(StringView key) const {
+  if (index_ == nullptr) {
+    for (Size row = 0; row < size_; row++) {
+      if ((*this)[row] == key) return row;
+    }
+    return kNotFound;
+  }
+  Size key_hash = hash(key);
+  // A valid index always has an empty slot, but an unverified one might not,
+  // so give up after looking at every slot.
+  for (Size i = key_hash & index_mask_, probes = 0; probes <= index_mask_;
+       i = (i + 1) & index_mask_, probes++) {
+    std::uint64_t slot = index_[i];
+    if (slot == 0) return kNotFound;
+    if (slot >> 32 != key_hash >> 32) continue;
+    Size row = (slot & UINT32_MAX) - 1;
+    if (row < size_ && (*this)[row] == key) return row;
+  }
+  return kNotFound;
+}
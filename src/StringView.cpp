@@ -0,0 +1,81 @@
+#include <cstring>
+#include <iostream>
+#include "../include/Simd.h"
+#include "../include/StringView.h"
+
+using Size = StringView::Size;
+
+// Constructs an empty view.
+// StringView foo;
+StringView::StringView() : data_(""), length_(0) {}
+
+// Constructs a view of a nul-terminated string, not including the nul.
+// StringView foo{"Hello!"};
+StringView::StringView(const char* c_str)
+    : data_(c_str), length_(std::strlen(c_str)) {}
+
+// Constructs a view of a fixed number of bytes from a buffer.
+// StringView foo{"Hello!", 6};
+StringView::StringView(const char* data, Size size)
+    : data_(data), length_(size) {}
+
+// Constructs a view of the whole of a string.
+// String foo{"Hello!"};
+// StringView bar{foo};
+StringView::StringView(const String& s)
+    : data_(s.data()), length_(s.length()) {}
+
+const char* StringView::data() const {
+  return data_;
+}
+
+Size StringView::length() const {
+  return length_;
+}
+
+// output v to a stream (eg. std::cout).
+std::ostream& operator<<(std::ostream& output, StringView v) {
+  output.write(v.data(), v.length());
+  return output;
+}
+
+// subview from start position to end. start must be <= v.length().
+StringView substring(StringView v, Size start) {
+  if (start > v.length()) {
+    return StringView();
+  }
+  return StringView(v.data() + start, v.length() - start);
+}
+
+// subview [start, start + length). subview indices must be fully inside v.
+StringView substring(StringView v, Size start, Size length) {
+  if (length > v.length() || start > v.length() - length) {
+    return StringView();
+  }
+  return StringView(v.data() + start, length);
+}
+
+int compare(StringView a, StringView b) {
+  Size common = a.length() < b.length() ? a.length() : b.length();
+  Size i = simd::mismatch(a.data(), b.data(), common);
+  if (i < common) {
+    auto x = static_cast<unsigned char>(a.data()[i]);
+    auto y = static_cast<unsigned char>(b.data()[i]);
+    return x < y ? -1 : 1;
+  }
+  if (a.length() == b.length()) return 0;
+  return a.length() < b.length() ? -1 : 1;
+}
+
+bool operator==(StringView a, StringView b) {
+  if (a.length() != b.length()) return false;
+  // Copies of a shared string have the same chars at the same address.
+  if (a.length() == 0 || a.data() == b.data()) return true;
+  return simd::mismatch(a.data(), b.data(), a.length()) == a.length();
+}
+
+bool operator!=(StringView a, StringView b) { return !(a == b); }
+bool operator<(StringView a, StringView b) { return compare(a, b) < 0; }
+bool operator<=(StringView a, StringView b) { return compare(a, b) <= 0; }
+bool operator>(StringView a, StringView b) { return compare(a, b) > 0; }
+bool operator>=(StringView a, StringView b) { return compare(a, b) >= 0; }
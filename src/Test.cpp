@@ -1,14 +1,46 @@
+#include "../include/Arena.h"
+#include "../include/Hash.h"
+#include "../include/Intern.h"
+#include "../include/KeywordMatcher.h"
+#include "../include/Number.h"
+#include "../include/Output.h"
+#include "../include/Parallel.h"
+#include "../include/Profile.h"
+#include "../include/Search.h"
+#include "../include/Simd.h"
+#include "../include/Sort.h"
+#include "../include/Split.h"
 #include "../include/String.h"
+#include "../include/StringBuilder.h"
+#include "../include/StringColumn.h"
+#include "../include/StringTable.h"
+#include "../include/StringView.h"
+#include "../include/Transform.h"
+#include "../include/Utf8.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <mutex>
+#include <random>
+#include <set>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <sstream>
+#include <stdexcept>
+#include <system_error>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace std::literals;
 
@@ -120,7 +152,8 @@ struct AssertEqual {
       [[maybe_unused]] const auto& internal_stream_result_ = assert_data.message
 
 // Replace the default new and delete with custom ones which track allocations.
-// This allows the code to catch accidental double-deletes or memory leaks.
+// This allows the code to catch accidental double-deletes or memory leaks. The
+// table is guarded by a mutex so that tests can allocate from several threads.
 struct Allocation {
   enum State {
     ACTIVE,
@@ -131,11 +164,13 @@ struct Allocation {
   State state;
 };
 
-constexpr std::size_t kMaxAllocations = 1024;
+constexpr std::size_t kMaxAllocations = 4096;
 std::size_t num_allocations = 0;
 std::size_t total_size = 0;
+std::size_t allocation_count = 0;
 Allocation allocations[kMaxAllocations];
 bool force_next_allocation_failure = false;
+std::mutex allocations_mutex;
 
 struct {
   bool raised = false;
@@ -143,7 +178,21 @@ struct {
   const char* message;
 } allocation_failure;
 
+// Freed allocations are kept (and their memory left poisoned) so that double
+// deletes can be detected. Once the table fills up, this returns the memory of
+// the freed ones to the system to make room for more.
+void ReclaimFreedAllocations() {
+  auto end = std::remove_if(
+      allocations, allocations + num_allocations, [](Allocation a) {
+        if (a.state != Allocation::FREED) return false;
+        std::free(a.address);
+        return true;
+      });
+  num_allocations = end - allocations;
+}
+
 void* operator new(std::size_t size) {
+  std::lock_guard<std::mutex> lock(allocations_mutex);
   if (force_next_allocation_failure) {
     force_next_allocation_failure = false;
     throw std::bad_alloc();
@@ -155,20 +204,22 @@ void* operator new(std::size_t size) {
   allocation.address = p;
   allocation.state = Allocation::ACTIVE;
   total_size += size;
+  allocation_count++;
   auto begin = allocations, end = allocations + num_allocations;
   auto i =
       std::find_if(begin, end, [&](Allocation a) { return a.address == p; });
   if (i != end) {
     *i = allocation;
-  } else if (num_allocations == kMaxAllocations) {
-    throw std::bad_alloc();
-  } else {
-    allocations[num_allocations++] = allocation;
+    return allocation.address;
   }
+  if (num_allocations == kMaxAllocations) ReclaimFreedAllocations();
+  if (num_allocations == kMaxAllocations) throw std::bad_alloc();
+  allocations[num_allocations++] = allocation;
   return allocation.address;
 }
 
 void DoDelete(void* p, std::size_t s, bool check_size) noexcept {
+  std::lock_guard<std::mutex> lock(allocations_mutex);
   auto begin = allocations, end = allocations + num_allocations;
   auto i =
       std::find_if(begin, end, [&](Allocation a) { return a.address == p; });
@@ -199,6 +250,14 @@ void DoDelete(void* p, std::size_t s, bool check_size) noexcept {
 void operator delete(void* p) noexcept { DoDelete(p, 0, false); }
 void operator delete(void* p, std::size_t s) noexcept { DoDelete(p, s, true); }
 
+// The array forms go through the ones above too. The standard library's
+// defaults already do, but a sanitizer's runtime replaces them with its own.
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete[](void* p) noexcept { DoDelete(p, 0, false); }
+void operator delete[](void* p, std::size_t s) noexcept {
+  DoDelete(p, s, true);
+}
+
 TEST(EmptyString) {
   String empty;
   ASSERT_EQ(empty.length(), 0);
@@ -229,13 +288,22 @@ TEST(StringCopy) {
 }
 
 TEST(StringMove) {
-  String foo{"foo"};
+  String foo{'x', 64};  // has to be long enough to force allocation.
   const char* data = foo.data();
   String moved = std::move(foo);
   ASSERT_EQ(moved.data(), data)
       << "String move should steal the existing buffer.";
 }
 
+TEST(ShortStringMove) {
+  String foo{"foo"};
+  String moved = std::move(foo);
+  ASSERT_EQ(moved.data(), "foo"sv);
+  ASSERT_EQ(moved.length(), 3);
+  ASSERT_EQ(foo.data()[foo.length()], '\0')
+      << "A moved-from string must still be valid.";
+}
+
 TEST(StringMoveWithFailedAllocation) {
   // We want to test that an allocation failure when trying to move-construct
   // string will leave the source string in a valid state. I can't think of any
@@ -252,10 +320,26 @@ TEST(StringMoveWithFailedAllocation) {
   } catch (const std::bad_alloc&) {
     had_exception = true;
   }
+  if (force_next_allocation_failure) {
+    // This can only happen if the implementation never invoked new. This is
+    // perfectly reasonable, so we can just skip the test in this case.
+    return;
+  }
   force_next_allocation_failure = false;
   ASSERT(had_exception) << "Whoops! The test isn't working properly :(";
 }
 
+TEST(VectorGrowthMovesStrings) {
+  std::vector<String> strings;
+  for (int i = 0; i < 100; i++) strings.emplace_back('x', 64);
+  // Growing the vector must move the strings into the new storage, not copy
+  // them, so the only allocation is for the storage itself.
+  auto before = allocation_count;
+  strings.reserve(strings.capacity() + 1);
+  ASSERT_EQ(allocation_count, before + 1)
+      << "Reallocating a vector of Strings should not copy them.";
+}
+
 TEST(CopyAssign) {
   String foo{"foo"};
   String bar;
@@ -295,7 +379,7 @@ TEST(CopyAssignWithFailedAllocation) {
 }
 
 TEST(MoveAssign) {
-  String foo{"foo"};
+  String foo{'x', 64};  // has to be long enough to force allocation.
   const char* data = foo.data();
   String bar;
   bar = std::move(foo);
@@ -355,6 +439,23 @@ const char y = 0;
 static_assert(!IsConst(&x));
 static_assert(IsConst(&y));
 
+// Literals have their length, and suffixes, worked out at compile time.
+constexpr StaticString kGreeting = "Hello, World!"_s;
+static_assert(kGreeting.length() == 13);
+static_assert(kGreeting.data()[7] == 'W');
+static_assert(IsConst(kGreeting.data()));
+static_assert(substring(kGreeting, 7).length() == 6);
+static_assert(substring(kGreeting, 7).data()[0] == 'W');
+static_assert(substring(kGreeting, 14).length() == 0);
+static_assert("a\0b"_s.length() == 3);
+static_assert(""_s.length() == 0);
+static_assert(std::is_trivially_copyable_v<StaticString>);
+static_assert(std::is_convertible_v<StaticString, String>);
+static_assert(std::is_convertible_v<StaticString, StringView>);
+
+// Constant-initialized, so no code runs to set it up at startup.
+const String kLongLiteral = "a literal much too long to be stored inline"_s;
+
 TEST(ConstAccess) {
   const String foo{"foo"};
   ASSERT(IsConst(foo.data()))
@@ -410,13 +511,2251 @@ TEST(SubstringWithZeros) {
 TEST(Concat) {
   String hello{"Hello, "};
   String world{"World!"};
-  ASSERT_EQ((hello + world).data(), "Hello, World!"sv);
+  ASSERT_EQ(String{hello + world}.data(), "Hello, World!"sv);
+}
+
+TEST(ChainedConcat) {
+  String a{"alpha "}, b{"beta "}, c{"gamma "}, d{"delta epsilon zeta"};
+  auto before = allocation_count;
+  String all = a + b + c + d;
+  ASSERT_EQ(allocation_count, before + 1)
+      << "A chain of + should allocate the result exactly once.";
+  ASSERT_EQ(all.data(), "alpha beta gamma delta epsilon zeta"sv);
+  ASSERT_EQ((a + b + c + d).length(), all.length());
+}
+
+TEST(ConcatWithLiteralsAndViews) {
+  String key{"user"};
+  String line{"id=42;name=joe"};
+  String joined = key + "[" + view(line, 3, 2) + "]=" + view(line, 11);
+  ASSERT_EQ(joined.data(), "user[42]=joe"sv);
+  String prefixed = "key:" + key;
+  ASSERT_EQ(prefixed.data(), "key:user"sv);
+}
+
+TEST(ConcatIntoSelf) {
+  String foo{"abcdefghijklmnop"};
+  foo = foo + foo;
+  ASSERT_EQ(foo.data(), "abcdefghijklmnopabcdefghijklmnop"sv);
+  foo = substring(foo, 30) + foo;
+  ASSERT_EQ(foo.length(), 34);
+}
+
+TEST(ConcatOutput) {
+  std::ostringstream output;
+  String hello{"Hello"};
+  output << hello + ", " + String{"World\0!", 7};
+  ASSERT_EQ(output.str(), "Hello, World\0!"sv);
 }
 
 TEST(ConcatWithZeros) {
   ASSERT_EQ((String('\0', 5) + String('\0', 5)).length(), 10);
 }
 
+TEST(ConcatMany) {
+  String directory{"/var/lib/service"}, name{"settings.backup"};
+  char separator = '/';
+  auto before = allocation_count;
+  String path = concat(directory, separator, view(name, 0, 8), ".txt");
+  auto after = allocation_count;
+  ASSERT_EQ(after, before + 1);
+  ASSERT_EQ(path.data(), "/var/lib/service/settings.txt"sv);
+  ASSERT_EQ(concat().length(), 0);
+  ASSERT_EQ(concat(name).data(), "settings.backup"sv);
+  ASSERT_EQ(concat('a', 'b', String{"c\0d", 3}, directory + "!").length(),
+            22);
+  String greeting = name + ',' + ' ' + "hi";
+  ASSERT_EQ(greeting.data(), "settings.backup, hi"sv);
+}
+
+TEST(Join) {
+  std::vector<String> words{"alpha", "beta", "a much longer gamma"};
+  auto before = allocation_count;
+  String joined = join(words, ", ");
+  auto after = allocation_count;
+  ASSERT_EQ(after, before + 1);
+  ASSERT_EQ(joined.data(), "alpha, beta, a much longer gamma"sv);
+  ASSERT_EQ(join(words, '|').data(), "alpha|beta|a much longer gamma"sv);
+  ASSERT_EQ(join(words, StringView{}).length(), 28);
+  ASSERT_EQ(join(std::vector<String>{}, ", ").length(), 0);
+  ASSERT_EQ(join(std::vector<String>{"one"}, ", ").data(), "one"sv);
+  std::vector<const char*> parts{"usr", "local", "bin"};
+  ASSERT_EQ(join(parts, '/').data(), "usr/local/bin"sv);
+  std::vector<StringView> fields{"a", "", "c"};
+  ASSERT_EQ(join(fields, String{","}).data(), "a,,c"sv);
+  ASSERT_EQ(join(std::string_view{"abc"}, '-').data(), "a-b-c"sv);
+}
+
+TEST(JoinManyFragments) {
+  std::vector<String> fragments;
+  for (int i = 0; i < 200; i++) fragments.emplace_back('a' + i % 26, 20);
+  auto before = allocation_count;
+  String joined = join(fragments, "");
+  auto after = allocation_count;
+  ASSERT_EQ(after, before + 1);
+  ASSERT_EQ(joined.length(), 4000);
+  ASSERT_EQ(view(joined, 3990, 10), StringView{"rrrrrrrrrr"});
+}
+
+TEST(ShortStringsDoNotAllocate) {
+  auto before = allocation_count;
+  String empty;
+  String filled{'a', 15};
+  String status{"404 Not Found"};
+  String key{"user-id", 7};
+  String copy{status};
+  String moved{std::move(copy)};
+  copy = key;
+  moved = std::move(filled);
+  String tail = substring(status, 4);
+  String middle = substring(status, 4, 3);
+  String joined = key + middle;
+  ASSERT_EQ(allocation_count, before)
+      << "Strings of up to 15 chars should be stored inline.";
+  ASSERT_EQ(empty.data(), ""sv);
+  ASSERT_EQ(moved.data(), "aaaaaaaaaaaaaaa"sv);
+  ASSERT_EQ(moved.data()[15], '\0');
+  ASSERT_EQ(copy.data(), "user-id"sv);
+  ASSERT_EQ(tail.data(), "Not Found"sv);
+  ASSERT_EQ(joined.data(), "user-idNot"sv);
+}
+
+TEST(LongStringsAllocate) {
+  auto before = allocation_count;
+  String long_string{'a', 16};
+  ASSERT_EQ(allocation_count, before + 1);
+  ASSERT_EQ(long_string.length(), 16);
+  ASSERT_EQ(long_string.data(), "aaaaaaaaaaaaaaaa"sv);
+}
+
+TEST(InlineToHeapTransitions) {
+  String small{"small"};
+  String large{"a string far too long to be stored inline"};
+  String temp = small;
+  small = large;
+  large = temp;
+  ASSERT_EQ(small.data(), "a string far too long to be stored inline"sv);
+  ASSERT_EQ(large.data(), "small"sv);
+  large = std::move(small);
+  ASSERT_EQ(large.length(), 41);
+  ASSERT_EQ((large + temp).length(), 46);
+}
+
+TEST(InlineStringsWithZeros) {
+  String zeros{'\0', 15};
+  ASSERT_EQ(zeros.length(), 15);
+  String copy{zeros};
+  ASSERT_EQ(copy.length(), 15);
+  ASSERT_EQ(substring(copy, 3, 4).length(), 4);
+}
+
+TEST(ViewOfString) {
+  String foo{"Nobody thinks that Joe is awesome."};
+  StringView bar = view(foo, 19);
+  ASSERT_EQ(bar, StringView{"Joe is awesome."});
+  ASSERT_EQ(bar.data(), foo.data() + 19) << "Views should not copy.";
+  ASSERT_EQ(view(foo, 19, 3), StringView{"Joe"});
+  ASSERT_EQ(view(foo).length(), foo.length());
+}
+
+TEST(ViewSubstringDoesNotAllocate) {
+  String line{'x', 200};
+  auto before = allocation_count;
+  StringView rest = view(line, 10);
+  StringView field = substring(rest, 5, 20);
+  StringView tail = substring(field, 15);
+  ASSERT_EQ(allocation_count, before);
+  ASSERT_EQ(field.length(), 20);
+  ASSERT_EQ(tail.length(), 5);
+  ASSERT_EQ(tail.data(), line.data() + 30);
+}
+
+TEST(ViewSubstringOutOfRange) {
+  StringView foo{"Hello"};
+  ASSERT_EQ(substring(foo, 6).length(), 0);
+  ASSERT_EQ(substring(foo, 5).length(), 0);
+  ASSERT_EQ(substring(foo, 1, 10).length(), 0);
+  ASSERT_EQ(substring(foo, 4, 2).length(), 0);
+  ASSERT_EQ(substring(foo, 4, 1), StringView{"o"});
+}
+
+TEST(ViewComparison) {
+  StringView apple{"apple"}, apples{"apples"}, banana{"banana"};
+  ASSERT(apple == StringView{"apple"});
+  ASSERT(apple != apples);
+  ASSERT(apple < apples) << "A proper prefix should order first.";
+  ASSERT(apples < banana);
+  ASSERT(banana > apple);
+  ASSERT(apple <= apple && apple >= apple);
+  ASSERT(StringView{} == StringView{""});
+}
+
+TEST(ViewComparisonWithZeros) {
+  StringView a{"ab\0c", 4}, b{"ab\0d", 4}, c{"ab", 2};
+  ASSERT(a != b) << "Comparison should look past embedded '\\0' chars.";
+  ASSERT(a < b);
+  ASSERT(c < a);
+}
+
+TEST(ViewOutput) {
+  std::ostringstream output;
+  auto text = "Hello\0World"sv;
+  output << substring(StringView{text.data(), text.length()}, 3, 5);
+  ASSERT_EQ(output.str(), "lo\0Wo"sv);
+}
+
+TEST(OwningCopyOfView) {
+  String foo{"key=value"};
+  String value{view(foo, 4)};
+  ASSERT_EQ(value.data(), "value"sv);
+  ASSERT(value.data() != foo.data() + 4) << "String should own its chars.";
+}
+
+// Runs body once for each instruction set this machine supports, restoring the
+// default selection afterwards.
+template <typename F> void ForEachIsa(F&& body) {
+  simd::Isa original = simd::selected();
+  for (auto isa : {simd::Isa::kScalar, simd::Isa::kSse2, simd::Isa::kAvx2}) {
+    if (isa > simd::detect()) break;
+    simd::select(isa);
+    try {
+      body(isa);
+    } catch (...) {
+      simd::select(original);
+      throw;
+    }
+  }
+  simd::select(original);
+}
+
+constexpr int kMaxAlignment = 64;
+constexpr int kMaxKernelLength = 3 * kMaxAlignment;
+
+TEST(SimdLengthAtEveryAlignment) {
+  ForEachIsa([](simd::Isa isa) {
+    alignas(kMaxAlignment) char buffer[2 * kMaxAlignment + kMaxKernelLength];
+    std::memset(buffer, 'x', sizeof(buffer));
+    for (int offset = 0; offset < kMaxAlignment; offset++) {
+      for (int length = 0; length < kMaxKernelLength; length++) {
+        buffer[offset + length] = '\0';
+        ASSERT_EQ(simd::length(buffer + offset), length)
+            << "isa " << static_cast<int>(isa) << ", offset " << offset;
+        buffer[offset + length] = 'x';
+      }
+    }
+  });
+}
+
+TEST(SimdFillAtEveryAlignment) {
+  ForEachIsa([](simd::Isa isa) {
+    alignas(kMaxAlignment) char buffer[2 * kMaxAlignment + kMaxKernelLength];
+    char expected[sizeof(buffer)];
+    for (int offset = 0; offset < kMaxAlignment; offset++) {
+      for (int length = 0; length < kMaxKernelLength; length++) {
+        std::memset(buffer, '.', sizeof(buffer));
+        std::memset(expected, '.', sizeof(expected));
+        std::memset(expected + offset, '#', length);
+        simd::fill(buffer + offset, '#', length);
+        ASSERT_EQ(std::string_view(buffer, sizeof(buffer)),
+                  std::string_view(expected, sizeof(expected)))
+            << "isa " << static_cast<int>(isa) << ", offset " << offset
+            << ", length " << length;
+      }
+    }
+  });
+}
+
+TEST(SimdCopyAtEveryAlignment) {
+  ForEachIsa([](simd::Isa isa) {
+    alignas(kMaxAlignment) char source[kMaxAlignment + kMaxKernelLength];
+    alignas(kMaxAlignment) char buffer[2 * kMaxAlignment + kMaxKernelLength];
+    char expected[sizeof(buffer)];
+    for (int i = 0; i < static_cast<int>(sizeof(source)); i++) {
+      source[i] = static_cast<char>('A' + i % 53);
+    }
+    for (int offset = 0; offset < kMaxAlignment; offset++) {
+      for (int length = 0; length < kMaxKernelLength; length++) {
+        // Vary the source alignment independently of the destination.
+        const char* in = source + (offset * 5) % kMaxAlignment;
+        std::memset(buffer, '.', sizeof(buffer));
+        std::memset(expected, '.', sizeof(expected));
+        std::memcpy(expected + offset, in, length);
+        simd::copy(buffer + offset, in, length);
+        ASSERT_EQ(std::string_view(buffer, sizeof(buffer)),
+                  std::string_view(expected, sizeof(expected)))
+            << "isa " << static_cast<int>(isa) << ", offset " << offset
+            << ", length " << length;
+      }
+    }
+  });
+}
+
+TEST(SimdMismatchAtEveryPosition) {
+  ForEachIsa([](simd::Isa isa) {
+    char a[kMaxKernelLength], b[kMaxKernelLength];
+    for (int i = 0; i < kMaxKernelLength; i++) a[i] = b[i] = 'a' + i % 26;
+    int errors = 0;
+    for (int length = 0; length < kMaxKernelLength; length++) {
+      if (simd::mismatch(a, b, length) != simd::Size(length)) errors++;
+      for (int position = 0; position < length; position++) {
+        b[position] = '\0';
+        if (simd::mismatch(a, b, length) != simd::Size(position)) errors++;
+        b[position] = a[position];
+      }
+    }
+    ASSERT_EQ(errors, 0) << "isa " << static_cast<int>(isa);
+  });
+}
+
+TEST(SimdMatchMaskAtEveryLength) {
+  ForEachIsa([](simd::Isa isa) {
+    char text[kMaxKernelLength];
+    for (int i = 0; i < kMaxKernelLength; i++) text[i] = i % 3 ? 'a' : ',';
+    int errors = 0;
+    for (int offset = 0; offset < 3; offset++) {
+      for (int length = 0; length < kMaxKernelLength - offset; length++) {
+        std::uint64_t expected = 0;
+        for (int i = 0; i < length && i < 64; i++) {
+          expected |= std::uint64_t{text[offset + i] == ','} << i;
+        }
+        if (simd::match_mask(text + offset, length, ',') != expected) {
+          errors++;
+        }
+      }
+    }
+    ASSERT_EQ(errors, 0) << "isa " << static_cast<int>(isa);
+  });
+  // Windows of 64 bytes or more fill the whole mask on the SSE2 path, which
+  // leaves no tail to add after its 16-byte blocks.
+  if (simd::detect() < simd::Isa::kSse2) return;
+  simd::Isa original = simd::selected();
+  simd::select(simd::Isa::kSse2);
+  char text[100];
+  std::memset(text, 'a', sizeof(text));
+  text[0] = text[63] = text[64] = ',';
+  std::uint64_t expected = 1 | std::uint64_t{1} << 63;
+  std::uint64_t at_64 = simd::match_mask(text, 64, ',');
+  std::uint64_t at_100 = simd::match_mask(text, 100, ',');
+  simd::select(original);
+  ASSERT_EQ(at_64, expected);
+  ASSERT_EQ(at_100, expected);
+}
+
+TEST(ConstructorsAtEveryLength) {
+  ForEachIsa([](simd::Isa isa) {
+    char text[kMaxKernelLength + 1];
+    for (int i = 0; i < kMaxKernelLength; i++) text[i] = 'a' + i % 26;
+    for (int length = 0; length < kMaxKernelLength; length++) {
+      text[length] = '\0';
+      std::string_view expected{text, static_cast<std::size_t>(length)};
+      String from_c_str{text};
+      String from_buffer{text, static_cast<String::Size>(length)};
+      String copy{from_buffer};
+      String filled{'z', static_cast<String::Size>(length)};
+      String joined = from_c_str + copy;
+      ASSERT_EQ(from_c_str.data(), expected) << "isa " << static_cast<int>(isa);
+      ASSERT_EQ(from_buffer.data(), expected);
+      ASSERT_EQ(copy.data(), expected);
+      ASSERT_EQ(filled.data(), std::string(length, 'z'));
+      ASSERT_EQ(joined.length(), 2 * from_c_str.length());
+      ASSERT_EQ(substring(joined, length).data(), expected);
+      text[length] = 'a' + length % 26;
+    }
+  });
+}
+
+TEST(FindChar) {
+  String foo{"one two one"};
+  ASSERT_EQ(find(foo, 'o'), 0);
+  ASSERT_EQ(find(foo, 'o', 1), 6);
+  ASSERT_EQ(find(foo, 'x'), kNotFound);
+  ASSERT_EQ(find(foo, 'e', 11), kNotFound);
+  ASSERT_EQ(rfind(foo, 'o'), 8);
+  ASSERT_EQ(rfind(foo, 'x'), kNotFound);
+  ASSERT_EQ(count(foo, 'o'), 3);
+  ASSERT(contains(foo, 'w'));
+  ASSERT(!contains(foo, 'z'));
+}
+
+TEST(FindSubstring) {
+  String foo{"one two one"};
+  ASSERT_EQ(find(foo, "one"), 0);
+  ASSERT_EQ(find(foo, "one", 1), 8);
+  ASSERT_EQ(find(foo, "three"), kNotFound);
+  ASSERT_EQ(find(foo, ""), 0);
+  ASSERT_EQ(find(foo, "", 11), 11);
+  ASSERT_EQ(find(foo, "", 12), kNotFound);
+  ASSERT_EQ(rfind(foo, "one"), 8);
+  ASSERT_EQ(rfind(foo, ""), 11);
+  ASSERT_EQ(count(String{"aaaaa"}, "aa"), 2) << "Counts don't overlap.";
+  ASSERT_EQ(count(foo, ""), 12);
+  ASSERT(contains(view(foo, 2, 5), "e tw"));
+  ASSERT(!contains(view(foo, 2, 5), "one"));
+}
+
+TEST(FindWithZeros) {
+  auto text = "ab\0cd\0\0ef\0cd"sv;
+  String foo{text.data(), text.length()};
+  ASSERT_EQ(find(foo, '\0'), 2);
+  ASSERT_EQ(rfind(foo, '\0'), 9);
+  ASSERT_EQ(count(foo, '\0'), 4);
+  ASSERT_EQ(find(foo, StringView{"\0cd", 3}), 2);
+  ASSERT_EQ(rfind(foo, StringView{"\0cd", 3}), 9);
+  ASSERT_EQ(find(foo, StringView{"\0\0", 2}), 5);
+  ASSERT_EQ(find(foo, "cd", 4), 10) << "Search should go past '\\0' chars.";
+}
+
+TEST(FindLongNeedle) {
+  String needle = String{'a', 40} + "b";
+  String haystack = String{'a', 1000} + "b" + String{'a', 50} + "b";
+  ASSERT_EQ(find(haystack, needle), 960);
+  ASSERT_EQ(rfind(haystack, needle), 1011);
+  ASSERT_EQ(count(haystack, needle), 2);
+  ASSERT_EQ(find(haystack, String{'a', 51}), 0);
+  ASSERT_EQ(rfind(haystack, String{'a', 51}), 949);
+  ASSERT_EQ(rfind(haystack, String{'a', 50}), 1001);
+  ASSERT_EQ(find(haystack, String{needle + "c"}), kNotFound);
+}
+
+// Compares find, rfind and count against std::string_view on random strings
+// made of a small alphabet (including '\0'), so that partial matches are
+// common and every code path gets exercised.
+TEST(SearchMatchesStandardLibrary) {
+  std::mt19937 random(42);
+  constexpr char kAlphabet[] = {'a', 'b', '\0'};
+  auto random_text = [&](std::size_t length, int letters) {
+    std::string text(length, ' ');
+    for (char& c : text) c = kAlphabet[random() % letters];
+    return text;
+  };
+  ForEachIsa([&](simd::Isa isa) {
+    for (int round = 0; round < 300; round++) {
+      int letters = 1 + round % 3;
+      std::string haystack = random_text(random() % 300, letters);
+      std::string needle = random_text(1 + random() % 70, letters);
+      if (round % 4 == 0 && needle.length() < haystack.length()) {
+        // Make sure there is at least one match.
+        auto start = random() % (haystack.length() - needle.length());
+        needle = haystack.substr(start, needle.length());
+      }
+      std::string_view h = haystack, n = needle;
+      StringView sh{h.data(), h.length()}, sn{n.data(), n.length()};
+      auto expected = [](std::size_t i) {
+        return i == std::string_view::npos ? kNotFound : i;
+      };
+      std::size_t start = random() % (h.length() + 1);
+      ASSERT_EQ(find(sh, sn, start), expected(h.find(n, start)))
+          << "isa " << static_cast<int>(isa) << ", needle " << n.length();
+      ASSERT_EQ(rfind(sh, sn), expected(h.rfind(n)))
+          << "isa " << static_cast<int>(isa) << ", needle " << n.length();
+      ASSERT_EQ(find(sh, n[0], start), expected(h.find(n[0], start)));
+      ASSERT_EQ(rfind(sh, n[0]), expected(h.rfind(n[0])));
+      ASSERT_EQ(count(sh, n[0]),
+                static_cast<StringView::Size>(
+                    std::count(h.begin(), h.end(), n[0])));
+      StringView::Size matches = 0;
+      for (auto i = h.find(n); i != std::string_view::npos;
+           i = h.find(n, i + n.length())) {
+        matches++;
+      }
+      ASSERT_EQ(count(sh, sn), matches) << "needle " << n.length();
+    }
+  });
+}
+
+// A memory resource which forwards to the global heap and keeps track of how
+// many bytes it has outstanding, so tests can check that buffers are returned
+// to the resource they came from.
+class CountingResource : public std::pmr::memory_resource {
+ public:
+  std::size_t live_bytes = 0;
+
+ private:
+  void* do_allocate(std::size_t bytes, std::size_t) override {
+    live_bytes += bytes;
+    return ::operator new(bytes);
+  }
+  void do_deallocate(void* p, std::size_t bytes, std::size_t) override {
+    live_bytes -= bytes;
+    ::operator delete(p, bytes);
+  }
+  bool do_is_equal(const memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+};
+
+TEST(StringFromResource) {
+  CountingResource resource;
+  {
+    String foo{"a string too long to be stored inline", &resource};
+    ASSERT_EQ(foo.data(), "a string too long to be stored inline"sv);
+    ASSERT_EQ(foo.length(), 37);
+    ASSERT(foo.resource() == &resource);
+    ASSERT(resource.live_bytes > foo.length());
+    String short_string{"short", &resource};
+    ASSERT(short_string.resource() == nullptr)
+        << "Inline strings don't need a resource.";
+  }
+  ASSERT_EQ(resource.live_bytes, 0);
+}
+
+TEST(CopyFromResourceUsesGlobalHeap) {
+  CountingResource resource;
+  String foo{'x', 100, &resource};
+  String copy{foo};
+  ASSERT(copy.resource() == nullptr);
+  String copy_in_resource{copy, &resource};
+  ASSERT(copy_in_resource.resource() == &resource);
+  String assigned;
+  assigned = copy_in_resource;
+  ASSERT(assigned.resource() == nullptr);
+  ASSERT_EQ(assigned.data(), std::string(100, 'x'));
+}
+
+TEST(MoveBetweenResources) {
+  CountingResource first, second;
+  {
+    String a{'a', 100, &first};
+    String b{'b', 200, &second};
+    String c{'c', 300};
+    a = std::move(b);
+    ASSERT(a.resource() == &second);
+    String d{std::move(a)};
+    ASSERT(d.resource() == &second);
+    c = std::move(d);
+    ASSERT_EQ(c.length(), 200);
+    ASSERT_EQ(c.data()[0], 'b');
+    String e = String{'e', 64, &first} + c;
+    ASSERT(e.resource() == nullptr);
+    String f{e + "!", &first};
+    ASSERT(f.resource() == &first);
+  }
+  ASSERT_EQ(first.live_bytes, 0) << "Buffers should go back where they came "
+                                    "from, even after being moved.";
+  ASSERT_EQ(second.live_bytes, 0);
+}
+
+TEST(ArenaDoesNotUseGlobalHeapPerString) {
+  Arena arena;
+  auto before = allocation_count;
+  for (int i = 0; i < 50; i++) {
+    String foo{'a', 40, &arena};
+    String bar = foo + foo;
+    String baz{bar + foo, &arena};
+    ASSERT_EQ(baz.length(), 120);
+  }
+  ASSERT_EQ(allocation_count, before + 50 + 1)
+      << "Only the non-arena concatenations and the arena's one block should "
+         "touch the global heap.";
+  ASSERT_EQ(arena.bytes_used(), 50 * (2 * sizeof(void*) + 41 + 121));
+}
+
+TEST(ArenaRelease) {
+  Arena arena{256};
+  {
+    String big{'x', 1000, &arena};  // bigger than a block.
+    String small{'y', 20, &arena};
+    ASSERT_EQ(big.data()[999], 'x');
+    ASSERT_EQ(small.data(), std::string(20, 'y'));
+  }
+  ASSERT(arena.bytes_used() > 1020);
+  arena.release();
+  ASSERT_EQ(arena.bytes_used(), 0);
+  String again{'z', 30, &arena};
+  ASSERT_EQ(again.data(), std::string(30, 'z'));
+}
+
+TEST(ArenaAlignment) {
+  Arena arena{128};
+  for (std::size_t alignment : {1, 2, 8, 16, 64}) {
+    void* p = arena.allocate(3, alignment);
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(p) % alignment, 0u);
+  }
+}
+
+TEST(ProfileCountsAllocations) {
+  auto before = profile::snapshot();
+  {
+    String short_string{"short"};
+    String filled{'x', 100};
+    String text{"a string too long to be stored inline"};
+    String copy{filled};
+    String assigned;
+    assigned = text;
+    String tail = substring(text, 2);
+    String joined = filled + text;
+    auto during = profile::difference(profile::snapshot(), before);
+    ASSERT_EQ(during.allocations, 6);
+    ASSERT_EQ(during.deallocations, 0);
+    ASSERT_EQ(during.live_bytes - before.live_bytes,
+              101 + 38 + 101 + 38 + 36 + 138);
+    ASSERT_EQ(during[profile::Operation::kFill].allocations, 1);
+    ASSERT_EQ(during[profile::Operation::kFill].bytes, 101);
+    ASSERT_EQ(during[profile::Operation::kCString].allocations, 1);
+    ASSERT_EQ(during[profile::Operation::kCopy].allocations, 1);
+    ASSERT_EQ(during[profile::Operation::kCopyAssign].allocations, 1);
+    ASSERT_EQ(during[profile::Operation::kSubstring].allocations, 1);
+    ASSERT_EQ(during[profile::Operation::kConcat].allocations, 1);
+    ASSERT_EQ(during[profile::Operation::kConcat].bytes, 138);
+    ASSERT_EQ(during.histogram[profile::bucket(101)], 2);
+    ASSERT_EQ(during.histogram[profile::bucket(138)], 1);
+  }
+  auto after = profile::difference(profile::snapshot(), before);
+  ASSERT_EQ(after.deallocations, 6);
+  ASSERT_EQ(after.live_bytes, before.live_bytes);
+}
+
+TEST(ProfileHistogramBuckets) {
+  ASSERT_EQ(profile::bucket(1), 0);
+  ASSERT_EQ(profile::bucket(2), 1);
+  ASSERT_EQ(profile::bucket(3), 1);
+  ASSERT_EQ(profile::bucket(16), 4);
+  ASSERT_EQ(profile::bucket(4095), 11);
+  ASSERT_EQ(profile::bucket(~0ull), 63);
+  ASSERT_EQ(profile::name(profile::Operation::kCopyAssign), "copy_assign"sv);
+}
+
+TEST(ProfileScope) {
+  auto before = profile::snapshot();
+  {
+    profile::Scope scope{profile::Operation::kOther};
+    String foo{'x', 50};
+    {
+      profile::Scope inner{profile::Operation::kSubstring};
+      String bar{'y', 50};
+    }
+    String baz{'z', 50};
+  }
+  String qux{'w', 50};
+  auto after = profile::difference(profile::snapshot(), before);
+  ASSERT_EQ(after[profile::Operation::kOther].allocations, 2);
+  ASSERT_EQ(after[profile::Operation::kSubstring].allocations, 1);
+  ASSERT_EQ(after[profile::Operation::kFill].allocations, 1);
+}
+
+TEST(ProfileMergesThreads) {
+  constexpr int kThreads = 4, kStringsPerThread = 100;
+  auto before = profile::snapshot();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([] {
+      for (int j = 0; j < kStringsPerThread; j++) {
+        String foo{'x', 20 + static_cast<String::Size>(j)};
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  auto after = profile::difference(profile::snapshot(), before);
+  ASSERT_EQ(after.allocations, kThreads * kStringsPerThread)
+      << "Counts from threads which have exited should be kept.";
+  ASSERT_EQ(after.deallocations, kThreads * kStringsPerThread);
+  ASSERT_EQ(after[profile::Operation::kFill].allocations,
+            kThreads * kStringsPerThread);
+  ASSERT_EQ(after.live_bytes, before.live_bytes);
+}
+
+TEST(ProfileFreeOnAnotherThread) {
+  auto before = profile::snapshot();
+  String* foo = new String{'x', 1000};
+  std::thread([foo] { delete foo; }).join();
+  auto after = profile::difference(profile::snapshot(), before);
+  ASSERT_EQ(after.allocations, 1);
+  ASSERT_EQ(after.deallocations, 1);
+  ASSERT_EQ(after.live_bytes, before.live_bytes);
+}
+
+TEST(SharedCopiesDoNotAllocate) {
+  String config{'c', 1000};
+  config.share();
+  const String& shared = config;
+  auto before = allocation_count;
+  String copy{shared};
+  String assigned;
+  assigned = copy;
+  std::vector<String> copies(10, shared);
+  ASSERT_EQ(allocation_count, before + 1)
+      << "Only the vector's own storage should be allocated.";
+  ASSERT_EQ(static_cast<const String&>(copy).data(), shared.data());
+  ASSERT_EQ(static_cast<const String&>(assigned).data(), shared.data());
+  ASSERT_EQ(shared.share_count(), 13);
+  copies.clear();
+  ASSERT_EQ(shared.share_count(), 3);
+}
+
+TEST(ShareShortStringDoesNothing) {
+  String foo{"short"};
+  foo.share();
+  String copy{foo};
+  ASSERT_EQ(foo.share_count(), 1);
+  ASSERT_EQ(copy.data(), "short"sv);
+}
+
+TEST(WriteToSharedStringCopies) {
+  String original{"a string too long to be stored inline"};
+  original.share();
+  String copy{original};
+  const char* shared_data = static_cast<const String&>(original).data();
+  char* writable = copy.data();
+  ASSERT(writable != shared_data) << "Writing must not affect other strings.";
+  writable[0] = 'A';
+  ASSERT_EQ(copy.data(), "A string too long to be stored inline"sv);
+  ASSERT_EQ(original.share_count(), 1);
+  ASSERT_EQ(static_cast<const String&>(original).data(),
+            "a string too long to be stored inline"sv);
+  String again{original};
+  ASSERT_EQ(again.share_count(), 2) << "original should still be shareable.";
+}
+
+TEST(MoveSharedString) {
+  String foo{'f', 100};
+  foo.share();
+  String copy = foo;
+  String moved = std::move(foo);
+  ASSERT_EQ(moved.share_count(), 2);
+  copy = std::move(moved);
+  ASSERT_EQ(copy.share_count(), 2);
+  ASSERT_EQ(copy.length(), 100);
+}
+
+TEST(SharedStringFromResource) {
+  CountingResource resource;
+  {
+    String foo{'r', 200, &resource};
+    foo.share();
+    String copy{foo};
+    ASSERT(copy.resource() == &resource);
+    ASSERT_EQ(foo.share_count(), 2);
+    copy.data()[0] = 'R';
+    ASSERT(copy.resource() == &resource)
+        << "A private copy should come from the same resource.";
+  }
+  ASSERT_EQ(resource.live_bytes, 0);
+}
+
+TEST(SharedCopiesAcrossThreads) {
+  constexpr int kThreads = 8, kCopiesPerThread = 2000;
+  String config{'x', 4096};
+  config.share();
+  const String& shared = config;
+  std::vector<std::thread> threads;
+  std::vector<int> mismatches(kThreads, 0);
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&shared, &mismatches, i] {
+      for (int j = 0; j < kCopiesPerThread; j++) {
+        String copy{shared};
+        String second = copy;
+        copy = String();
+        if (static_cast<const String&>(second).data() != shared.data()) {
+          mismatches[i]++;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  for (int count : mismatches) ASSERT_EQ(count, 0);
+  ASSERT_EQ(shared.share_count(), 1)
+      << "Every copy made on another thread should have been released.";
+}
+
+TEST(InternSameStringSameHandle) {
+  InternPool pool;
+  String field{"a_field_name_long_enough_for_the_heap"};
+  InternPool::Handle a = pool.intern(field);
+  InternPool::Handle b = pool.intern(String{field}.data());
+  ASSERT(a == b);
+  ASSERT(a.data() != field.data()) << "The pool should keep its own copy.";
+  ASSERT_EQ(a.view(), StringView{field});
+  ASSERT_EQ(a.data()[a.length()], '\0');
+  ASSERT_EQ(pool.size(), 1);
+}
+
+TEST(InternDistinctStrings) {
+  InternPool pool;
+  InternPool::Handle a = pool.intern("one");
+  InternPool::Handle b = pool.intern("two");
+  InternPool::Handle c = pool.intern(StringView{"one\0", 4});
+  InternPool::Handle empty = pool.intern("");
+  ASSERT(a != b);
+  ASSERT(a != c) << "Embedded zeros are part of the string.";
+  ASSERT(empty != InternPool::Handle{})
+      << "The empty string is not the null handle.";
+  ASSERT_EQ(empty.length(), 0);
+  ASSERT_EQ(pool.size(), 4);
+}
+
+TEST(InternFind) {
+  InternPool pool;
+  ASSERT(!pool.find("missing"));
+  InternPool::Handle added = pool.intern("present");
+  ASSERT(pool.find("present") == added);
+  ASSERT(!pool.find("missing"));
+  ASSERT_EQ(pool.size(), 1) << "find() should never add to the pool.";
+  InternPool::Handle null;
+  ASSERT_EQ(null.view(), StringView{});
+  ASSERT_EQ(null.hash(), 0);
+}
+
+TEST(InternManyStrings) {
+  constexpr int kCount = 20000;
+  InternPool pool;
+  std::vector<InternPool::Handle> handles;
+  for (int i = 0; i < kCount; i++) {
+    handles.push_back(pool.intern(String{std::to_string(i).c_str()}));
+  }
+  ASSERT_EQ(pool.size(), kCount);
+  int mismatches = 0;
+  for (int i = 0; i < kCount; i++) {
+    std::string expected = std::to_string(i);
+    if (pool.intern(expected.c_str()) != handles[i] ||
+        handles[i].view() != StringView{expected.c_str()}) {
+      mismatches++;
+    }
+  }
+  ASSERT_EQ(mismatches, 0);
+  ASSERT_EQ(pool.size(), kCount);
+}
+
+TEST(InternDoesNotAllocatePerString) {
+  // Few enough to stay within the allocation tracker's table.
+  std::vector<String> values;
+  for (int i = 0; i < 500; i++) {
+    values.push_back(String{'a', static_cast<String::Size>(i % 200 + 16)} +
+                     std::to_string(i).c_str());
+  }
+  InternPool pool;
+  auto before = allocation_count;
+  for (const String& value : values) pool.intern(value);
+  // Each shard takes its first slab here, and some tables grow.
+  ASSERT(allocation_count - before < values.size() / 4)
+      << "Only new slabs and tables should allocate, but there were "
+      << (allocation_count - before) << " allocations.";
+}
+
+TEST(InternHandlesAsKeys) {
+  InternPool pool;
+  std::unordered_map<InternPool::Handle, int> counts;
+  for (const char* word : {"a", "b", "a", "c", "a", "b"}) {
+    counts[pool.intern(word)]++;
+  }
+  ASSERT_EQ(counts.size(), 3);
+  ASSERT_EQ(counts[pool.intern("a")], 3);
+  ASSERT_EQ(pool.intern("a").hash(), pool.find("a").hash());
+}
+
+TEST(InternFromManyThreads) {
+  constexpr int kThreads = 8, kStrings = 2000;
+  InternPool pool;
+  std::vector<std::vector<InternPool::Handle>> handles(
+      kThreads, std::vector<InternPool::Handle>(kStrings));
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&pool, &handles, i] {
+      // Each thread interns the same strings, in a different order.
+      for (int j = 0; j < kStrings; j++) {
+        int k = (j * 7 + i * 131) % kStrings;
+        std::string value = "identifier_" + std::to_string(k);
+        handles[i][k] = pool.intern(value.c_str());
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  ASSERT_EQ(pool.size(), kStrings);
+  int mismatches = 0;
+  for (int i = 1; i < kThreads; i++) {
+    if (handles[i] != handles[0]) mismatches++;
+  }
+  ASSERT_EQ(mismatches, 0);
+}
+
+TEST(StringComparison) {
+  String apple{"apple"}, banana{"banana"};
+  String long_apple{"apple, and a few words to put it on the heap"};
+  ASSERT(apple == String{"apple"});
+  ASSERT(apple == "apple" && "apple" == apple);
+  ASSERT(apple != banana);
+  ASSERT(apple < banana && banana > apple);
+  ASSERT(apple < long_apple) << "A proper prefix should order first.";
+  ASSERT(compare(apple, banana) < 0);
+  ASSERT(compare(banana, apple) > 0);
+  ASSERT(compare(long_apple, String{long_apple}) == 0);
+  ASSERT(compare(String{"\xff"}, String{"a"}) > 0)
+      << "Chars should compare as unsigned.";
+}
+
+TEST(StringComparisonWithZeros) {
+  String a{"key\0one", 7}, b{"key\0two", 7};
+  ASSERT(a != b);
+  ASSERT(a < b);
+  ASSERT(String{"key"} < a);
+  ASSERT(a != "key") << "A nul-terminated string stops at the first '\\0'.";
+}
+
+TEST(StringsAsOrderedKeys) {
+  std::set<String> words;
+  for (const char* word : {"pear", "apple", "fig", "apple", "banana"}) {
+    words.insert(String{word});
+  }
+  std::vector<std::string> sorted;
+  for (const String& word : words) sorted.push_back(word.data());
+  ASSERT(sorted == (std::vector<std::string>{"apple", "banana", "fig",
+                                              "pear"}));
+}
+
+TEST(HashIgnoresStorage) {
+  Arena arena;
+  for (String::Size length : {0, 1, 3, 4, 8, 15, 16, 17, 48, 49, 100, 1000}) {
+    String inline_or_heap{'q', length};
+    String from_arena{inline_or_heap, &arena};
+    String shared{inline_or_heap};
+    shared.share();
+    auto expected = hash(view(inline_or_heap));
+    ASSERT_EQ(inline_or_heap.hash(), expected) << "length " << length;
+    ASSERT_EQ(from_arena.hash(), expected) << "length " << length;
+    ASSERT_EQ(shared.hash(), expected) << "length " << length;
+    ASSERT_EQ(std::hash<String>{}(shared), expected) << "length " << length;
+    ASSERT_EQ(String{shared}.hash(), expected) << "length " << length;
+  }
+}
+
+TEST(HashSeesEveryByte) {
+  // Changing any one byte of strings of every length up to 100 should change
+  // the hash.
+  char buffer[100];
+  for (int i = 0; i < 100; i++) buffer[i] = 'a' + i % 26;
+  int collisions = 0;
+  std::set<String::Size> prefix_hashes;
+  for (int length = 0; length <= 100; length++) {
+    auto original = hash(StringView{buffer, String::Size(length)});
+    prefix_hashes.insert(original);
+    for (int position = 0; position < length; position++) {
+      buffer[position] ^= 1;
+      if (hash(StringView{buffer, String::Size(length)}) == original) {
+        collisions++;
+      }
+      buffer[position] ^= 1;
+    }
+  }
+  ASSERT_EQ(collisions, 0);
+  ASSERT_EQ(prefix_hashes.size(), 101) << "Prefixes should hash differently.";
+  ASSERT(hash(StringView{"\0", 1}) != hash(StringView{}))
+      << "A '\\0' char should count towards the hash.";
+}
+
+TEST(StringsAsUnorderedKeys) {
+  const char* long_word = "a word long enough to be on the heap";
+  std::unordered_map<String, int> counts;
+  for (const char* word : {"one", "two", "one", long_word, "one", long_word}) {
+    counts[String{word}]++;
+  }
+  ASSERT_EQ(counts.size(), 3);
+  ASSERT_EQ(counts[String{"one"}], 3);
+  ASSERT_EQ(counts[String{long_word}], 2);
+  ASSERT_EQ(std::hash<StringView>{}("one"), String{"one"}.hash());
+}
+
+TEST(AppendWithinInlineCapacity) {
+  String foo{"Hello"};
+  ASSERT_EQ(foo.capacity(), 15);
+  foo.push_back(',');
+  foo.append(" you", 4);
+  ASSERT_EQ(foo.data(), "Hello, you"sv);
+  ASSERT_EQ(foo.length(), 10);
+}
+
+TEST(AppendGrowsGeometrically) {
+  std::string expected;
+  for (int i = 0; i < 10000; i++) expected.push_back('a' + i % 26);
+  auto before = allocation_count;
+  String foo;
+  for (char c : expected) foo.push_back(c);
+  auto allocations = allocation_count - before;
+  ASSERT_EQ(std::string_view(foo.data(), foo.length()), expected);
+  ASSERT_EQ(foo.data()[foo.length()], '\0');
+  ASSERT(foo.capacity() >= foo.length());
+  ASSERT(allocations < 20) << "10000 push_backs made " << allocations
+                           << " allocations; growth should be geometric.";
+}
+
+TEST(AppendStrings) {
+  String foo{"key"};
+  foo.append(String{"="});
+  foo.append(String{"a value which is too long to be stored inline"});
+  ASSERT_EQ(foo.data(), "key=a value which is too long to be stored inline"sv);
+  String zeros;
+  zeros.append("a\0b", 3);
+  ASSERT_EQ(std::string_view(zeros.data(), zeros.length()), "a\0b"sv);
+}
+
+TEST(AppendToItself) {
+  String foo{"abcdefghij"};
+  foo.append(foo);
+  ASSERT_EQ(foo.data(), "abcdefghijabcdefghij"sv);
+  foo.append(foo);
+  ASSERT_EQ(foo.data(), "abcdefghijabcdefghijabcdefghijabcdefghij"sv);
+  foo.reserve(1000);
+  foo.append(foo.data() + 5, 5);
+  ASSERT_EQ(foo.length(), 45);
+  ASSERT_EQ(view(foo, 40), StringView{"fghij"});
+}
+
+TEST(Reserve) {
+  String foo{"a string long enough to be on the heap"};
+  foo.reserve(10);
+  ASSERT_EQ(foo.capacity(), foo.length()) << "reserve() should never shrink.";
+  foo.reserve(1000);
+  ASSERT(foo.capacity() >= 1000);
+  ASSERT_EQ(foo.data(), "a string long enough to be on the heap"sv);
+  auto before = allocation_count;
+  const char* data = foo.data();
+  for (int i = 0; i < 900; i++) foo.push_back('!');
+  ASSERT_EQ(allocation_count, before) << "Reserved room shouldn't reallocate.";
+  ASSERT(foo.data() == data);
+  String copy{foo};
+  ASSERT_EQ(copy.capacity(), copy.length()) << "Copies should fit exactly.";
+}
+
+TEST(AppendKeepsResource) {
+  Arena arena;
+  String foo{"a string long enough to be on the heap", &arena};
+  foo.append(" and then some more", 19);
+  ASSERT(foo.resource() == &arena);
+  auto before = allocation_count;
+  for (int i = 0; i < 1000; i++) foo.push_back('.');
+  ASSERT(foo.resource() == &arena);
+  ASSERT(allocation_count - before <= 1)
+      << "Growing should use the arena, not the global heap.";
+}
+
+TEST(TruncateAndRemovePrefix) {
+  CountingResource resource;
+  {
+    // Every kind of buffer which can shrink in place, and a shared one which
+    // can't.
+    String exact{"an exact-fit buffer, allocated for these chars", &resource};
+    String growable{"a growable buffer", &resource};
+    growable.append(", with more appended to it", 26);
+    String small{"inline"};
+    String shared{"a shared buffer, which must be copied first"};
+    shared.share();
+    String other = shared;
+    for (String* s : {&exact, &growable, &small, &shared}) {
+      String::Size length = s->length();
+      std::string expected{s->data() + 2, length - 5};
+      const char* buffer = s->data();
+      s->truncate(length - 3);
+      s->truncate(length);
+      s->remove_prefix(2);
+      ASSERT_EQ(std::string_view(s->data(), s->length()), expected);
+      ASSERT_EQ(s->data()[s->length()], '\0');
+      if (s != &shared) {
+        ASSERT(s->data() == buffer);
+      }
+    }
+    ASSERT_EQ(other.length(), 43) << "Other copies keep the whole buffer.";
+    // Trimmed by more than fits in one byte, then by one more char, so both
+    // ways of recording the spare room are used.
+    exact.truncate(3);
+    exact.truncate(2);
+    ASSERT_EQ(exact.data(), " e"sv);
+    exact.remove_prefix(10);
+    ASSERT_EQ(exact.length(), 0);
+    String moved = std::move(growable);
+    moved.truncate(0);
+  }
+  ASSERT_EQ(resource.live_bytes, 0u)
+      << "Shortened buffers should be returned whole.";
+}
+
+TEST(AppendToSharedStringCopies) {
+  String foo{'x', 32};
+  foo.share();
+  String copy = foo;
+  copy.push_back('y');
+  ASSERT_EQ(foo.length(), 32);
+  ASSERT_EQ(copy.length(), 33);
+  ASSERT_EQ(foo.share_count(), 1);
+  ASSERT_EQ(view(copy, 32), StringView{"y"});
+}
+
+TEST(ProfileCountsAppends) {
+  if (!profile::kEnabled) return;
+  auto before = profile::snapshot();
+  String foo;
+  for (int i = 0; i < 100; i++) foo.push_back('z');
+  auto churn = profile::difference(profile::snapshot(), before);
+  ASSERT(churn[profile::Operation::kAppend].allocations > 0);
+  ASSERT_EQ(churn.allocations, churn[profile::Operation::kAppend].allocations);
+}
+
+TEST(StringBuilderHandsOverBuffer) {
+  StringBuilder out;
+  out << "{\"name\": \"" << "value" << '"' << '}';
+  for (int i = 0; i < 20; i++) out.append(", more", 6);
+  StringView built = out.view();
+  const char* data = built.data();
+  String message = out.build();
+  ASSERT(message.data() == data) << "build() should not copy the chars.";
+  ASSERT_EQ(view(message, 0, 17), StringView{"{\"name\": \"value\"}"});
+  ASSERT_EQ(message.length(), 17 + 20 * 6);
+  ASSERT_EQ(out.length(), 0);
+  out << "again";
+  ASSERT_EQ(out.build().data(), "again"sv);
+}
+
+TEST(StringBuilderReserve) {
+  StringBuilder out{4096};
+  ASSERT(out.capacity() >= 4096);
+  auto before = allocation_count;
+  for (int i = 0; i < 4096; i++) out << 'x';
+  ASSERT_EQ(allocation_count, before);
+  ASSERT(out.build() == String('x', 4096));
+}
+
+// A file in /tmp holding given contents, deleted when this goes out of scope.
+class TemporaryFile {
+ public:
+  explicit TemporaryFile(std::string_view contents) {
+    int file = mkstemp(path_);
+    if (file == -1) throw std::runtime_error("mkstemp failed");
+    bool written = write(file, contents.data(), contents.size()) ==
+                   static_cast<ssize_t>(contents.size());
+    close(file);
+    if (!written) throw std::runtime_error("write failed");
+  }
+  ~TemporaryFile() { unlink(path_); }
+  const char* path() const { return path_; }
+
+ private:
+  char path_[32] = "/tmp/string_test_XXXXXX";
+};
+
+TEST(MapFile) {
+  std::string contents;
+  for (int i = 0; i < 10000; i++) contents.push_back('a' + i % 26);
+  TemporaryFile file{contents};
+  String mapped = String::map_file(file.path());
+  ASSERT_EQ(mapped.length(), contents.size());
+  ASSERT_EQ(std::string_view(mapped.data(), mapped.length()), contents);
+  ASSERT_EQ(mapped.data()[mapped.length()], '\0');
+  ASSERT(mapped.resource() == nullptr);
+  StringView middle = substring(view(mapped), 5000, 10);
+  ASSERT(middle.data() == mapped.data() + 5000)
+      << "Views of a mapped string should point into the mapping.";
+  std::ostringstream output;
+  output << mapped;
+  ASSERT_EQ(output.str(), contents);
+  String moved = std::move(mapped);
+  ASSERT_EQ(moved.length(), contents.size());
+}
+
+TEST(MapFileFillingLastPage) {
+  std::string contents(sysconf(_SC_PAGESIZE), 'p');
+  TemporaryFile file{contents};
+  String mapped = String::map_file(file.path());
+  ASSERT_EQ(mapped.length(), contents.size());
+  ASSERT_EQ(mapped.data()[mapped.length()], '\0')
+      << "A zero page should follow a file which fills its last page.";
+  ASSERT_EQ(simd::length(mapped.data()), contents.size());
+}
+
+TEST(MapSmallAndEmptyFiles) {
+  TemporaryFile small{"tiny"}, empty{""};
+  String tiny = String::map_file(small.path());
+  ASSERT_EQ(tiny.data(), "tiny"sv);
+  ASSERT_EQ(tiny.capacity(), 15) << "Short files should just be read inline.";
+  String nothing = String::map_file(empty.path());
+  ASSERT_EQ(nothing.length(), 0);
+}
+
+TEST(MapMissingFile) {
+  try {
+    String::map_file("/nonexistent/file");
+  } catch (const std::system_error& error) {
+    ASSERT_EQ(error.code().value(), ENOENT);
+    return;
+  }
+  ASSERT(false) << "Mapping a missing file should throw.";
+}
+
+TEST(WriteToMappedStringCopies) {
+  std::string contents(100, 'm');
+  TemporaryFile file{contents};
+  String mapped = String::map_file(file.path());
+  String copy = mapped;
+  const char* mapping = std::as_const(mapped).data();
+  ASSERT(copy.data() != mapping) << "A copy should be on the heap.";
+  mapped.data()[0] = 'M';
+  ASSERT(std::as_const(mapped).data() != mapping);
+  mapped.push_back('!');
+  ASSERT_EQ(view(mapped, 0, 2), StringView{"Mm"});
+  ASSERT_EQ(mapped.length(), 101);
+  String again = String::map_file(file.path());
+  ASSERT_EQ(std::string_view(again.data(), again.length()), contents)
+      << "Writing to the string shouldn't change the file.";
+}
+
+// Collects the fields of a split as std::strings, to compare in one assert.
+std::vector<std::string> Fields(const Split& fields) {
+  std::vector<std::string> result;
+  for (StringView field : fields) {
+    result.emplace_back(field.data(), field.length());
+  }
+  return result;
+}
+
+TEST(SplitOnChar) {
+  using Strings = std::vector<std::string>;
+  ASSERT(Fields(split("id,name,,email", ',')) ==
+         (Strings{"id", "name", "", "email"}));
+  ASSERT(Fields(split(",a,", ',')) == (Strings{"", "a", ""}));
+  ASSERT(Fields(split("", ',')) == Strings{""});
+  ASSERT(Fields(split("abc", ',')) == Strings{"abc"});
+  std::string columns_text =
+      std::string(40, 'x') + "\t" + std::string(40, 'y');
+  String row{columns_text.data(), columns_text.size()};
+  Split columns = split(row, '\t');
+  std::vector<StringView> fields(columns.begin(), columns.end());
+  ASSERT_EQ(fields.size(), 2);
+  ASSERT(fields[0].data() == row.data()) << "Fields should be views.";
+  ASSERT_EQ(fields[1].length(), 40);
+}
+
+TEST(SplitOnString) {
+  using Strings = std::vector<std::string>;
+  ASSERT(Fields(split("a, b, , c", ", ")) ==
+         (Strings{"a", "b", "", "c"}));
+  ASSERT(Fields(split("a::::b", "::")) == (Strings{"a", "", "b"}));
+  ASSERT(Fields(split("a,b", StringView{})) == Strings{"a,b"});
+  ASSERT(Fields(split(StringView{"a\0b\0c", 5}, StringView{"\0", 1})) ==
+         (Strings{"a", "b", "c"}));
+}
+
+TEST(SplitOptions) {
+  using Strings = std::vector<std::string>;
+  ASSERT(Fields(split(",a,,b,", ',', kSkipEmpty)) == (Strings{"a", "b"}));
+  ASSERT(Fields(split(",,", ',', kSkipEmpty)).empty());
+  ASSERT(Fields(split(" a ,\tb\t, ", ',', kTrimWhitespace)) ==
+         (Strings{"a", "b", ""}));
+  ASSERT(Fields(split(" a , ,b", ',', kTrimWhitespace | kSkipEmpty)) ==
+         (Strings{"a", "b"}));
+}
+
+TEST(SplitLines) {
+  using Strings = std::vector<std::string>;
+  ASSERT(Fields(lines("one\ntwo\r\n\nthree")) ==
+         (Strings{"one", "two", "", "three"}));
+  ASSERT(Fields(lines("one\ntwo\n")) == (Strings{"one", "two"}));
+  ASSERT(Fields(lines("\n")) == Strings{""});
+  ASSERT(Fields(lines("")).empty());
+  ASSERT(Fields(lines("a\n\n  \nb\n", kTrimWhitespace | kSkipEmpty)) ==
+         (Strings{"a", "b"}));
+}
+
+TEST(SplitWithAlgorithms) {
+  String text{"alpha beta gamma delta epsilon zeta eta theta iota kappa"};
+  Split words = split(text, ' ');
+  ASSERT_EQ(std::distance(words.begin(), words.end()), 10);
+  auto found = std::find(words.begin(), words.end(), StringView{"theta"});
+  ASSERT(found != words.end());
+  ASSERT_EQ(found->data() - text.data(), 40);
+  Split::Iterator i = words.begin(), j = i++;
+  ASSERT(j == words.begin());
+  ASSERT_EQ(*i, StringView{"beta"});
+}
+
+TEST(SplitDoesNotAllocate) {
+  std::string csv;
+  for (int i = 0; i < 1000; i++) csv += "field,another field,,last\n";
+  String text{csv.data(), csv.size()};
+  auto before = allocation_count;
+  std::size_t rows = 0, fields = 0, bytes = 0;
+  for (StringView line : lines(text)) {
+    rows++;
+    for (StringView field : split(line, ',', kSkipEmpty)) {
+      fields++;
+      bytes += field.length();
+    }
+  }
+  auto after = allocation_count;
+  ASSERT_EQ(after, before);
+  ASSERT_EQ(rows, 1000);
+  ASSERT_EQ(fields, 3000);
+  ASSERT_EQ(bytes, 1000 * (5 + 13 + 4));
+}
+
+TEST(NumbersToString) {
+  ASSERT_EQ(to_string(0).data(), "0"sv);
+  ASSERT_EQ(to_string(-42).data(), "-42"sv);
+  ASSERT_EQ(to_string(std::numeric_limits<long long>::min()).data(),
+            "-9223372036854775808"sv);
+  ASSERT_EQ(to_string(std::numeric_limits<unsigned long long>::max()).data(),
+            "18446744073709551615"sv);
+  ASSERT_EQ(to_string(static_cast<unsigned char>(200)).data(), "200"sv);
+  ASSERT_EQ(to_string(0.1).data(), "0.1"sv);
+  ASSERT_EQ(to_string(0.1f).data(), "0.1"sv);
+  ASSERT_EQ(to_string(-12.5).data(), "-12.5"sv);
+  ASSERT_EQ(to_string(1e21).data(), "1e+21"sv);
+  ASSERT_EQ(to_string(-std::numeric_limits<double>::max()).data(),
+            "-1.7976931348623157e+308"sv);
+  ASSERT_EQ(to_string(std::numeric_limits<double>::infinity()).data(),
+            "inf"sv);
+  auto before = allocation_count;
+  String small = to_string(123456789012345);
+  auto after = allocation_count;
+  ASSERT_EQ(after, before);
+  ASSERT_EQ(small.data(), "123456789012345"sv);
+}
+
+TEST(AppendNumbers) {
+  String line{"latency_ms "};
+  append_number(line, 12.5);
+  line.push_back(' ');
+  append_number(line, -3);
+  ASSERT_EQ(line.data(), "latency_ms 12.5 -3"sv);
+  StringBuilder out;
+  out << "requests_total " << 1024u << '\n' << "ratio " << 0.25 << '\n';
+  String built = out.build();
+  ASSERT_EQ(built.data(), "requests_total 1024\nratio 0.25\n"sv);
+}
+
+TEST(ParseNumbers) {
+  ASSERT(parse_int("-42") == -42LL);
+  ASSERT(parse_int(view(String{"id=1234;"}, 3, 4)) == 1234LL);
+  ASSERT(parse_int("9223372036854775807") ==
+         std::numeric_limits<long long>::max());
+  ASSERT(!parse_int("9223372036854775808"));
+  ASSERT(!parse_int(""));
+  ASSERT(!parse_int(" 1"));
+  ASSERT(!parse_int("1 "));
+  ASSERT(!parse_int("+1"));
+  ASSERT(!parse_int("1.5"));
+  ASSERT(parse_uint("18446744073709551615") ==
+         std::numeric_limits<unsigned long long>::max());
+  ASSERT(!parse_uint("-1"));
+  ASSERT(parse_double("0.1") == 0.1);
+  ASSERT(parse_double("-2.5e-3") == -2.5e-3);
+  ASSERT(parse_double("7") == 7.0);
+  ASSERT(parse_double("inf") == std::numeric_limits<double>::infinity());
+  ASSERT(!parse_double("1e999"));
+  ASSERT(!parse_double("1,5"));
+  ASSERT(!parse_double(StringView{"1\0", 2}));
+}
+
+TEST(NumbersRoundTrip) {
+  std::mt19937_64 random{42};
+  for (int i = 0; i < 1000; i++) {
+    std::uint64_t bits = random();
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    if (value != value || value - value != 0) continue;  // nan or inf
+    ASSERT(parse_double(to_string(value)) == value) << to_string(value);
+    long long integer = static_cast<long long>(bits);
+    ASSERT(parse_int(to_string(integer)) == integer);
+  }
+}
+
+// Sequences which must be accepted or rejected, from the edges of each range
+// in the UTF-8 definition (RFC 3629).
+const std::vector<std::string_view> kValidUtf8 = {
+    "",
+    "plain ASCII",
+    "\x00"sv,
+    "\x7F",
+    "\xC2\x80",          // U+0080, the first 2-byte code point
+    "\xDF\xBF",          // U+07FF
+    "\xE0\xA0\x80",      // U+0800, the first 3-byte code point
+    "\xED\x9F\xBF",      // U+D7FF, just below the surrogates
+    "\xEE\x80\x80",      // U+E000, just above them
+    "\xEF\xBF\xBF",      // U+FFFF
+    "\xF0\x90\x80\x80",  // U+10000, the first 4-byte code point
+    "\xF4\x8F\xBF\xBF",  // U+10FFFF, the last code point
+    "na\xC3\xAFve caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80",
+};
+
+const std::vector<std::string_view> kInvalidUtf8 = {
+    "\x80",              // continuation without a lead
+    "\xBF",
+    "a\x80z",
+    "\xC2\x80\x80",      // one continuation too many
+    "\xC0\x80",          // overlong nul
+    "\xC1\xBF",          // overlong U+007F
+    "\xE0\x80\x80",      // overlong 3-byte
+    "\xE0\x9F\xBF",      // overlong U+07FF
+    "\xF0\x80\x80\x80",  // overlong 4-byte
+    "\xF0\x8F\xBF\xBF",  // overlong U+FFFF
+    "\xED\xA0\x80",      // U+D800, the first surrogate
+    "\xED\xBF\xBF",      // U+DFFF, the last surrogate
+    "\xF4\x90\x80\x80",  // U+110000, past the last code point
+    "\xF5\x80\x80\x80",  // leads which can't appear at all
+    "\xF8\x88\x80\x80\x80",
+    "\xFE",
+    "\xFF",
+    "\xC2",              // truncated sequences
+    "\xE2\x82",
+    "\xF0\x9F\x98",
+    "\xC2z",             // sequences cut short by ASCII
+    "\xE2\x82z",
+    "\xF0\x9F\x98z",
+    "\xE2z\xAC",
+};
+
+TEST(Utf8Conformance) {
+  ForEachIsa([](simd::Isa isa) {
+    for (auto text : kValidUtf8) {
+      ASSERT(is_valid_utf8(StringView{text.data(), text.size()}))
+          << "isa " << static_cast<int>(isa) << ": " << Dump(text);
+    }
+    for (auto text : kInvalidUtf8) {
+      ASSERT(!is_valid_utf8(StringView{text.data(), text.size()}))
+          << "isa " << static_cast<int>(isa) << ": " << Dump(text);
+    }
+  });
+}
+
+// Puts each sequence at every position in a run of ASCII long enough to span
+// several vectors, so that it lands across every block boundary, and at the
+// very end.
+TEST(Utf8AtEveryPosition) {
+  ForEachIsa([](simd::Isa isa) {
+    int errors = 0;
+    for (bool valid : {true, false}) {
+      for (auto sequence : valid ? kValidUtf8 : kInvalidUtf8) {
+        for (std::size_t at = 0; at < 100; at++) {
+          std::string text(at, 'x');
+          text += sequence;
+          if (is_valid_utf8(StringView{text.data(), text.size()}) != valid) {
+            errors++;
+          }
+          text.append(at % 40, 'y');
+          if (is_valid_utf8(StringView{text.data(), text.size()}) != valid) {
+            errors++;
+          }
+        }
+      }
+    }
+    ASSERT_EQ(errors, 0) << "isa " << static_cast<int>(isa);
+  });
+}
+
+// Cuts and corrupts random valid text and checks the vector kernels agree
+// with the scalar one.
+TEST(Utf8MatchesScalar) {
+  std::string text;
+  for (int i = 0; i < 40; i++) text += kValidUtf8[i % kValidUtf8.size()];
+  std::mt19937 random{7};
+  int errors = 0;
+  for (int trial = 0; trial < 2000; trial++) {
+    std::string sample = text.substr(random() % text.size());
+    sample.resize(random() % (sample.size() + 1));
+    if (trial % 2 == 1 && !sample.empty()) {
+      sample[random() % sample.size()] = static_cast<char>(random());
+    }
+    simd::Isa original = simd::selected();
+    simd::select(simd::Isa::kScalar);
+    bool expected = simd::valid_utf8(sample.data(), sample.size());
+    std::size_t expected_count =
+        simd::count_code_points(sample.data(), sample.size());
+    ForEachIsa([&](simd::Isa) {
+      if (simd::valid_utf8(sample.data(), sample.size()) != expected ||
+          simd::count_code_points(sample.data(), sample.size()) !=
+              expected_count) {
+        errors++;
+      }
+    });
+    simd::select(original);
+  }
+  ASSERT_EQ(errors, 0);
+}
+
+TEST(CountCodePoints) {
+  ASSERT_EQ(count_code_points(""), 0);
+  ASSERT_EQ(count_code_points("na\xC3\xAFve"), 5);
+  ASSERT_EQ(count_code_points("\xF0\x9F\x98\x80\xE2\x82\xAC"), 2);
+  std::string long_text;
+  for (int i = 0; i < 100; i++) long_text += "caf\xC3\xA9 ";
+  ForEachIsa([&](simd::Isa isa) {
+    ASSERT_EQ(count_code_points(StringView{long_text.data(),
+                                           long_text.size()}),
+              500)
+        << "isa " << static_cast<int>(isa);
+  });
+}
+
+TEST(Utf8Substring) {
+  StringView text{"na\xC3\xAFve caf\xC3\xA9"};
+  ASSERT_EQ(utf8_substring(text, 6), StringView{"caf\xC3\xA9"});
+  ASSERT_EQ(utf8_substring(text, 1, 3), StringView{"a\xC3\xAFv"});
+  ASSERT_EQ(utf8_substring(text, 9, 5), StringView{"\xC3\xA9"});
+  ASSERT_EQ(utf8_substring(text, 10).length(), 0);
+  ASSERT_EQ(utf8_substring(text, 50, 2).length(), 0);
+  std::string long_text;
+  for (int i = 0; i < 100; i++) long_text += "\xE2\x82\xAC";
+  StringView euros{long_text.data(), long_text.size()};
+  StringView middle = utf8_substring(euros, 30, 40);
+  ASSERT_EQ(middle.data() - euros.data(), 90);
+  ASSERT_EQ(middle.length(), 120);
+  ASSERT_EQ(utf8_substring(euros, 99).length(), 3);
+}
+
+TEST(TruncateUtf8) {
+  StringView text{"caf\xC3\xA9"};
+  ASSERT_EQ(truncate_utf8(text, 10), text);
+  ASSERT_EQ(truncate_utf8(text, 5), text);
+  ASSERT_EQ(truncate_utf8(text, 4), StringView{"caf"});
+  ASSERT_EQ(truncate_utf8(text, 0).length(), 0);
+  StringView emoji{"\xF0\x9F\x98\x80\xF0\x9F\x98\x80"};
+  ASSERT_EQ(truncate_utf8(emoji, 7).length(), 4);
+  ASSERT_EQ(truncate_utf8(emoji, 3).length(), 0);
+}
+
+TEST(SimdCaseAndReplaceAtEveryLength) {
+  ForEachIsa([](simd::Isa isa) {
+    char text[kMaxKernelLength], out[kMaxKernelLength];
+    for (int i = 0; i < kMaxKernelLength; i++) {
+      text[i] = "aZ@[`{\xC3\xA9"[i % 8];
+    }
+    int errors = 0;
+    for (int offset = 0; offset < 4; offset++) {
+      for (int length = 0; length < kMaxKernelLength - offset; length++) {
+        const char* in = text + offset;
+        simd::to_lower(out, in, length);
+        for (int i = 0; i < length; i++) {
+          char c = in[i];
+          errors += out[i] != (c >= 'A' && c <= 'Z' ? c + 32 : c);
+        }
+        simd::to_upper(out, in, length);
+        for (int i = 0; i < length; i++) {
+          char c = in[i];
+          errors += out[i] != (c >= 'a' && c <= 'z' ? c - 32 : c);
+        }
+        simd::replace_byte(out, in, length, '@', '#');
+        for (int i = 0; i < length; i++) {
+          errors += out[i] != (in[i] == '@' ? '#' : in[i]);
+        }
+      }
+    }
+    ASSERT_EQ(errors, 0) << "isa " << static_cast<int>(isa);
+  });
+}
+
+TEST(SimdMismatchIgnoringCaseAtEveryPosition) {
+  ForEachIsa([](simd::Isa isa) {
+    char a[kMaxKernelLength], b[kMaxKernelLength];
+    for (int i = 0; i < kMaxKernelLength; i++) {
+      a[i] = 'a' + i % 26;
+      b[i] = i % 3 ? 'A' + i % 26 : a[i];
+    }
+    int errors = 0;
+    for (int length = 0; length < kMaxKernelLength; length++) {
+      if (simd::mismatch_ignoring_case(a, b, length) != simd::Size(length)) {
+        errors++;
+      }
+      for (int position = 0; position < length; position++) {
+        char saved = b[position];
+        // '@' and '`' differ from 'A' and 'a' only in the case bit, and
+        // must not compare equal.
+        b[position] = a[position] == 'a' ? '`' : '@';
+        if (simd::mismatch_ignoring_case(a, b, length) !=
+            simd::Size(position)) {
+          errors++;
+        }
+        b[position] = saved;
+      }
+    }
+    ASSERT_EQ(errors, 0) << "isa " << static_cast<int>(isa);
+  });
+}
+
+TEST(CaseMapping) {
+  ASSERT_EQ(to_lower("Content-Type: TEXT/HTML").data(),
+            "content-type: text/html"sv);
+  ASSERT_EQ(to_upper("x-request-id \xC3\xA9").data(),
+            "X-REQUEST-ID \xC3\xA9"sv);
+  String header{"ACCEPT-ENCODING: GZIP, DEFLATE"};
+  const char* buffer = header.data();
+  to_lower_in_place(header);
+  ASSERT_EQ(header.data(), "accept-encoding: gzip, deflate"sv);
+  ASSERT(header.data() == buffer) << "In place shouldn't reallocate.";
+}
+
+TEST(ChangingSharedStringInPlaceCopies) {
+  String original{"Shared Header Value Which Is Long"};
+  original.share();
+  String copy = original;
+  to_upper_in_place(copy);
+  ASSERT_EQ(copy.data(), "SHARED HEADER VALUE WHICH IS LONG"sv);
+  ASSERT_EQ(std::as_const(original).data(),
+            "Shared Header Value Which Is Long"sv);
+  String unchanged = original;
+  replace_all_in_place(unchanged, "missing", "other");
+  ASSERT_EQ(unchanged.share_count(), 2)
+      << "Nothing to replace shouldn't unshare.";
+}
+
+TEST(Replace) {
+  ASSERT_EQ(replace("C:\\dir\\file", '\\', '/').data(), "C:/dir/file"sv);
+  String path{"a/long/path/with/several/parts"};
+  replace_in_place(path, '/', '.');
+  ASSERT_EQ(path.data(), "a.long.path.with.several.parts"sv);
+  ASSERT_EQ(replace(StringView{"a\0b", 3}, '\0', '-').data(), "a-b"sv);
+}
+
+TEST(ReplaceAll) {
+  ASSERT_EQ(replace_all("a, b, c", ", ", ",").data(), "a,b,c"sv);
+  ASSERT_EQ(replace_all("x", "x", "longer text").data(), "longer text"sv);
+  ASSERT_EQ(replace_all("aaaaa", "aa", "b").data(), "bba"sv);
+  ASSERT_EQ(replace_all("abc", "", "-").data(), "abc"sv);
+  ASSERT_EQ(replace_all("abc", "b", "").data(), "ac"sv);
+  ASSERT_EQ(replace_all("no match here", "zz", "y").data(), "no match here"sv);
+  std::string long_text;
+  for (int i = 0; i < 100; i++) long_text += "{name} ";
+  StringView template_text{long_text.data(), long_text.size()};
+  auto before = allocation_count;
+  String filled = replace_all(template_text, "{name}", "Ada Lovelace");
+  auto after = allocation_count;
+  ASSERT_EQ(after, before + 1);
+  ASSERT_EQ(filled.length(), 1300);
+  ASSERT_EQ(view(filled, 0, 13), StringView{"Ada Lovelace "});
+  String same_length{"2024-01-02 2024-03-04 and more text after"};
+  const char* buffer = same_length.data();
+  replace_all_in_place(same_length, "-", "/");
+  ASSERT_EQ(same_length.data(), "2024/01/02 2024/03/04 and more text after"sv);
+  ASSERT(same_length.data() == buffer);
+  replace_all_in_place(same_length, "2024", "24");
+  ASSERT_EQ(same_length.data(), "24/01/02 24/03/04 and more text after"sv);
+  // Views of the string itself stay as they were when the call was made.
+  String aliased{"abaaaaaaaaaaaaaaaaaaaa"};
+  replace_all_in_place(aliased, view(aliased, 0, 1), view(aliased, 1, 1));
+  ASSERT_EQ(aliased.data(), "bbbbbbbbbbbbbbbbbbbbbb"sv);
+  String shared_aliased{"ab, and a string long enough to be shared"};
+  shared_aliased.share();
+  replace_all_in_place(shared_aliased, view(shared_aliased, 0, 1),
+                       view(shared_aliased, 1, 1));
+  ASSERT_EQ(shared_aliased.data(),
+            "bb, bnd b string long enough to be shbred"sv);
+}
+
+TEST(Trim) {
+  ASSERT_EQ(trim("  value\r\n"), StringView{"value"});
+  ASSERT_EQ(trim(" \t\v\f\r\n ").length(), 0);
+  ASSERT_EQ(trim("").length(), 0);
+  ASSERT_EQ(trim("a b"), StringView{"a b"});
+  String padded{"   a value long enough to be on the heap   "};
+  trim_in_place(padded);
+  ASSERT_EQ(padded.data(), "a value long enough to be on the heap"sv);
+  const char* buffer = padded.data();
+  trim_in_place(padded);
+  ASSERT(padded.data() == buffer) << "Nothing to trim shouldn't reallocate.";
+  String line{"\t  a line read from somewhere, with its newline\r\n"};
+  buffer = line.data();
+  auto before = allocation_count;
+  trim_in_place(line);
+  ASSERT_EQ(allocation_count, before) << "Trimming shouldn't allocate.";
+  ASSERT(line.data() == buffer);
+  ASSERT_EQ(line.data(), "a line read from somewhere, with its newline"sv);
+  String shared{"  a shared string, which trimming must copy  "};
+  shared.share();
+  String copy = shared;
+  trim_in_place(copy);
+  ASSERT_EQ(copy.data(), "a shared string, which trimming must copy"sv);
+  ASSERT_EQ(shared.length(), 45);
+}
+
+TEST(CompareIgnoringCase) {
+  ASSERT(equals_ignoring_case("Content-Length", "content-LENGTH"));
+  ASSERT(!equals_ignoring_case("Content-Length", "Content-Lengths"));
+  ASSERT(!equals_ignoring_case("@", "`"));
+  ASSERT(!equals_ignoring_case("[", "{"));
+  ASSERT(!equals_ignoring_case("\xC3\xA9", "\xC3\x89"));
+  ASSERT_EQ(compare_ignoring_case("apple", "BANANA"), -1);
+  ASSERT_EQ(compare_ignoring_case("Banana", "apple"), 1);
+  ASSERT_EQ(compare_ignoring_case("APPLE", "apple"), 0);
+  ASSERT_EQ(compare_ignoring_case("app", "APPLE"), -1);
+  ASSERT_EQ(compare_ignoring_case("a_", "AB"), -1) << "'_' sorts before 'b'";
+}
+
+TEST(ThreadPoolRunsEveryTaskOnce) {
+  parallel::ThreadPool pool{4};
+  ASSERT_EQ(pool.threads(), 4u);
+  std::vector<std::atomic<int>> runs(1000);
+  for (int batch = 0; batch < 20; batch++) {
+    pool.run(runs.size(), [&](parallel::Size i) { runs[i]++; });
+  }
+  for (auto& count : runs) ASSERT_EQ(count.load(), 20);
+  // Batches from several threads take turns.
+  std::atomic<int> total{0};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&] {
+      for (int j = 0; j < 10; j++) {
+        pool.run(100, [&](parallel::Size) { total++; });
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  ASSERT_EQ(total.load(), 4000);
+  parallel::ThreadPool alone{1};
+  int serial = 0;
+  alone.run(10, [&](parallel::Size) { serial++; });
+  ASSERT_EQ(serial, 10);
+}
+
+TEST(ThreadPoolRunsNestedCallsInline) {
+  parallel::ThreadPool pool{4, 0, 64};
+  std::vector<std::atomic<int>> runs(100 * 10);
+  std::atomic<int> matches{0};
+  String text{'x', 1000};
+  pool.run(100, [&](parallel::Size i) {
+    pool.run(10, [&](parallel::Size j) { runs[i * 10 + j]++; });
+    if (parallel::count(view(text), 'x', pool) == 1000) matches++;
+  });
+  for (auto& count : runs) ASSERT_EQ(count.load(), 1);
+  ASSERT_EQ(matches.load(), 100);
+}
+
+TEST(ParallelMatchesSerial) {
+  // A threshold of 0 and tiny chunks split even short strings between
+  // threads, so every way a chunk can line up with the data is tried.
+  parallel::ThreadPool pool{4, 0, 64};
+  std::mt19937 random{19};
+  for (parallel::Size size : {0, 1, 63, 64, 65, 200, 1000, 4099}) {
+    std::string chars(size, ' ');
+    for (char& c : chars) c = "aBc-Z_"[random() % 6];
+    StringView v{chars.data(), chars.size()};
+    ASSERT_EQ(parallel::fill('x', size, pool), String('x', size));
+    ASSERT_EQ(parallel::copy(v, pool), String{v});
+    StringView half = substring(v, 0, size / 2);
+    ASSERT_EQ(parallel::concat(half, v, pool), String{half} + v);
+    ASSERT_EQ(parallel::to_lower(v, pool), to_lower(v));
+    ASSERT_EQ(parallel::to_upper(v, pool), to_upper(v));
+    ASSERT_EQ(parallel::replace(v, '-', '+', pool), replace(v, '-', '+'));
+    String s{v};
+    s.share();
+    String shared = s;
+    parallel::to_upper_in_place(s, pool);
+    ASSERT_EQ(s, to_upper(v));
+    ASSERT_EQ(shared, String{v}) << "Shared copies shouldn't change.";
+    parallel::to_lower_in_place(s, pool);
+    parallel::replace_in_place(s, 'z', '!', pool);
+    ASSERT_EQ(s, replace(to_lower(v), 'z', '!'));
+  }
+}
+
+TEST(ParallelSearchAcrossChunks) {
+  parallel::ThreadPool pool{4, 0, 64};
+  // Every match starts just before a chunk boundary and ends after it.
+  std::string chars(1024, '.');
+  for (std::size_t i = 62; i + 5 < chars.size(); i += 128) {
+    chars.replace(i, 5, "match");
+  }
+  StringView v{chars.data(), chars.size()};
+  ASSERT_EQ(parallel::find(v, "match", pool), 62);
+  ASSERT_EQ(parallel::find(v, "atch.", pool), 63);
+  ASSERT_EQ(parallel::find(v, "missing", pool), kNotFound);
+  ASSERT_EQ(parallel::find(v, 'h', pool), 66);
+  ASSERT_EQ(parallel::find(v, '!', pool), kNotFound);
+  ASSERT_EQ(parallel::count(v, "match", pool), 8);
+  ASSERT_EQ(parallel::count(v, 't', pool), 8);
+  ASSERT_EQ(parallel::count(v, "", pool), count(v, ""));
+  ASSERT_EQ(parallel::find(v, "", pool), 0);
+  // Overlapping matches count like count() does: "aaa" has one "aa".
+  std::string runs(1000, 'a');
+  StringView a{runs.data(), runs.size()};
+  ASSERT_EQ(parallel::count(a, "aa", pool), 500);
+  ASSERT_EQ(parallel::count(a, "aaa", pool), count(a, "aaa"));
+  ASSERT_EQ(parallel::find(a, "aaa", pool), 0);
+  // Random text, compared with the single-threaded search.
+  std::mt19937 random{23};
+  std::string text(5000, ' ');
+  for (char& c : text) c = "ab"[random() % 2];
+  StringView t{text.data(), text.size()};
+  for (StringView needle : {StringView{"ab"}, StringView{"bba"},
+                            StringView{"abab"}, StringView{"aabbb"},
+                            StringView{"bbbbbbbbbbbb"}}) {
+    ASSERT_EQ(parallel::find(t, needle, pool), find(t, needle)) << needle;
+    ASSERT_EQ(parallel::count(t, needle, pool), count(t, needle)) << needle;
+  }
+}
+
+TEST(StringLiterals) {
+  auto before = allocation_count;
+  String s = "a literal much too long to be stored inline"_s;
+  String copy = s;
+  String assigned;
+  assigned = kLongLiteral;
+  String short_one = "short"_s;
+  auto after = allocation_count;
+  ASSERT_EQ(after, before) << "Literals should never allocate.";
+  ASSERT_EQ(s, kLongLiteral);
+  ASSERT(std::as_const(copy).data() == std::as_const(s).data())
+      << "Copies should point at the literal.";
+  ASSERT(std::as_const(assigned).data() == kLongLiteral.data());
+  ASSERT_EQ(short_one.length(), 5);
+  ASSERT_EQ(s.share_count(), 1);
+  ASSERT(s.resource() == nullptr);
+  ASSERT_EQ(s.capacity(), s.length());
+  s.share();
+  ASSERT(std::as_const(s).data() == std::as_const(copy).data())
+      << "Sharing a literal should do nothing.";
+  // Changing a literal string copies it first.
+  copy.data()[0] = 'A';
+  ASSERT_EQ(copy.data(), "A literal much too long to be stored inline"sv);
+  ASSERT_EQ(s.data(), "a literal much too long to be stored inline"sv);
+  short_one.push_back('!');
+  ASSERT_EQ(short_one.data(), "short!"sv);
+  String reserved = "tiny"_s;
+  reserved.reserve(12);
+  ASSERT_EQ(reserved.data(), "tiny"sv);
+  ASSERT_EQ(reserved.capacity(), 15);
+  String empty = ""_s;
+  ASSERT_EQ(empty.length(), 0);
+  ASSERT_EQ(empty.data()[0], '\0');
+}
+
+TEST(StringLiteralsWork) {
+  String name{"world"};
+  ASSERT_EQ(String{"Hello, "_s + name + "!"_s}, StringView{"Hello, world!"});
+  ASSERT_EQ(concat("a"_s, '-', "b"_s), StringView{"a-b"});
+  ASSERT_EQ(substring("Hello, World!"_s, 7, 5), StringView{"World"});
+  ASSERT_EQ(substring(kLongLiteral, 2, 7), StringView{"literal"});
+  std::ostringstream output;
+  output << "literal"_s << ' ' << kGreeting;
+  ASSERT_EQ(output.str(), "literal Hello, World!");
+  ASSERT_EQ(find(kLongLiteral, "inline"_s), 37);
+  ASSERT("abc"_s < "abd"_s);
+  ASSERT_EQ(hash("key"_s), hash(String{"key"}));
+  std::unordered_map<String, int> counts;
+  counts["content-type"_s]++;
+  ASSERT_EQ(counts[String{"content-type"}], 1);
+}
+
+// A pipe with a thread reading everything written to it, optionally a little
+// at a time so that writers fill the pipe and have their writes cut short.
+class Pipe {
+ public:
+  explicit Pipe(std::size_t read_size = 65536) {
+    int ends[2];
+    if (pipe(ends) == -1) throw std::runtime_error("pipe failed");
+    read_end_ = ends[0];
+    write_end_ = ends[1];
+    reader_ = std::thread([this, read_size] {
+      std::vector<char> buffer(read_size);
+      ssize_t count;
+      while ((count = read(read_end_, buffer.data(), read_size)) > 0) {
+        contents_.append(buffer.data(), count);
+        if (read_size < 65536) usleep(100);
+      }
+    });
+  }
+  ~Pipe() { contents(); }
+  int fd() const { return write_end_; }
+  // Closes the write end and returns everything that was written.
+  const std::string& contents() {
+    if (write_end_ != -1) {
+      close(write_end_);
+      write_end_ = -1;
+      reader_.join();
+      close(read_end_);
+    }
+    return contents_;
+  }
+
+ private:
+  int read_end_, write_end_;
+  std::thread reader_;
+  std::string contents_;
+};
+
+TEST(OutputBatchWritesInOrder) {
+  Pipe pipe;
+  String name{"a name long enough to be on the heap"};
+  String body{'b', 200};
+  {
+    OutputBatch out{pipe.fd()};
+    out << "user="_s << name << ' ' << String{"id="} + "x" << 42 << ' '
+        << view(name, 2, 4) << " pi=" << 3.25 << '\n' << body;
+    out.add(String{'-', 20}).add("");
+    ASSERT_EQ(out.pieces(), 3) << "Short pieces should be written as one.";
+    ASSERT_EQ(out.length(), 282);
+    // Long pieces are pointed at, not copied.
+    body.data()[0] = 'B';
+    name.data()[0] = 'A';
+    out.flush();
+    ASSERT_EQ(out.pieces(), 0);
+    ASSERT_EQ(out.length(), 0);
+    out << "left for the destructor\n";
+  }
+  ASSERT_EQ(pipe.contents(),
+            "user=a name long enough to be on the heap id=x42 name pi=3.25\n" +
+                std::string(1, 'B') + std::string(199, 'b') +
+                "--------------------left for the destructor\n");
+}
+
+TEST(OutputBatchKeepsTemporaries) {
+  Pipe pipe;
+  OutputBatch out{pipe.fd()};
+  String shared{'s', 200};
+  shared.share();
+  std::string expected;
+  for (int i = 0; i < 100; i++) {
+    // Temporaries, each destroyed before the flush unless the batch keeps it.
+    out << String{static_cast<char>('a' + i % 26), String::Size(1 + i * 3)};
+    out << String{shared};
+    expected.append(1 + i * 3, 'a' + i % 26);
+    expected.append(200, 's');
+  }
+  ASSERT_EQ(shared.share_count(), 101)
+      << "Copies of a shared string should share its buffer.";
+  out.flush();
+  ASSERT_EQ(shared.share_count(), 1);
+  ASSERT_EQ(pipe.contents(), expected);
+}
+
+TEST(OutputBatchShortWrites) {
+  // The pipe is non-blocking and read slowly, so writes stop part way through
+  // a piece and the batch has to wait for room.
+  Pipe pipe{1000};
+  fcntl(pipe.fd(), F_SETFL, fcntl(pipe.fd(), F_GETFL) | O_NONBLOCK);
+  std::string expected;
+  {
+    OutputBatch out{pipe.fd()};
+    // More pieces than kMaxPieces, so some are written before the flush.
+    for (int i = 0; i < 3000; i++) {
+      std::string piece(1 + i % 997, 'A' + i % 26);
+      out << String{piece.data(), piece.size()};
+      expected += piece;
+      ASSERT(out.pieces() <= OutputBatch::kMaxPieces);
+    }
+    out.flush();
+  }
+  ASSERT_EQ(pipe.contents().size(), expected.size());
+  ASSERT(pipe.contents() == expected);
+}
+
+TEST(OutputBatchErrors) {
+  OutputBatch out{-1};
+  out << "copied, " << String{'k', 200} << "kept and copied";
+  bool thrown = false;
+  try {
+    out.flush();
+  } catch (const std::system_error& error) {
+    ASSERT_EQ(error.code().value(), EBADF);
+    thrown = true;
+  }
+  ASSERT(thrown) << "Writing to a bad descriptor should throw.";
+  ASSERT_EQ(out.pieces(), 3) << "Unwritten pieces should stay in the batch.";
+  ASSERT_EQ(out.length(), 223);
+}
+
+// Random keys which share long prefixes, end at every length up to a few
+// words and are full of '\0's. They are views of one buffer, so that there
+// can be more of them than the allocation table has room for.
+std::vector<std::string_view> SortKeys(std::string& buffer,
+                                       std::size_t count) {
+  std::mt19937 random(7);
+  const std::string prefixes[] = {"", "https://example.com/", "\0\0\0"s,
+                                  "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"};
+  std::vector<std::size_t> ends;
+  buffer.clear();
+  for (std::size_t i = 0; i < count; i++) {
+    buffer += prefixes[random() % 4];
+    std::size_t length = random() % 24;
+    for (std::size_t j = 0; j < length; j++) {
+      buffer += "\0ab\xff"[random() % 4];
+    }
+    ends.push_back(buffer.size());
+  }
+  std::vector<std::string_view> keys;
+  for (std::size_t i = 0, start = 0; i < count; start = ends[i++]) {
+    keys.emplace_back(buffer.data() + start, ends[i] - start);
+  }
+  return keys;
+}
+
+TEST(SortStringsMatchesStdSort) {
+  parallel::ThreadPool pool{4};
+  std::string buffer;
+  buffer.reserve(10 << 20);
+  for (std::size_t count : {0, 1, 2, 11, 100, 1000, 200000}) {
+    std::vector<std::string_view> expected = SortKeys(buffer, count);
+    std::vector<StringView> views;
+    for (auto key : expected) views.emplace_back(key.data(), key.size());
+    std::sort(expected.begin(), expected.end());
+    sort_strings(views, pool);
+    ASSERT_EQ(views.size(), count);
+    for (std::size_t i = 0; i < count; i++) {
+      ASSERT(std::string_view(views[i].data(), views[i].length()) ==
+             expected[i])
+          << "Position " << i << " of " << count << " is out of order.";
+    }
+    // Strings sort the same as views of them.
+    if (count > 1000) continue;
+    std::vector<String> strings;
+    for (auto view : views) strings.emplace_back(view);
+    std::shuffle(strings.begin(), strings.end(), std::mt19937(count));
+    sort_strings(strings, pool);
+    for (std::size_t i = 0; i < count; i++) ASSERT(strings[i] == views[i]);
+  }
+}
+
+TEST(SortStringsMovesRatherThanCopies) {
+  // Each String is moved rather than copied, so heap strings keep their
+  // buffers.
+  parallel::ThreadPool alone{1};
+  std::vector<String> strings;
+  std::vector<const char*> buffers;
+  for (int i = 0; i < 500; i++) {
+    strings.push_back(String{'a', String::Size(16 + (i * 37) % 101)});
+  }
+  for (auto& s : strings) buffers.push_back(s.data());
+  sort_strings(strings, alone);
+  for (std::size_t i = 1; i < strings.size(); i++) {
+    ASSERT(strings[i - 1] <= strings[i]);
+  }
+  std::vector<const char*> after;
+  for (auto& s : strings) after.push_back(s.data());
+  std::sort(buffers.begin(), buffers.end());
+  std::sort(after.begin(), after.end());
+  ASSERT(buffers == after) << "Sorting should never copy a string.";
+}
+
+TEST(StringColumnHoldsRows) {
+  StringColumn column;
+  ASSERT_EQ(column.size(), 0);
+  std::vector<std::string> rows = {"alice", "", "a row long enough for the heap",
+                                   "nul\0inside"s, "", "bob"};
+  for (auto& row : rows) column.append(StringView{row.data(), row.size()});
+  ASSERT_EQ(column.size(), rows.size());
+  ASSERT_EQ(column.bytes(), 48);
+  for (std::size_t i = 0; i < rows.size(); i++) {
+    ASSERT(std::string_view(column[i].data(), column[i].length()) == rows[i]);
+  }
+  ASSERT_EQ(column.offset(3), 35);
+  // Appending a row of the column itself.
+  column.append(column[0]);
+  ASSERT(column[6] == "alice");
+
+  std::vector<String> strings = column.to_strings();
+  ASSERT_EQ(strings.size(), 7);
+  ASSERT(strings[3] == (StringView{"nul\0inside", 10}));
+  StringColumn copy{strings};
+  ASSERT_EQ(copy.size(), 7);
+  ASSERT_EQ(copy.bytes(), column.bytes());
+  for (std::size_t i = 0; i < copy.size(); i++) ASSERT(copy[i] == column[i]);
+  copy.append("carol");
+  ASSERT(copy[7] == "carol");
+
+  StringColumn taken = column.take({5, 0, 1, 5});
+  ASSERT_EQ(taken.size(), 4);
+  ASSERT(taken[0] == "bob" && taken[1] == "alice" && taken[2] == "");
+  ASSERT(taken[3] == "bob");
+}
+
+TEST(StringColumnKernels) {
+  StringColumn column;
+  for (const char* row : {"abc", "cab", "", "ca", "bcab", "xyz", "ab", "ab"}) {
+    column.append(row);
+  }
+  using Rows = std::vector<StringColumn::Size>;
+  ASSERT(column.find("ab") == (Rows{0, 1, 4, 6, 7}));
+  // "cca" and "bca" run across rows, and must not be found.
+  ASSERT(column.find("cca") == Rows{});
+  ASSERT(column.find("bca") == (Rows{4}));
+  ASSERT(column.find("z") == (Rows{5}));
+  ASSERT(column.find("") == (Rows{0, 1, 2, 3, 4, 5, 6, 7}));
+  ASSERT(column.find_equal("ab") == (Rows{6, 7}));
+  ASSERT(column.find_equal("") == (Rows{2}));
+  ASSERT(column.find_equal("abcd") == Rows{});
+  ASSERT(column.filter([](StringView v) { return v.length() == 3; }) ==
+         (Rows{0, 1, 5}));
+
+  // Against a loop over the rows, on random rows from a small alphabet.
+  std::mt19937 random(3);
+  StringColumn big;
+  std::vector<std::string> rows;
+  for (int i = 0; i < 2000; i++) {
+    std::string row(random() % 8, 'a');
+    for (char& c : row) c = "ab\0"[random() % 3];
+    big.append(StringView{row.data(), row.size()});
+    rows.push_back(row);
+  }
+  for (std::string needle : {"a"s, "ab"s, "b\0a"s, "aaaa"s, "\0\0"s}) {
+    Rows expected;
+    for (std::size_t i = 0; i < rows.size(); i++) {
+      if (rows[i].find(needle) != std::string::npos) expected.push_back(i);
+    }
+    ASSERT(big.find(StringView{needle.data(), needle.size()}) == expected);
+  }
+}
+
+TEST(StringTableRoundTrip) {
+  std::vector<String> strings = {String{"alpha"}, String{},
+                                 String{"a row long enough for the heap"},
+                                 String{"nul\0inside", 10}, String{"alpha"}};
+  for (bool with_index : {true, false}) {
+    TemporaryFile file{""};
+    write_string_table(file.path(), strings, with_index);
+    StringTable table{file.path()};
+    ASSERT_EQ(table.has_index(), with_index);
+    ASSERT_EQ(table.size(), strings.size());
+    for (std::size_t i = 0; i < strings.size(); i++) {
+      ASSERT(table[i] == strings[i]);
+    }
+    ASSERT_EQ(table.find("alpha"), 0) << "The first of equal rows is found.";
+    ASSERT_EQ(table.find(""), 1);
+    ASSERT_EQ(table.find(StringView{"nul\0inside", 10}), 3);
+    ASSERT_EQ(table.find("nul"), kNotFound);
+    ASSERT_EQ(table.find("beta"), kNotFound);
+    // Moving a table keeps its views valid.
+    StringView row = table[2];
+    StringTable moved = std::move(table);
+    ASSERT(moved[2].data() == row.data());
+  }
+  TemporaryFile empty{""};
+  write_string_table(empty.path(), std::vector<String>{});
+  StringTable table{empty.path()};
+  ASSERT_EQ(table.size(), 0);
+  ASSERT_EQ(table.find("anything"), kNotFound);
+}
+
+TEST(StringTableLookups) {
+  StringColumn column;
+  for (int i = 0; i < 3000; i++) {
+    std::string key = std::string(i % 50, 'k') + std::to_string(i);
+    column.append(StringView{key.data(), key.size()});
+  }
+  TemporaryFile file{""};
+  write_string_table(file.path(), column);
+  StringTable table{file.path()};
+  for (int i = 0; i < 3000; i++) ASSERT_EQ(table.find(column[i]), i);
+  ASSERT_EQ(table.find("k3000"), kNotFound);
+}
+
+TEST(StringTableRewriteKeepsOldMapping) {
+  TemporaryFile file{""};
+  std::vector<String> old_rows;
+  for (int i = 0; i < 1000; i++) old_rows.emplace_back('o', 40);
+  write_string_table(file.path(), old_rows);
+  StringTable old_table{file.path()};
+  // A much shorter table: rewriting in place would truncate the mapping
+  // under old_table.
+  write_string_table(file.path(), std::vector<String>{String{"new"}});
+  StringTable new_table{file.path()};
+  ASSERT_EQ(new_table.size(), 1);
+  ASSERT(new_table[0] == "new");
+  ASSERT_EQ(old_table.size(), 1000);
+  for (int i = 0; i < 1000; i++) ASSERT(old_table[i] == old_rows[i]);
+  ASSERT_EQ(old_table.find(old_rows[0]), 0);
+  std::string temporary = std::string{file.path()} + ".tmp";
+  ASSERT(access(temporary.c_str(), F_OK) == -1)
+      << "The temporary file should be renamed away.";
+}
+
+TEST(StringTableRejectsBadFiles) {
+  auto rejects = [](const std::string& contents, bool verify) {
+    TemporaryFile file{contents};
+    try {
+      StringTable table{file.path(), verify};
+    } catch (const std::runtime_error&) {
+      return true;
+    }
+    return false;
+  };
+  TemporaryFile good{""};
+  write_string_table(good.path(),
+                     std::vector<String>{String{"one"}, String{"two"}});
+  String mapped = String::map_file(good.path());
+  std::string contents{mapped.data(), mapped.length()};
+  ASSERT(!rejects(contents, true));
+  ASSERT(rejects("tiny", false));
+  ASSERT(rejects(std::string(100, 'x'), false)) << "Wrong magic.";
+  ASSERT(rejects(contents.substr(0, contents.size() - 1), false))
+      << "Truncated.";
+  std::string newer = contents;
+  newer[8] = 2;
+  ASSERT(rejects(newer, false)) << "Wrong version.";
+  // A flipped char is only caught by the checksum.
+  std::string flipped = contents;
+  flipped.back() ^= 1;
+  ASSERT(rejects(flipped, true));
+  ASSERT(!rejects(flipped, false));
+  TemporaryFile file{flipped};
+  StringTable unverified{file.path(), false};
+  ASSERT(unverified[1] == "twn");
+}
+
+TEST(KeywordMatcherFindsEveryMatch) {
+  KeywordMatcher matcher{std::vector<String>{
+      String{"he"}, String{"she"}, String{"his"}, String{"hers"}, String{},
+      String{"he"}, String{"\0x", 2}}};
+  ASSERT_EQ(matcher.patterns(), 7);
+  using Match = KeywordMatcher::Match;
+  auto pairs = [](const std::vector<Match>& matches) {
+    std::vector<std::pair<std::size_t, std::size_t>> result;
+    for (Match m : matches) result.emplace_back(m.pattern, m.position);
+    return result;
+  };
+  // Longest first at the same end, and equal patterns in the order given.
+  ASSERT(pairs(matcher.find_all("ushers")) ==
+         (std::vector<std::pair<std::size_t, std::size_t>>{
+             {1, 1}, {0, 2}, {5, 2}, {3, 2}}));
+  ASSERT(pairs(matcher.find_all(StringView{"a\0x\0", 4})) ==
+         (std::vector<std::pair<std::size_t, std::size_t>>{{6, 1}}));
+  ASSERT(matcher.find_all("nothing to see").empty());
+  Match first = matcher.find_first("ushers");
+  ASSERT_EQ(first.pattern, 1);
+  ASSERT_EQ(first.position, 1);
+  ASSERT_EQ(matcher.find_first("xyz").pattern, kNotFound);
+  ASSERT(KeywordMatcher{std::vector<String>{}}.find_all("abc").empty());
+}
+
+TEST(KeywordMatcherMatchesSearch) {
+  // Against find() for each pattern, on random texts and patterns over a
+  // small alphabet, so that patterns overlap and share prefixes and
+  // suffixes. Many patterns push most states out of the full rows.
+  std::mt19937 random(11);
+  auto random_text = [&](std::size_t length) {
+    std::string text(length, 'a');
+    for (char& c : text) c = "abc\0"[random() % 4];
+    return text;
+  };
+  for (int patterns : {1, 5, 50, 300}) {
+    std::vector<std::string> strings;
+    std::vector<StringView> views;
+    for (int i = 0; i < patterns; i++) {
+      strings.push_back(random_text(1 + random() % 7));
+    }
+    for (auto& s : strings) views.emplace_back(s.data(), s.size());
+    KeywordMatcher matcher{views};
+    std::string text = random_text(500);
+    std::vector<std::pair<std::size_t, std::size_t>> expected, found, streamed;
+    for (std::size_t p = 0; p < strings.size(); p++) {
+      for (std::size_t i = text.find(strings[p]); i != std::string::npos;
+           i = text.find(strings[p], i + 1)) {
+        expected.emplace_back(p, i);
+      }
+    }
+    matcher.for_each_match(StringView{text.data(), text.size()},
+                           [&](KeywordMatcher::Match m) {
+                             found.emplace_back(m.pattern, m.position);
+                           });
+    std::sort(expected.begin(), expected.end());
+    std::sort(found.begin(), found.end());
+    ASSERT(found == expected) << patterns << " patterns.";
+    // Fed in chunks of every size from 1 to 9.
+    KeywordMatcher::Stream stream{matcher};
+    for (std::size_t i = 0, size = 1; i < text.size(); i += size++ % 9) {
+      StringView chunk{text.data() + i, std::min(size % 9, text.size() - i)};
+      stream.feed(chunk, [&](KeywordMatcher::Match m) {
+        streamed.emplace_back(m.pattern, m.position);
+      });
+    }
+    ASSERT_EQ(stream.position(), text.size());
+    std::sort(streamed.begin(), streamed.end());
+    ASSERT(streamed == expected) << patterns << " patterns, streamed.";
+  }
+}
+
 // // This test will fail because of memory corruption.
 // TEST(DoubleDelete) {
 //   int* a = new int;
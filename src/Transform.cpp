@@ -0,0 +1,145 @@
+#include <utility>
+#include "../include/Search.h"
+#include "../include/Simd.h"
+#include "../include/Transform.h"
+
+using Size = StringView::Size;
+
+namespace {
+
+bool IsWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' ||
+         c == '\f';
+}
+
+char ToLower(char c) { return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c; }
+
+}  // namespace
+
+String to_lower(StringView v) {
+  String result = String::uninitialized(v.length());
+  simd::to_lower(result.data(), v.data(), v.length());
+  return result;
+}
+
+String to_upper(StringView v) {
+  String result = String::uninitialized(v.length());
+  simd::to_upper(result.data(), v.data(), v.length());
+  return result;
+}
+
+void to_lower_in_place(String& s) {
+  simd::to_lower(s.data(), s.data(), s.length());
+}
+
+void to_upper_in_place(String& s) {
+  simd::to_upper(s.data(), s.data(), s.length());
+}
+
+String replace(StringView v, char from, char to) {
+  String result = String::uninitialized(v.length());
+  simd::replace_byte(result.data(), v.data(), v.length(), from, to);
+  return result;
+}
+
+void replace_in_place(String& s, char from, char to) {
+  simd::replace_byte(s.data(), s.data(), s.length(), from, to);
+}
+
+String replace_all(StringView v, StringView needle, StringView replacement) {
+  if (needle.length() == 0) return String{v};
+  // The counting pass keeps the first kRemembered matches, so that the
+  // copying pass only has to search again for any after them.
+  constexpr Size kRemembered = 64;
+  Size remembered[kRemembered];
+  Size matches = 0;
+  for (Size i = find(v, needle); i != kNotFound;
+       i = find(v, needle, i + needle.length())) {
+    if (matches < kRemembered) remembered[matches] = i;
+    matches++;
+  }
+  if (matches == 0) return String{v};
+  Size length = v.length() - matches * needle.length() +
+                matches * replacement.length();
+  String result = String::uninitialized(length);
+  char* out = result.data();
+  Size start = 0;
+  for (Size i = 0; i < matches; i++) {
+    Size match = i < kRemembered ? remembered[i] : find(v, needle, start);
+    simd::copy(out, v.data() + start, match - start);
+    out += match - start;
+    simd::copy(out, replacement.data(), replacement.length());
+    out += replacement.length();
+    start = match + needle.length();
+  }
+  simd::copy(out, v.data() + start, v.length() - start);
+  return result;
+}
+
+void replace_all_in_place(String& s, StringView needle,
+                          StringView replacement) {
+  if (needle.length() == 0) return;
+  if (needle.length() != replacement.length()) {
+    if (find(s, needle) != kNotFound) s = replace_all(s, needle, replacement);
+    return;
+  }
+  // The first match is found in a view of s, so that a shared string is only
+  // copied once there is something to change.
+  Size match = find(s, needle);
+  if (match == kNotFound) return;
+  // needle and replacement may be views of s itself, which the writes below
+  // (or the copy that data() makes of a shared string) would pull out from
+  // under them, so those are copied first.
+  const char* begin = std::as_const(s).data();
+  const char* end = begin + s.length();
+  String needle_copy, replacement_copy;
+  if (needle.data() < end && begin < needle.data() + needle.length()) {
+    needle_copy = String{needle};
+    needle = view(needle_copy);
+  }
+  if (replacement.data() < end &&
+      begin < replacement.data() + replacement.length()) {
+    replacement_copy = String{replacement};
+    replacement = view(replacement_copy);
+  }
+  char* data = s.data();
+  StringView chars{data, s.length()};
+  for (; match != kNotFound; match = find(chars, needle, match)) {
+    simd::copy(data + match, replacement.data(), replacement.length());
+    match += needle.length();
+  }
+}
+
+StringView trim(StringView v) {
+  const char* first = v.data();
+  const char* last = first + v.length();
+  while (first != last && IsWhitespace(*first)) first++;
+  while (last != first && IsWhitespace(last[-1])) last--;
+  return StringView{first, Size(last - first)};
+}
+
+void trim_in_place(String& s) {
+  StringView trimmed = trim(s);
+  Size front = trimmed.data() - std::as_const(s).data();
+  // Dropping the front first means a shared string is copied at most once.
+  s.remove_prefix(front);
+  s.truncate(trimmed.length());
+}
+
+bool equals_ignoring_case(StringView a, StringView b) {
+  if (a.length() != b.length()) return false;
+  return simd::mismatch_ignoring_case(a.data(), b.data(), a.length()) ==
+         a.length();
+}
+
+int compare_ignoring_case(StringView a, StringView b) {
+  Size common = a.length() < b.length() ? a.length() : b.length();
+  Size i = simd::mismatch_ignoring_case(a.data(), b.data(), common);
+  if (i < common) {
+    auto x = static_cast<unsigned char>(ToLower(a.data()[i]));
+    auto y = static_cast<unsigned char>(ToLower(b.data()[i]));
+    return x < y ? -1 : 1;
+  }
+  if (a.length() == b.length()) return 0;
+  return a.length() < b.length() ? -1 : 1;
+}
@@ -0,0 +1,61 @@
+#include "../include/Simd.h"
+#include "../include/Utf8.h"
+
+using Size = StringView::Size;
+
+namespace {
+
+bool IsContinuation(char c) { return (c & 0xC0) == 0x80; }
+
+// Returns the index of the start of the count'th code point after position
+// from in v, or v.length() if there aren't that many. Whole blocks with no
+// more code points than are left to skip are counted with the vector kernel
+// rather than stepped through.
+Size SkipCodePoints(StringView v, Size from, Size count) {
+  constexpr Size kBlock = 64;
+  const char* data = v.data();
+  Size i = from;
+  while (v.length() - i >= kBlock) {
+    Size starts = simd::count_code_points(data + i, kBlock);
+    if (starts > count) break;
+    count -= starts;
+    i += kBlock;
+  }
+  for (; i < v.length(); i++) {
+    if (IsContinuation(data[i])) continue;
+    if (count == 0) return i;
+    count--;
+  }
+  return v.length();
+}
+
+}  // namespace
+
+bool is_valid_utf8(StringView v) {
+  return simd::valid_utf8(v.data(), v.length());
+}
+
+Size count_code_points(StringView v) {
+  return simd::count_code_points(v.data(), v.length());
+}
+
+StringView utf8_substring(StringView v, Size start) {
+  Size first = SkipCodePoints(v, 0, start);
+  return StringView{v.data() + first, v.length() - first};
+}
+
+StringView utf8_substring(StringView v, Size start, Size length) {
+  Size first = SkipCodePoints(v, 0, start);
+  Size last = SkipCodePoints(v, first, length);
+  return StringView{v.data() + first, last - first};
+}
+
+StringView truncate_utf8(StringView v, Size max_length) {
+  if (v.length() <= max_length) return v;
+  Size end = max_length;
+  // A code point is at most four bytes, so this backs up at most three.
+  while (end > 0 && max_length - end < 3 && IsContinuation(v.data()[end])) {
+    end--;
+  }
+  return StringView{v.data(), end};
+}